@@ -0,0 +1,144 @@
+#include "database.hpp"
+#include "message_dispatch.hpp"
+#include <benchmark/benchmark.h>
+
+// Frame-level cost always runs. The write families need a MongoDB at
+// MONGODB_URI and use a scratch database that is dropped afterwards.
+namespace {
+
+QByteArray unread_frame(int chat_ID) {
+    return QByteArray(R"({"type":"update_unread_message","chatID":)") + QByteArray::number(chat_ID) + "}";
+}
+
+QByteArray batch_envelope(int operation_count) {
+    QByteArray envelope = R"({"type":"batch","batch_id":7,"operations":[)";
+    for (int chat_ID = 1; chat_ID <= operation_count; chat_ID++) {
+        if (chat_ID > 1)
+            envelope += ',';
+
+        envelope += unread_frame(chat_ID);
+    }
+
+    return envelope + "]}";
+}
+
+void report(benchmark::State &state) {
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// One WebSocket frame per operation, each parsed and decoded on its own
+void individual_frames(benchmark::State &state) {
+    QList<QByteArray> frames;
+    for (int chat_ID = 1; chat_ID <= state.range(0); chat_ID++)
+        frames.append(unread_frame(chat_ID));
+
+    for (auto _ : state) {
+        for (const QByteArray &frame : frames) {
+            json_frame json;
+            json.parse(frame);
+
+            chat_frame decoded;
+            bool ok = message_dispatch::type_of(json) == message_dispatch::UpdateUnreadMessage && message_dispatch::decode(json, decoded);
+            benchmark::DoNotOptimize(ok);
+        }
+    }
+
+    report(state);
+}
+
+// The same operations carried in one batch envelope
+void batch_frame(benchmark::State &state) {
+    const QByteArray envelope = batch_envelope(state.range(0));
+
+    for (auto _ : state) {
+        json_frame json;
+        json.parse(envelope);
+
+        QList<QByteArray> elements;
+        json.elements(json.find("operations"), elements);
+
+        for (QByteArray &element : elements) {
+            json_frame operation;
+            operation.parse(std::move(element));
+
+            chat_frame decoded;
+            bool ok = message_dispatch::type_of(operation) == message_dispatch::UpdateUnreadMessage && message_dispatch::decode(operation, decoded);
+            benchmark::DoNotOptimize(ok);
+        }
+    }
+
+    report(state);
+}
+
+mongocxx::database &scratch_db() {
+    static mongocxx::instance instance{};
+    static mongocxx::client connection{mongocxx::uri{std::getenv("MONGODB_URI")}};
+    static mongocxx::database db = connection.database("chatAppBenchmark");
+
+    return db;
+}
+
+void seed_chats(int operation_count) {
+    scratch_db().collection("chats").drop();
+
+    for (int chat_ID = 1; chat_ID <= operation_count; chat_ID++)
+        Account::insert_document(scratch_db(), "chats", QJsonObject{{"_id", chat_ID}, {"messages", QJsonArray{}}});
+}
+
+QJsonObject push_object(int chat_ID) {
+    return QJsonObject{{"$push", QJsonObject{{"messages", QJsonObject{{"message", "ok"}, {"sender", chat_ID}, {"time", "2024-06-01T18:42:13Z"}}}}}};
+}
+
+// One round trip per operation, as separate frames produce
+void individual_writes(benchmark::State &state) {
+    seed_chats(state.range(0));
+
+    for (auto _ : state) {
+        for (int chat_ID = 1; chat_ID <= state.range(0); chat_ID++)
+            Account::update_document(scratch_db(), "chats", QJsonObject{{"_id", chat_ID}}, push_object(chat_ID));
+    }
+
+    report(state);
+}
+
+// The same writes queued inside a batch and sent as one bulk_write
+void merged_writes(benchmark::State &state) {
+    seed_chats(state.range(0));
+
+    for (auto _ : state) {
+        Account::begin_batch();
+
+        for (int chat_ID = 1; chat_ID <= state.range(0); chat_ID++)
+            Account::update_document(scratch_db(), "chats", QJsonObject{{"_id", chat_ID}}, push_object(chat_ID));
+
+        bool written = Account::commit_batch(scratch_db());
+        benchmark::DoNotOptimize(written);
+    }
+
+    report(state);
+}
+
+void register_benchmarks() {
+    benchmark::RegisterBenchmark("individual_frames", individual_frames)->RangeMultiplier(4)->Range(1, 256);
+    benchmark::RegisterBenchmark("batch_frame", batch_frame)->RangeMultiplier(4)->Range(1, 256);
+
+    if (std::getenv("MONGODB_URI")) {
+        benchmark::RegisterBenchmark("individual_writes", individual_writes)->RangeMultiplier(4)->Range(1, 256)->Unit(benchmark::kMillisecond)->UseRealTime();
+        benchmark::RegisterBenchmark("merged_writes", merged_writes)->RangeMultiplier(4)->Range(1, 256)->Unit(benchmark::kMillisecond)->UseRealTime();
+    }
+}
+
+}
+
+int main(int argc, char **argv) {
+    register_benchmarks();
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    if (std::getenv("MONGODB_URI"))
+        scratch_db().drop();
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#!/usr/bin/env bash
+# Starts 1..MAX_NODES server processes on the tcp cluster bus, on one host,
+# and drives each size with load_generator at USERS_PER_NODE users per node.
+# Users are spread round-robin over the nodes, so every friend pair spans
+# two of them and all direct texts cross the bus. Capacity scales linearly
+# when text recv/s grows with the node count while p99 stays flat; give it
+# at least one core per node. Database and S3 settings come from the
+# environment, as for a single server.
+#
+#   benchmarks/cluster_scaling.sh <server_app> <load_generator> [max_nodes] [users_per_node] [-- load_generator options]
+set -euo pipefail
+
+if [ $# -lt 2 ]; then
+    sed -n '2,12p' "$0"
+    exit 1
+fi
+
+server=$1
+generator=$2
+shift 2
+
+max_nodes=4
+users_per_node=200
+if [[ ${1:-} =~ ^[0-9]+$ ]]; then max_nodes=$1; shift; fi
+if [[ ${1:-} =~ ^[0-9]+$ ]]; then users_per_node=$1; shift; fi
+if [ "${1:-}" = "--" ]; then shift; fi
+
+base_port=${BASE_PORT:-22000}
+
+export CHAT_APP_CLUSTER_BUS=tcp
+export CHAT_APP_CLUSTER_SECRET=${CHAT_APP_CLUSTER_SECRET:-$(head -c 32 /dev/urandom | base64)}
+
+pids=()
+stop_nodes() {
+    if [ ${#pids[@]} -gt 0 ]; then
+        kill "${pids[@]}" 2>/dev/null || true
+        wait "${pids[@]}" 2>/dev/null || true
+    fi
+    pids=()
+}
+trap stop_nodes EXIT
+
+wait_for_port() {
+    for _ in $(seq 1 100); do
+        if (exec 3<>"/dev/tcp/127.0.0.1/$1") 2>/dev/null; then
+            return 0
+        fi
+        sleep 0.2
+    done
+    echo "nothing listening on port $1" >&2
+    return 1
+}
+
+summary="nodes users text_recv/s text_p99_ms"
+for nodes in $(seq 1 "$max_nodes"); do
+    peers=""
+    for node in $(seq 0 $((nodes - 1))); do
+        peers+="127.0.0.1:$((base_port + 1000 + node)),"
+    done
+
+    urls=()
+    for node in $(seq 0 $((nodes - 1))); do
+        CHAT_APP_SERVER_PORT=$((base_port + node)) \
+        CHAT_APP_METRICS_PORT=$((base_port + 2000 + node)) \
+        CHAT_APP_CLUSTER_NODE="127.0.0.1:$((base_port + 1000 + node))" \
+        CHAT_APP_CLUSTER_PEERS="$peers" \
+            "$server" 2>"cluster_node_${nodes}_${node}.log" &
+        pids+=($!)
+        urls+=(--url "ws://127.0.0.1:$((base_port + node))")
+    done
+
+    for node in $(seq 0 $((nodes - 1))); do
+        wait_for_port $((base_port + node))
+    done
+
+    # Let the mesh finish its handshakes before users log in
+    sleep 3
+
+    users=$((nodes * users_per_node))
+    output=$("$generator" "${urls[@]}" --users "$users" --base-number $((700000000 + nodes * 1000000)) "$@")
+    echo "$output"
+
+    summary+=$'\n'"$nodes $users $(echo "$output" | awk '$1 == "text" { print $4, $7; exit }')"
+
+    stop_nodes
+done
+
+echo
+echo "$summary" | awk '{ printf "%-6s %-7s %-12s %s\n", $1, $2, $3, $4 }'
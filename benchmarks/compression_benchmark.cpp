@@ -0,0 +1,164 @@
+#include "frame_compression.hpp"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <array>
+#include <benchmark/benchmark.h>
+
+// CPU per frame against bytes saved, for tuning CHAT_APP_COMPRESSION_LEVEL,
+// _MIN_BYTES and _DICTIONARY. Frames mimic what the server sends: login
+// contacts and groups chunks, and the small text and typing frames the
+// threshold is meant to skip. The dictionary variants use one built from
+// frames of a different seed, the way an operator would build one from
+// captured traffic. The ratio counter is input over output, saved_bytes is
+// per frame; inflate runs at level 6.
+namespace {
+
+const QStringList words{"hey", "see", "you", "at", "the", "usual", "place", "tomorrow", "sounds", "good", "running", "late", "lunch", "meeting", "call", "me", "when", "free"};
+
+QString sentence(QRandomGenerator &random) {
+    QStringList picked;
+    for (int word = 0, count = random.bounded(3, 14); word < count; word++)
+        picked.append(words[random.bounded(static_cast<int>(words.size()))]);
+
+    return picked.join(' ');
+}
+
+QString time_of(QRandomGenerator &random) {
+    return QString("2024-06-%1T%2:%3:%4Z").arg(random.bounded(1, 29), 2, 10, QChar('0')).arg(random.bounded(24), 2, 10, QChar('0')).arg(random.bounded(60), 2, 10, QChar('0')).arg(random.bounded(60), 2, 10, QChar('0'));
+}
+
+QJsonArray messages(QRandomGenerator &random, int owner, int contact, int count) {
+    QJsonArray history;
+    for (int index = 0; index < count; index++)
+        history.append(QJsonObject{{"message", sentence(random)}, {"sender_ID", random.bounded(2) ? owner : contact}, {"time", time_of(random)}});
+
+    return history;
+}
+
+QByteArray contacts_chunk(quint32 seed) {
+    QRandomGenerator random(seed);
+    const int owner = random.bounded(100000000, 999999999);
+
+    QJsonArray contacts;
+    for (int contact = 0; contact < 12; contact++) {
+        const int contact_ID = random.bounded(100000000, 999999999);
+
+        contacts.append(QJsonObject{{"contactInfo", QJsonObject{{"_id", contact_ID}, {"first_name", "First" + QString::number(contact)}, {"last_name", "Last" + QString::number(contact)}, {"status", random.bounded(2) == 1}, {"image_url", "https://bucket.s3.amazonaws.com/" + QString::number(contact_ID) + ".png"}}},
+                                    {"chatID", random.bounded(1, 1000000)},
+                                    {"unread_messages", random.bounded(5)},
+                                    {"chatMessages", messages(random, owner, contact_ID, 8)}});
+    }
+
+    return QJsonDocument(QJsonObject{{"type", "contacts_chunk"}, {"contacts", contacts}}).toJson(QJsonDocument::Compact);
+}
+
+QByteArray groups_chunk(quint32 seed) {
+    QRandomGenerator random(seed);
+
+    QJsonArray groups;
+    for (int group = 0; group < 4; group++) {
+        QJsonArray members;
+        for (int member = 0; member < 8; member++)
+            members.append(random.bounded(100000000, 999999999));
+
+        QJsonArray history;
+        for (int index = 0; index < 30; index++)
+            history.append(QJsonObject{{"message", sentence(random)}, {"sender_ID", members[random.bounded(8)]}, {"sender_name", "Member" + QString::number(random.bounded(8))}, {"time", time_of(random)}});
+
+        groups.append(QJsonObject{{"groupID", random.bounded(1, 1000000)}, {"group_name", "Group " + QString::number(group)}, {"group_image_url", QString()}, {"unread_messages", random.bounded(5)}, {"group_members", members}, {"group_messages", history}});
+    }
+
+    return QJsonDocument(QJsonObject{{"type", "groups_chunk"}, {"groups", groups}}).toJson(QJsonDocument::Compact);
+}
+
+QByteArray text(quint32 seed) {
+    QRandomGenerator random(seed);
+
+    return QJsonDocument(QJsonObject{{"type", "text"}, {"message", sentence(random)}, {"time", time_of(random)}, {"sender_ID", 123456789}, {"chatID", random.bounded(1, 1000000)}}).toJson(QJsonDocument::Compact);
+}
+
+QByteArray typing(quint32) {
+    return R"({"type":"is_typing","sender_ID":123456789})";
+}
+
+struct sample {
+    const char *name;
+    QByteArray (*make)(quint32);
+};
+
+const std::array<sample, 4> samples{{{"contacts_chunk", contacts_chunk}, {"groups_chunk", groups_chunk}, {"text", text}, {"is_typing", typing}}};
+
+// zlib only looks at the last 32 KiB, where the most common strings belong
+QByteArray dictionary() {
+    QByteArray training;
+    for (quint32 seed = 1000; training.size() < 64 * 1024; seed++) {
+        for (const sample &kind : samples)
+            training += kind.make(seed);
+    }
+
+    return training.right(32 * 1024);
+}
+
+const QByteArray shared_dictionary = dictionary();
+
+void deflate_frame(benchmark::State &state) {
+    const QByteArray frame = samples[state.range(0)].make(1);
+    frame_compression compression(static_cast<int>(state.range(1)), state.range(2) ? shared_dictionary : QByteArray());
+
+    qsizetype output_size = frame.size();
+    for (auto _ : state) {
+        QByteArray compressed = compression.compress(frame);
+        output_size = compressed.isNull() ? frame.size() : compressed.size();
+
+        benchmark::DoNotOptimize(compressed);
+    }
+
+    state.SetBytesProcessed(state.iterations() * frame.size());
+    state.counters["input_bytes"] = static_cast<double>(frame.size());
+    state.counters["ratio"] = static_cast<double>(frame.size()) / static_cast<double>(output_size);
+    state.counters["saved_bytes"] = static_cast<double>(frame.size() - output_size);
+}
+
+void inflate_frame(benchmark::State &state) {
+    const QByteArray frame = samples[state.range(0)].make(1);
+    frame_compression compression(6, state.range(1) ? shared_dictionary : QByteArray());
+
+    const QByteArray compressed = compression.compress(frame);
+    if (compressed.isNull()) {
+        state.SkipWithError("frame does not compress");
+        return;
+    }
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(compression.decompress(compressed, 64 * 1024 * 1024));
+
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+
+void register_benchmarks() {
+    for (int kind = 0; kind < static_cast<int>(samples.size()); kind++) {
+        for (int with_dictionary : {0, 1}) {
+            std::string suffix = std::string("/") + samples[kind].name + (with_dictionary ? "/dictionary" : "");
+
+            for (int level : {1, 3, 6, 9})
+                benchmark::RegisterBenchmark(("deflate_frame" + suffix + "/level:" + std::to_string(level)).c_str(), deflate_frame)->Args({kind, level, with_dictionary});
+
+            benchmark::RegisterBenchmark(("inflate_frame" + suffix).c_str(), inflate_frame)->Args({kind, with_dictionary});
+        }
+    }
+}
+
+}
+
+int main(int argc, char **argv) {
+    register_benchmarks();
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::AddCustomContext("dictionary_bytes", std::to_string(shared_dictionary.size()));
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
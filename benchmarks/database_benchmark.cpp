@@ -0,0 +1,352 @@
+#include "database.hpp"
+#include <benchmark/benchmark.h>
+
+// Security and the JSON/BSON conversions always run. Account families need a
+// MongoDB at MONGODB_URI and seed a scratch database that is dropped
+// afterwards; S3 families need CHAT_APP_S3_ENDPOINT (or real credentials)
+// and CHAT_APP_BUCKET_NAME. Fixture sizes come from CHAT_APP_BENCH_CONTACTS
+// (default 500) and CHAT_APP_BENCH_MESSAGES (default 50000) and are recorded
+// in the JSON context, so --benchmark_out=<file> --benchmark_out_format=json
+// runs can be compared with tools/compare.py.
+namespace {
+
+constexpr int owner_ID = 1;
+constexpr int large_chat_ID = 1;
+constexpr int group_count = 20;
+
+int fixture_size(const char *variable, int fallback) {
+    const char *value = std::getenv(variable);
+    return value ? std::max(1, std::atoi(value)) : fallback;
+}
+
+const int contact_count = fixture_size("CHAT_APP_BENCH_CONTACTS", 500);
+const int message_count = fixture_size("CHAT_APP_BENCH_MESSAGES", 50000);
+
+QJsonObject message(int index) {
+    return QJsonObject{{"message", "Message number " + QString::number(index) + " of the benchmark fixture"},
+                       {"sender", index % 2 ? owner_ID : owner_ID + 1},
+                       {"time", "2024-06-01T18:42:13Z"}};
+}
+
+QJsonObject chat(int chat_ID, int messages) {
+    QJsonArray history;
+    for (int index = 0; index < messages; index++)
+        history.append(message(index));
+
+    return QJsonObject{{"_id", chat_ID}, {"messages", history}};
+}
+
+QJsonObject account(int phone_number, int contacts) {
+    QJsonArray contact_array;
+    for (int contact = 1; contact <= contacts; contact++)
+        contact_array.append(QJsonObject{{"contactID", owner_ID + contact}, {"chatID", contact}, {"unread_messages", 0}});
+
+    QJsonArray group_array;
+    for (int group_ID = 1; group_ID <= (contacts ? group_count : 0); group_ID++)
+        group_array.append(QJsonObject{{"groupID", group_ID}, {"group_unread_messages", 0}});
+
+    return QJsonObject{{"_id", phone_number},
+                       {"first_name", "Bench"},
+                       {"last_name", QString::number(phone_number)},
+                       {"status", false},
+                       {"image_url", "contact.png"},
+                       {"contacts", contact_array},
+                       {"groups", group_array}};
+}
+
+// The conversions every Account call makes on the way in and out
+bsoncxx::document::value to_bson(const QJsonObject &object) {
+    return bsoncxx::from_json(QJsonDocument(object).toJson(QJsonDocument::Compact).toStdString());
+}
+
+QJsonObject to_json(const bsoncxx::document::view &document) {
+    return QJsonDocument::fromJson(QString::fromStdString(bsoncxx::to_json(document)).toUtf8()).object();
+}
+
+void report_bytes(benchmark::State &state, qsizetype bytes) {
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+void salt(benchmark::State &state) {
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Security::generate_random_salt(32));
+}
+
+void hash_password(benchmark::State &state) {
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Security::hashing_password("correct horse battery staple"));
+}
+
+void verify_password(benchmark::State &state) {
+    const std::string hashed_password = Security::hashing_password("correct horse battery staple");
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Security::verifying_password("correct horse battery staple", hashed_password));
+}
+
+void json_to_bson(benchmark::State &state) {
+    const QJsonObject object = chat(large_chat_ID, state.range(0));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(to_bson(object));
+
+    report_bytes(state, QJsonDocument(object).toJson(QJsonDocument::Compact).size());
+}
+
+void bson_to_json(benchmark::State &state) {
+    const bsoncxx::document::value document = to_bson(chat(large_chat_ID, state.range(0)));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(to_json(document.view()));
+
+    report_bytes(state, static_cast<qsizetype>(document.view().length()));
+}
+
+mongocxx::database &scratch_db() {
+    static mongocxx::instance instance{};
+    static mongocxx::client connection{mongocxx::uri{std::getenv("MONGODB_URI")}};
+    static mongocxx::database db = connection.database("chatAppBenchmark");
+
+    return db;
+}
+
+void insert_in_chunks(const std::string &collection_name, int first, int last, const std::function<QJsonObject(int)> &make) {
+    QJsonArray operations;
+    for (int id = first; id <= last; id++) {
+        operations.append(QJsonObject{{"insert_one", QJsonObject{{"document", make(id)}}}});
+
+        if (operations.size() == 1000 || id == last) {
+            Account::bulk_write(scratch_db(), collection_name, operations);
+            operations = QJsonArray();
+        }
+    }
+}
+
+// One owner with contact_count contacts, each with its own chat and account,
+// and group_count groups. Chat 1 holds message_count messages, the rest 20.
+void seed_fixture() {
+    mongocxx::database &db = scratch_db();
+    db.drop();
+
+    Account::insert_document(db, "accounts", account(owner_ID, contact_count));
+    insert_in_chunks("accounts", owner_ID + 1, owner_ID + contact_count, [](int id) { return account(id, 0); });
+
+    Account::insert_document(db, "chats", chat(large_chat_ID, message_count));
+    insert_in_chunks("chats", large_chat_ID + 1, contact_count, [](int id) { return chat(id, 20); });
+
+    insert_in_chunks("groups", 1, group_count, [](int id) {
+        QJsonArray members;
+        for (int member = owner_ID; member <= std::min(owner_ID + 50, owner_ID + contact_count); member++)
+            members.append(member);
+
+        QJsonArray history;
+        for (int index = 0; index < 100; index++)
+            history.append(message(index));
+
+        return QJsonObject{{"_id", id},
+                           {"group_name", "Group " + QString::number(id)},
+                           {"group_admin", owner_ID},
+                           {"group_image_url", "networking.png"},
+                           {"group_members", members},
+                           {"group_messages", history}};
+    });
+}
+
+void find_account(benchmark::State &state) {
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Account::find_document(scratch_db(), "accounts", QJsonObject{{"_id", owner_ID}}));
+}
+
+void find_account_projected(benchmark::State &state) {
+    const QJsonObject fields{{"first_name", 1}, {"last_name", 1}, {"image_url", 1}, {"status", 1}};
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Account::find_document(scratch_db(), "accounts", QJsonObject{{"_id", owner_ID}}, fields));
+}
+
+void find_large_chat(benchmark::State &state) {
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Account::find_document(scratch_db(), "chats", QJsonObject{{"_id", large_chat_ID}}));
+
+    state.SetItemsProcessed(state.iterations() * message_count);
+}
+
+// Cursor to QJsonArray conversion over many small documents
+void find_many_accounts(benchmark::State &state) {
+    const QJsonObject filter{{"_id", QJsonObject{{"$gt", owner_ID}}}};
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Account::find_document(scratch_db(), "accounts", filter));
+
+    state.SetItemsProcessed(state.iterations() * contact_count);
+}
+
+void fetch_contacts_and_chats(benchmark::State &state) {
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Account::fetch_contacts_and_chats(scratch_db(), owner_ID));
+}
+
+void fetch_groups_and_chats(benchmark::State &state) {
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Account::fetch_groups_and_chats(scratch_db(), owner_ID));
+}
+
+void fetch_contactIDs(benchmark::State &state) {
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Account::fetch_contactIDs(scratch_db(), owner_ID));
+}
+
+void insert_and_delete(benchmark::State &state) {
+    const QJsonObject document = account(owner_ID + contact_count + 1, 0);
+    const QJsonObject filter{{"_id", document["_id"]}};
+
+    for (auto _ : state) {
+        Account::insert_document(scratch_db(), "accounts", document);
+        Account::delete_document(scratch_db(), "accounts", filter);
+    }
+}
+
+// Appends to the large chat, as a text frame does; the pushes are pulled
+// back outside the timed region so the fixture keeps its size
+void push_message(benchmark::State &state) {
+    const QJsonObject filter{{"_id", large_chat_ID}};
+    const QJsonObject update{{"$push", QJsonObject{{"messages", message(-1)}}}};
+
+    for (auto _ : state)
+        Account::update_document(scratch_db(), "chats", filter, update);
+
+    Account::update_document(scratch_db(), "chats", filter, QJsonObject{{"$pull", QJsonObject{{"messages", QJsonObject{{"sender", message(-1)["sender"]}, {"message", message(-1)["message"]}}}}}});
+}
+
+void update_many_contacts(benchmark::State &state) {
+    const QJsonObject filter{{"_id", QJsonObject{{"$gt", owner_ID}}}};
+    const QJsonObject update{{"$set", QJsonObject{{"status", false}}}};
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Account::update_many(scratch_db(), "accounts", filter, update));
+
+    state.SetItemsProcessed(state.iterations() * contact_count);
+}
+
+void bulk_write_unread(benchmark::State &state) {
+    QJsonArray operations;
+    for (int contact = 1; contact <= contact_count; contact++) {
+        operations.append(QJsonObject{{"update_one", QJsonObject{{"filter", QJsonObject{{"_id", owner_ID}, {"contacts.chatID", contact}}},
+                                                                 {"update", QJsonObject{{"$set", QJsonObject{{"contacts.$.unread_messages", 0}}}}}}}});
+    }
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Account::bulk_write(scratch_db(), "accounts", operations));
+
+    state.SetItemsProcessed(state.iterations() * contact_count);
+}
+
+Aws::S3::S3Client &s3_client() {
+    static Aws::SDKOptions options{};
+    static bool initialized = (Aws::InitAPI(options), true);
+    (void)initialized;
+
+    static Aws::S3::S3Client client = []() {
+        Aws::Client::ClientConfiguration configuration;
+        if (const char *region = std::getenv("CHAT_APP_BUCKET_REGION"))
+            configuration.region = region;
+
+        const char *endpoint = std::getenv("CHAT_APP_S3_ENDPOINT");
+        if (endpoint)
+            configuration.endpointOverride = endpoint;
+
+        Aws::Auth::AWSCredentials credentials(std::getenv("CHAT_APP_ACCESS_KEY") ? std::getenv("CHAT_APP_ACCESS_KEY") : "",
+                                              std::getenv("CHAT_APP_SECRET_ACCESS_KEY") ? std::getenv("CHAT_APP_SECRET_ACCESS_KEY") : "");
+
+        return Aws::S3::S3Client(credentials, configuration, Aws::Client::AWSAuthV4Signer::PayloadSigningPolicy::Never, endpoint == nullptr);
+    }();
+
+    return client;
+}
+
+std::string s3_key(benchmark::State &state) {
+    return "benchmark/object_" + std::to_string(state.range(0));
+}
+
+void s3_store(benchmark::State &state) {
+    const std::string data(state.range(0), 'x');
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(S3::store_data_to_s3(s3_client(), s3_key(state), data));
+
+    report_bytes(state, state.range(0));
+}
+
+void s3_get(benchmark::State &state) {
+    S3::store_data_to_s3(s3_client(), s3_key(state), std::string(state.range(0), 'x'));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(S3::get_data_from_s3(s3_client(), s3_key(state)));
+
+    report_bytes(state, state.range(0));
+}
+
+void s3_delete(benchmark::State &state) {
+    const std::string data(state.range(0), 'x');
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        S3::store_data_to_s3(s3_client(), s3_key(state), data);
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(S3::delete_data_from_s3(s3_client(), s3_key(state)));
+    }
+}
+
+void register_benchmarks() {
+    benchmark::AddCustomContext("fixture_contacts", std::to_string(contact_count));
+    benchmark::AddCustomContext("fixture_messages", std::to_string(message_count));
+
+    benchmark::RegisterBenchmark("security/generate_random_salt", salt);
+    benchmark::RegisterBenchmark("security/hashing_password", hash_password)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("security/verifying_password", verify_password)->Unit(benchmark::kMillisecond);
+
+    benchmark::RegisterBenchmark("convert/json_to_bson", json_to_bson)->RangeMultiplier(10)->Range(10, message_count)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("convert/bson_to_json", bson_to_json)->RangeMultiplier(10)->Range(10, message_count)->Unit(benchmark::kMicrosecond);
+
+    if (std::getenv("MONGODB_URI")) {
+        seed_fixture();
+
+        const std::vector<std::pair<const char *, void (*)(benchmark::State &)>> account_benchmarks{
+            {"account/find_document", find_account},
+            {"account/find_document_projected", find_account_projected},
+            {"account/find_document_large_chat", find_large_chat},
+            {"account/find_document_many", find_many_accounts},
+            {"account/fetch_contacts_and_chats", fetch_contacts_and_chats},
+            {"account/fetch_groups_and_chats", fetch_groups_and_chats},
+            {"account/fetch_contactIDs", fetch_contactIDs},
+            {"account/insert_and_delete_document", insert_and_delete},
+            {"account/update_document_push", push_message},
+            {"account/update_many", update_many_contacts},
+            {"account/bulk_write", bulk_write_unread}};
+
+        for (const auto &[name, function] : account_benchmarks)
+            benchmark::RegisterBenchmark(name, function)->Unit(benchmark::kMillisecond)->UseRealTime();
+    }
+
+    if (std::getenv("CHAT_APP_BUCKET_NAME") && (std::getenv("CHAT_APP_S3_ENDPOINT") || std::getenv("CHAT_APP_ACCESS_KEY"))) {
+        benchmark::RegisterBenchmark("s3/store_data_to_s3", s3_store)->RangeMultiplier(16)->Range(1 << 10, 1 << 22)->Unit(benchmark::kMillisecond)->UseRealTime();
+        benchmark::RegisterBenchmark("s3/get_data_from_s3", s3_get)->RangeMultiplier(16)->Range(1 << 10, 1 << 22)->Unit(benchmark::kMillisecond)->UseRealTime();
+        benchmark::RegisterBenchmark("s3/delete_data_from_s3", s3_delete)->Arg(1 << 10)->Unit(benchmark::kMillisecond)->UseRealTime();
+    }
+}
+
+}
+
+int main(int argc, char **argv) {
+    register_benchmarks();
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    if (std::getenv("MONGODB_URI"))
+        scratch_db().drop();
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "message_dispatch.hpp"
+#include <QHash>
+#include <benchmark/benchmark.h>
+
+using MessageType = message_dispatch::MessageType;
+
+namespace {
+
+QString to_qstring(std::string_view view) {
+    return QString::fromLatin1(view.data(), static_cast<qsizetype>(view.size()));
+}
+
+QJsonValue sample_value(const int &) { return 123456789; }
+QJsonValue sample_value(const QString &) { return QStringLiteral("Hey, are we still on for tonight?"); }
+QJsonValue sample_value(const QJsonArray &) { return QJsonArray{123456789, 234567891, 345678912, 456789123}; }
+QJsonValue sample_value(const QByteArrayView &) { return QStringLiteral("iVBORw0KGgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJAAAADUlEQVR42mNkYPhfDwAChwGA60e6kgAAAABJRU5ErkJggg=="); }
+
+void legacy_assign(const QJsonValue &value, int &out) { out = value.toInt(); }
+void legacy_assign(const QJsonValue &value, QString &out) { out = value.toString(); }
+void legacy_assign(const QJsonValue &value, QJsonArray &out) { out = value.toArray(); }
+void legacy_assign(const QJsonValue &value, QByteArrayView &out) {
+    static QByteArray storage;
+    storage = value.toString().toUtf8();
+    out = storage;
+}
+
+template <MessageType Type>
+using frame_of = std::tuple_element_t<Type, message_dispatch::frames>;
+
+template <MessageType Type>
+QJsonObject sample_frame() {
+    using Frame = frame_of<Type>;
+
+    QJsonObject json_object{{"type", to_qstring(message_dispatch::names[Type])}};
+
+    Frame frame;
+    std::apply([&](const auto &...fields) { (json_object.insert(to_qstring(fields.name), sample_value(frame.*std::decay_t<decltype(fields)>::member)), ...); }, Frame::fields());
+
+    return json_object;
+}
+
+// The dispatch path before compile-time tables: QHash<QString> type lookup,
+// then one QString-keyed lookup per handler argument. Both paths start from
+// an already parsed frame, parse cost is covered by parser_benchmark
+template <MessageType Type>
+void qhash_dispatch(benchmark::State &state) {
+    static const QHash<QString, int> map = [] {
+        QHash<QString, int> map;
+        for (int type = 0; type < message_dispatch::TypeCount; type++)
+            map.insert(to_qstring(message_dispatch::names[type]), type);
+
+        return map;
+    }();
+
+    using Frame = frame_of<Type>;
+    const QJsonObject json_object = sample_frame<Type>();
+
+    for (auto _ : state) {
+        int type = map.value(json_object["type"].toString());
+
+        Frame frame;
+        std::apply([&](const auto &...fields) { (legacy_assign(json_object[to_qstring(fields.name)], frame.*std::decay_t<decltype(fields)>::member), ...); }, Frame::fields());
+
+        benchmark::DoNotOptimize(type);
+        benchmark::DoNotOptimize(frame);
+    }
+}
+
+template <MessageType Type>
+void perfect_hash_dispatch(benchmark::State &state) {
+    using Frame = frame_of<Type>;
+
+    json_frame json;
+    json.parse(QJsonDocument(sample_frame<Type>()).toJson(QJsonDocument::Compact));
+
+    for (auto _ : state) {
+        MessageType type = message_dispatch::type_of(json);
+
+        Frame frame;
+        bool decoded = message_dispatch::decode(json, frame);
+
+        benchmark::DoNotOptimize(type);
+        benchmark::DoNotOptimize(decoded);
+        benchmark::DoNotOptimize(frame);
+    }
+}
+
+void unknown_type_rejection(benchmark::State &state) {
+    const QString type_name = QStringLiteral("client_connected");
+
+    for (auto _ : state) {
+        MessageType type = message_dispatch::type_of(std::u16string_view(reinterpret_cast<const char16_t *>(type_name.utf16()), type_name.size()));
+        benchmark::DoNotOptimize(type);
+    }
+}
+
+template <std::size_t... Types>
+void register_benchmarks(std::index_sequence<Types...>) {
+    (benchmark::RegisterBenchmark(("qhash_dispatch/" + std::string(message_dispatch::names[Types])).c_str(), qhash_dispatch<static_cast<MessageType>(Types)>), ...);
+    (benchmark::RegisterBenchmark(("perfect_hash_dispatch/" + std::string(message_dispatch::names[Types])).c_str(), perfect_hash_dispatch<static_cast<MessageType>(Types)>), ...);
+
+    benchmark::RegisterBenchmark("unknown_type_rejection", unknown_type_rejection);
+}
+
+}
+
+int main(int argc, char **argv) {
+    register_benchmarks(std::make_index_sequence<message_dispatch::TypeCount>{});
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
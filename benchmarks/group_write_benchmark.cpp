@@ -0,0 +1,102 @@
+#include "database.hpp"
+#include <benchmark/benchmark.h>
+
+// Needs a reachable MongoDB at MONGODB_URI. Works on a scratch database that
+// is dropped before and after the run.
+namespace {
+
+constexpr int group_ID = 4242;
+
+mongocxx::database &scratch_db() {
+    static mongocxx::instance instance{};
+    static mongocxx::client connection{mongocxx::uri{std::getenv("MONGODB_URI") ? std::getenv("MONGODB_URI") : "mongodb://localhost:27017"}};
+    static mongocxx::database db = connection.database("chatAppBenchmark");
+
+    return db;
+}
+
+QJsonArray seed_members(int member_count) {
+    mongocxx::database &db = scratch_db();
+    db.collection("accounts").drop();
+
+    QJsonArray members;
+    for (int phone_number = 1; phone_number <= member_count; phone_number++) {
+        Account::insert_document(db, "accounts", QJsonObject{{"_id", phone_number},
+                                                              {"first_name", "Member"},
+                                                              {"contacts", QJsonArray{}},
+                                                              {"groups", QJsonArray{QJsonObject{{"groupID", group_ID}, {"group_unread_messages", 0}}}}});
+        members.append(phone_number);
+    }
+
+    return members;
+}
+
+void report(benchmark::State &state) {
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["members"] = static_cast<double>(state.range(0));
+}
+
+// The old fan-out: one positional update per member
+void per_member_update_document(benchmark::State &state) {
+    const QJsonArray members = seed_members(state.range(0));
+    const QJsonObject increment_object{{"$inc", QJsonObject{{"groups.$.group_unread_messages", 1}}}};
+
+    for (auto _ : state) {
+        for (const QJsonValue &phone_number : members)
+            Account::update_document(scratch_db(), "accounts", QJsonObject{{"_id", phone_number}, {"groups.groupID", group_ID}}, increment_object);
+    }
+
+    report(state);
+}
+
+void update_many_array_filters(benchmark::State &state) {
+    const QJsonArray members = seed_members(state.range(0));
+    const QJsonObject increment_object{{"$inc", QJsonObject{{"groups.$[group].group_unread_messages", 1}}}};
+
+    for (auto _ : state) {
+        bool updated = Account::update_many(scratch_db(), "accounts", QJsonObject{{"_id", QJsonObject{{"$in", members}}}}, increment_object,
+                                            QJsonArray{QJsonObject{{"group.groupID", group_ID}}});
+        benchmark::DoNotOptimize(updated);
+    }
+
+    report(state);
+}
+
+void ordered_bulk_write(benchmark::State &state) {
+    const QJsonArray members = seed_members(state.range(0));
+
+    QJsonArray operations;
+    for (const QJsonValue &phone_number : members) {
+        operations.append(QJsonObject{{"update_one", QJsonObject{{"filter", QJsonObject{{"_id", phone_number}, {"groups.groupID", group_ID}}},
+                                                                 {"update", QJsonObject{{"$inc", QJsonObject{{"groups.$.group_unread_messages", 1}}}}}}}});
+    }
+
+    for (auto _ : state) {
+        bool written = Account::bulk_write(scratch_db(), "accounts", operations);
+        benchmark::DoNotOptimize(written);
+    }
+
+    report(state);
+}
+
+void register_benchmarks() {
+    auto configure = [](benchmark::internal::Benchmark *benchmark) { benchmark->RangeMultiplier(10)->Range(10, 1000)->Unit(benchmark::kMillisecond)->UseRealTime(); };
+
+    configure(benchmark::RegisterBenchmark("per_member_update_document", per_member_update_document));
+    configure(benchmark::RegisterBenchmark("update_many_array_filters", update_many_array_filters));
+    configure(benchmark::RegisterBenchmark("ordered_bulk_write", ordered_bulk_write));
+}
+
+}
+
+int main(int argc, char **argv) {
+    register_benchmarks();
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    scratch_db().drop();
+
+    return 0;
+}
@@ -0,0 +1,615 @@
+#include "metrics.hpp"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <QWebSocket>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+// Simulates N users against a running server: each signs up, logs in, makes
+// a friend and joins a group, then sends text, group_text, typing and file
+// frames at the configured per-user rates. Users are spread over worker
+// threads, each with its own event loop. Delivery latency is measured at the
+// receiving user from a send timestamp carried in the frame, request latency
+// at the sender. --go-server runs the same scenario against GOserver/
+// afterwards as a baseline. --slow-readers stalls that many users for the
+// steady state and samples the server's outbound queues and resident memory,
+// which should level off at the eviction limit instead of growing.
+// --upload-baseline repeats the run without uploads, so text latency with
+// the Bulk lane saturated can be read against an idle one.
+namespace {
+
+struct options {
+    QUrl url;
+    QList<QUrl> nodes;
+    int users{100};
+    int threads{4};
+    int duration{30};
+    double text_rate{1.0};
+    double group_rate{0.2};
+    double typing_rate{0.5};
+    double file_rate{0.02};
+    int file_bytes{16 * 1024};
+    int group_size{8};
+    int base_number{700000000};
+    int slow_readers{0};
+    QUrl metrics_url;
+    qint64 server_pid{0};
+};
+
+enum Kind {
+    SignUp,
+    Login,
+    LookupFriend,
+    NewGroup,
+    Text,
+    GroupText,
+    Typing,
+    File,
+    KindCount
+};
+
+constexpr std::array<const char *, KindCount> kind_names{"sign_up", "login", "lookup_friend", "new_group", "text", "group_text", "is_typing", "file"};
+
+struct report {
+    std::array<std::atomic<quint64>, KindCount> sent{};
+    std::array<std::atomic<quint64>, KindCount> received{};
+    std::array<metrics::histogram, KindCount> latency{};
+    std::atomic<quint64> errors{0};
+
+    // Users done with the current phase
+    std::atomic<int> ready{0};
+
+    // Sampled from the server during the steady state, -1 when unavailable
+    std::vector<double> queued_bytes{};
+    std::vector<qint64> resident_kb{};
+    double evictions{-1};
+};
+
+qint64 now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class simulated_user : public QObject {
+  public:
+    simulated_user(int index, const options &settings, report &results, QObject *parent)
+        : QObject(parent), _index(index), _number(settings.base_number + index), _settings(settings), _results(results) {
+        connect(&_socket, &QWebSocket::textMessageReceived, this, [this](const QString &message) { on_message(message); });
+        connect(&_socket, &QWebSocket::connected, this, [this]() {
+            send(SignUp, QJsonObject{{"type", "sign_up"},
+                                     {"phone_number", _number},
+                                     {"first_name", "Load"},
+                                     {"last_name", QString::number(_index)},
+                                     {"password", "load-generator"},
+                                     {"secret_question", "q"},
+                                     {"secret_answer", "a"}});
+        });
+    }
+
+    // Round-robin over the nodes, so each pair of friends spans two of them
+    void start() { _socket.open(_settings.nodes.isEmpty() ? _settings.url : _settings.nodes[_index % _settings.nodes.size()]); }
+
+    // Even users look up the next odd one; the odd one learns the chat from added_you
+    void befriend() {
+        if (_index % 2 == 0 && _index + 1 < _settings.users)
+            send(LookupFriend, QJsonObject{{"type", "lookup_friend"}, {"phone_number", _number + 1}});
+        else if (_index % 2 == 0)
+            _results.ready++;
+    }
+
+    void create_group() {
+        if (_index % _settings.group_size)
+            return;
+
+        QJsonArray members;
+        for (int member = _index; member < std::min(_index + _settings.group_size, _settings.users); member++)
+            members.append(_settings.base_number + member);
+
+        send(NewGroup, QJsonObject{{"type", "new_group"}, {"group_name", "load " + QString::number(_index)}, {"group_members", members}});
+    }
+
+    void run() {
+        _running = true;
+
+        schedule(Text, _settings.text_rate);
+        schedule(GroupText, _settings.group_rate);
+        schedule(Typing, _settings.typing_rate);
+        schedule(File, _settings.file_rate);
+    }
+
+    void stop() {
+        _running = false;
+        _socket.close();
+    }
+
+  private:
+    QWebSocket _socket{};
+    int _index;
+    int _number;
+    const options &_settings;
+    report &_results;
+
+    int _peer{0};
+    int _chat_ID{0};
+    int _group_ID{0};
+    bool _running{false};
+
+    std::array<qint64, KindCount> _sent_at{};
+
+    void send(Kind kind, const QJsonObject &message) {
+        _sent_at[kind] = now_ns();
+        _results.sent[kind]++;
+
+        _socket.sendTextMessage(QString::fromUtf8(QJsonDocument(message).toJson(QJsonDocument::Compact)));
+    }
+
+    void answered(Kind kind) {
+        _results.received[kind]++;
+        _results.latency[kind].record(now_ns() - _sent_at[kind]);
+    }
+
+    void delivered(Kind kind, qint64 sent_at) {
+        _results.received[kind]++;
+        if (sent_at)
+            _results.latency[kind].record(now_ns() - sent_at);
+    }
+
+    // Exponential gaps, so the aggregate across users is a Poisson stream
+    void schedule(Kind kind, double rate) {
+        if (rate <= 0)
+            return;
+
+        double gap = -std::log(1.0 - QRandomGenerator::global()->generateDouble()) / rate;
+
+        QTimer::singleShot(static_cast<int>(gap * 1000), this, [this, kind, rate]() {
+            if (!_running)
+                return;
+
+            fire(kind);
+            schedule(kind, rate);
+        });
+    }
+
+    void fire(Kind kind) {
+        QString stamp = QString::number(now_ns());
+
+        switch (kind) {
+        case Text:
+            if (_chat_ID)
+                send(Text, QJsonObject{{"type", "text"}, {"receiver", _peer}, {"message", "lg " + stamp}, {"time", "00:00"}, {"chatID", _chat_ID}});
+            break;
+        case GroupText:
+            if (_group_ID)
+                send(GroupText, QJsonObject{{"type", "group_text"}, {"groupID", _group_ID}, {"sender_name", "Load"}, {"message", "lg " + stamp}, {"time", "00:00"}});
+            break;
+        case Typing:
+            if (_peer)
+                send(Typing, QJsonObject{{"type", "is_typing"}, {"receiver", _peer}});
+            break;
+        case File:
+            if (_chat_ID) {
+                QByteArray payload(_settings.file_bytes, 'x');
+                send(File, QJsonObject{{"type", "file"},
+                                       {"chatID", _chat_ID},
+                                       {"receiver", _peer},
+                                       {"file_name", QString("lg_%1_%2.bin").arg(_number).arg(stamp)},
+                                       {"file_data", QString::fromLatin1(payload.toBase64())},
+                                       {"time", "00:00"}});
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    static qint64 stamp_of(const QString &message) {
+        return message.startsWith("lg ") ? message.mid(3).toLongLong() : 0;
+    }
+
+    void on_message(const QString &message) {
+        QJsonObject json = QJsonDocument::fromJson(message.toUtf8()).object();
+        QString type = json["type"].toString();
+
+        if (type == "sign_up") {
+            answered(SignUp);
+            send(Login, QJsonObject{{"type", "login_request"}, {"phone_number", _number}, {"password", "load-generator"}, {"time_zone", "UTC"}});
+        } else if (type == "login_end" || (type == "login_request" && json["status"].toBool())) {
+            // The Go server answers with a single login_request frame
+            answered(Login);
+            _results.ready++;
+        } else if (type == "login_request" && !json["status"].toBool()) {
+            _results.errors++;
+            _results.ready++;
+        } else if (type == "lookup_friend") {
+            answered(LookupFriend);
+
+            _peer = _number + 1;
+            _chat_ID = json["json_array"].toArray().first().toObject()["chatID"].toInt();
+            _results.ready++;
+        } else if (type == "added_you") {
+            QJsonObject contact = json["json_array"].toArray().first().toObject();
+
+            _peer = contact["contactInfo"].toObject()["_id"].toInt();
+            _chat_ID = contact["chatID"].toInt();
+            _results.ready++;
+        } else if (type == "added_to_group") {
+            if (_index % _settings.group_size == 0)
+                answered(NewGroup);
+
+            _group_ID = json["groups"].toArray().first().toObject()["_id"].toInt();
+            _results.ready++;
+        } else if (type == "text") {
+            if (json["sender_ID"].toInt() != _number)
+                delivered(Text, stamp_of(json["message"].toString()));
+        } else if (type == "group_text") {
+            if (json["sender_ID"].toInt() != _number)
+                delivered(GroupText, stamp_of(json["message"].toString()));
+        } else if (type == "is_typing") {
+            delivered(Typing, 0);
+        } else if (type == "file") {
+            if (json["sender_ID"].toInt() != _number)
+                return;
+
+            // The key, and so the send stamp, is the last path segment of the URL
+            QString key = QUrl(json["file_url"].toString()).fileName();
+            if (key.isEmpty())
+                _results.errors++;
+            else
+                delivered(File, key.section('_', 2, 2).section('.', 0, 0).toLongLong());
+        }
+    }
+};
+
+class worker {
+  public:
+    worker() {
+        _context = new QObject();
+        _context->moveToThread(&_thread);
+        QObject::connect(&_thread, &QThread::finished, _context, &QObject::deleteLater);
+
+        _thread.start();
+    }
+
+    ~worker() {
+        _thread.quit();
+        _thread.wait();
+    }
+
+    void add(int index, const options &settings, report &results) {
+        QMetaObject::invokeMethod(_context, [this, index, &settings, &results]() { _users.push_back(new simulated_user(index, settings, results, _context)); }, Qt::BlockingQueuedConnection);
+    }
+
+    // Blocks the event loop, so the kernel buffers of its sockets fill up
+    void freeze(int milliseconds) {
+        QMetaObject::invokeMethod(_context, [milliseconds]() { QThread::msleep(milliseconds); });
+    }
+
+    template <typename Step>
+    void each(Step step) {
+        QMetaObject::invokeMethod(_context, [this, step]() {
+            for (simulated_user *user : _users)
+                step(user);
+        });
+    }
+
+  private:
+    QThread _thread{};
+    QObject *_context{nullptr};
+    std::vector<simulated_user *> _users{};
+};
+
+// Waits on the event loop until expected users report ready, or the timeout passes
+bool wait_ready(report &results, int expected, int timeout_ms) {
+    QEventLoop loop;
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, &loop, [&]() {
+        if (results.ready >= expected || elapsed.elapsed() > timeout_ms)
+            loop.quit();
+    });
+    poll.start(20);
+    loop.exec();
+
+    bool complete = results.ready >= expected;
+    results.ready = 0;
+
+    return complete;
+}
+
+void pause(int milliseconds) {
+    QEventLoop loop;
+    QTimer::singleShot(milliseconds, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+// Unlabelled samples from the server's metrics endpoint
+QHash<QByteArray, double> scrape(const QUrl &url) {
+    QHash<QByteArray, double> samples;
+
+    QTcpSocket socket;
+    socket.connectToHost(url.host(), static_cast<quint16>(url.port(9464)));
+    if (!socket.waitForConnected(1000))
+        return samples;
+
+    socket.write("GET " + url.path(QUrl::FullyEncoded).toLatin1() + " HTTP/1.1\r\nHost: " + url.host().toLatin1() + "\r\n\r\n");
+
+    QByteArray response;
+    while (socket.waitForReadyRead(1000))
+        response += socket.readAll();
+
+    for (const QByteArray &line : response.mid(response.indexOf("\r\n\r\n") + 4).split('\n')) {
+        if (line.isEmpty() || line.startsWith('#') || line.contains('{'))
+            continue;
+
+        QList<QByteArray> fields = line.split(' ');
+        samples.insert(fields.value(0), fields.value(1).toDouble());
+    }
+
+    return samples;
+}
+
+qint64 resident_kb(qint64 pid) {
+    QFile status(QString("/proc/%1/status").arg(pid));
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+
+    for (const QByteArray &line : status.readAll().split('\n'))
+        if (line.startsWith("VmRSS:"))
+            return line.mid(6).simplified().split(' ').value(0).toLongLong();
+
+    return -1;
+}
+
+// Waits out the steady state, sampling the server once a second
+void observe(report &results, const options &settings) {
+    for (int second = 0; second < settings.duration; second++) {
+        pause(1000);
+
+        if (!settings.metrics_url.isEmpty()) {
+            QHash<QByteArray, double> samples = scrape(settings.metrics_url);
+            results.queued_bytes.push_back(samples.value("chat_outbound_queued_bytes", -1));
+            results.evictions = samples.value("chat_outbound_evictions_total", -1);
+        }
+
+        if (settings.server_pid)
+            results.resident_kb.push_back(resident_kb(settings.server_pid));
+    }
+}
+
+std::unique_ptr<report> run_scenario(const options &settings) {
+    QTextStream err(stderr);
+    auto results = std::make_unique<report>();
+
+    std::vector<std::unique_ptr<worker>> workers;
+    for (int thread = 0; thread < settings.threads; thread++)
+        workers.push_back(std::make_unique<worker>());
+
+    // Slow readers share a worker of their own, frozen for the steady state
+    worker *stalled = nullptr;
+    if (settings.slow_readers) {
+        workers.push_back(std::make_unique<worker>());
+        stalled = workers.back().get();
+    }
+
+    for (int index = 0; index < settings.users; index++)
+        (index < settings.slow_readers ? stalled : workers[index % settings.threads].get())->add(index, settings, *results);
+
+    err << "Logging in " << settings.users << " users on " << settings.url.toString() << Qt::endl;
+    for (auto &thread : workers)
+        thread->each([](simulated_user *user) { user->start(); });
+    if (!wait_ready(*results, settings.users, 120000))
+        err << "Not every user logged in" << Qt::endl;
+
+    err << "Pairing friends" << Qt::endl;
+    for (auto &thread : workers)
+        thread->each([](simulated_user *user) { user->befriend(); });
+    if (!wait_ready(*results, settings.users, 60000))
+        err << "Not every user has a friend" << Qt::endl;
+
+    err << "Creating groups of " << settings.group_size << Qt::endl;
+    for (auto &thread : workers)
+        thread->each([](simulated_user *user) { user->create_group(); });
+    if (!wait_ready(*results, settings.users, 60000))
+        err << "Not every user joined a group" << Qt::endl;
+
+    // Only steady-state traffic counts towards throughput
+    for (Kind kind : {Text, GroupText, Typing, File}) {
+        results->sent[kind] = 0;
+        results->received[kind] = 0;
+    }
+
+    err << "Running for " << settings.duration << "s" << Qt::endl;
+    for (auto &thread : workers)
+        thread->each([](simulated_user *user) { user->run(); });
+    if (stalled)
+        stalled->freeze(settings.duration * 1000);
+    observe(*results, settings);
+
+    for (auto &thread : workers)
+        thread->each([](simulated_user *user) { user->stop(); });
+
+    // Let in-flight deliveries land before the numbers are read
+    pause(1000);
+
+    return results;
+}
+
+void print(const QString &title, const report &results, const options &settings) {
+    QTextStream out(stdout);
+
+    auto ms = [](qint64 nanoseconds) { return QString::number(static_cast<double>(nanoseconds) / 1e6, 'f', 2); };
+
+    out << "\n"
+        << title << " (" << settings.users << " users, " << settings.duration << "s)\n";
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+               .arg("type", -14)
+               .arg("sent", 9)
+               .arg("received", 9)
+               .arg("recv/s", 9)
+               .arg("p50 ms", 9)
+               .arg("p90 ms", 9)
+               .arg("p99 ms", 9)
+               .arg("p99.9 ms", 9);
+
+    for (int kind = 0; kind < KindCount; kind++) {
+        bool steady = kind >= Text;
+        double rate = steady ? static_cast<double>(results.received[kind]) / settings.duration : 0;
+
+        out << QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+                   .arg(kind_names[kind], -14)
+                   .arg(results.sent[kind].load(), 9)
+                   .arg(results.received[kind].load(), 9)
+                   .arg(steady ? QString::number(rate, 'f', 1) : QString("-"), 9)
+                   .arg(ms(results.latency[kind].quantile(0.5)), 9)
+                   .arg(ms(results.latency[kind].quantile(0.9)), 9)
+                   .arg(ms(results.latency[kind].quantile(0.99)), 9)
+                   .arg(ms(results.latency[kind].quantile(0.999)), 9);
+    }
+
+    out << "errors: " << results.errors.load() << Qt::endl;
+
+    if (results.queued_bytes.empty() && results.resident_kb.empty())
+        return;
+
+    out << "server per second (" << settings.slow_readers << " slow readers):\n";
+    for (std::size_t second = 0; second < std::max(results.queued_bytes.size(), results.resident_kb.size()); second++)
+        out << QString("%1s queued %2 KiB, resident %3 KiB\n")
+                   .arg(second + 1, 4)
+                   .arg(second < results.queued_bytes.size() ? results.queued_bytes[second] / 1024 : -1, 10, 'f', 0)
+                   .arg(second < results.resident_kb.size() ? results.resident_kb[second] : -1, 10);
+
+    out << "evictions: " << results.evictions << Qt::endl;
+}
+
+bool wait_for_port(quint16 port, int timeout_ms) {
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    while (elapsed.elapsed() < timeout_ms) {
+        QTcpSocket probe;
+        probe.connectToHost("127.0.0.1", port);
+        if (probe.waitForConnected(200))
+            return true;
+
+        pause(200);
+    }
+
+    return false;
+}
+
+}
+
+int main(int argc, char **argv) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("WebSocket load generator for the chat server");
+    parser.addHelpOption();
+    parser.addOptions({{"url", "Server to load; repeat it to spread users over cluster nodes.", "url", "ws://127.0.0.1:12345"},
+                       {"users", "Simulated users.", "n", "100"},
+                       {"threads", "Worker threads.", "n", "4"},
+                       {"duration", "Steady-state seconds.", "s", "30"},
+                       {"text-rate", "text frames per user per second.", "rate", "1"},
+                       {"group-rate", "group_text frames per user per second.", "rate", "0.2"},
+                       {"typing-rate", "is_typing frames per user per second.", "rate", "0.5"},
+                       {"file-rate", "file uploads per user per second.", "rate", "0.02"},
+                       {"file-bytes", "Size of each uploaded file.", "bytes", "16384"},
+                       {"group-size", "Users per group.", "n", "8"},
+                       {"base-number", "Phone number of the first user.", "n", "700000000"},
+                       {"slow-readers", "Users that stop reading for the steady state.", "n", "0"},
+                       {"metrics-url", "Server metrics to sample each second.", "url"},
+                       {"server-pid", "Server process whose resident memory to sample.", "pid"},
+                       {"upload-baseline", "Also run without file uploads and compare text latency."},
+                       {"go-server", "Also run against the Go server built from this directory.", "dir"},
+                       {"go-port", "Port for the Go server.", "port", "12346"}});
+    parser.process(app);
+
+    options settings;
+    settings.url = QUrl(parser.value("url"));
+    for (const QString &node : parser.values("url"))
+        settings.nodes.append(QUrl(node));
+    settings.users = std::max(1, parser.value("users").toInt());
+    settings.threads = std::max(1, parser.value("threads").toInt());
+    settings.duration = std::max(1, parser.value("duration").toInt());
+    settings.text_rate = parser.value("text-rate").toDouble();
+    settings.group_rate = parser.value("group-rate").toDouble();
+    settings.typing_rate = parser.value("typing-rate").toDouble();
+    settings.file_rate = parser.value("file-rate").toDouble();
+    settings.file_bytes = parser.value("file-bytes").toInt();
+    settings.group_size = std::max(2, parser.value("group-size").toInt());
+    settings.base_number = parser.value("base-number").toInt();
+    settings.slow_readers = std::clamp(parser.value("slow-readers").toInt(), 0, settings.users);
+    settings.metrics_url = QUrl(parser.value("metrics-url"));
+    settings.server_pid = parser.value("server-pid").toLongLong();
+
+    std::unique_ptr<report> results = run_scenario(settings);
+    print("server " + settings.url.toString(), *results, settings);
+
+    if (parser.isSet("upload-baseline")) {
+        options quiet = settings;
+        quiet.file_rate = 0;
+        quiet.base_number = settings.base_number + settings.users;
+
+        std::unique_ptr<report> quiet_results = run_scenario(quiet);
+        print("server without uploads " + quiet.url.toString(), *quiet_results, quiet);
+
+        auto p99 = [](const report &run) { return QString::number(static_cast<double>(run.latency[Text].quantile(0.99)) / 1e6, 'f', 2); };
+        QTextStream(stdout) << "text p99: " << p99(*results) << " ms at " << settings.file_rate << " uploads/user/s, "
+                            << p99(*quiet_results) << " ms without" << Qt::endl;
+    }
+
+    if (!parser.isSet("go-server"))
+        return 0;
+
+    quint16 go_port = static_cast<quint16>(parser.value("go-port").toUInt());
+
+    QProcess go_server;
+    go_server.setWorkingDirectory(parser.value("go-server"));
+    go_server.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert("CHAT_APP_SERVER_IP", "127.0.0.1");
+    environment.insert("CHAT_APP_SERVER_PORT", QString::number(go_port));
+    go_server.setProcessEnvironment(environment);
+
+    go_server.start("go", {"run", "."});
+    if (!go_server.waitForStarted() || !wait_for_port(go_port, 120000)) {
+        QTextStream(stderr) << "Go server did not come up on port " << go_port << Qt::endl;
+        return 1;
+    }
+
+    // Fresh numbers, so accounts from the earlier runs do not collide
+    options baseline = settings;
+    baseline.url = QUrl(QString("ws://127.0.0.1:%1/").arg(go_port));
+    baseline.nodes.clear();
+    baseline.base_number = settings.base_number + 2 * settings.users;
+    baseline.metrics_url = QUrl();
+    baseline.server_pid = 0;
+
+    std::unique_ptr<report> baseline_results = run_scenario(baseline);
+    print("GOserver baseline " + baseline.url.toString(), *baseline_results, baseline);
+
+    go_server.terminate();
+    if (!go_server.waitForFinished(5000))
+        go_server.kill();
+
+    return 0;
+}
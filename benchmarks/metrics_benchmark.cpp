@@ -0,0 +1,102 @@
+#include "message_dispatch.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
+#include <benchmark/benchmark.h>
+
+// The receive path of on_frame_received with and without the instruments it
+// carries: a counter bump per frame, and two histogram records over three
+// clock reads for timed frames. frame_instrumented times every frame,
+// frame_sampled one in 64 as the server does by default; compare both against
+// frame_baseline for the overhead.
+namespace {
+
+const QByteArray sample_text = R"({"type":"text","receiver":123456789,"message":"Hey, are we still on for tonight?","time":"18:42","chatID":987654321})";
+
+bool receive(const QByteArray &message) {
+    json_frame json;
+    if (!json.parse(message))
+        return false;
+
+    text_frame decoded;
+    return message_dispatch::type_of(json) == message_dispatch::Text && message_dispatch::decode(json, decoded);
+}
+
+void frame_baseline(benchmark::State &state) {
+    for (auto _ : state)
+        benchmark::DoNotOptimize(receive(sample_text));
+}
+
+void frame_instrumented(benchmark::State &state) {
+    metrics::registry &registry = metrics::registry::instance();
+    metrics::counter &received = registry.counter_of("bench_frames_received_total", "", R"(type="text")");
+    metrics::histogram &queued = registry.histogram_of("bench_frame_queue_seconds", "", R"(type="text")");
+    metrics::histogram &handled = registry.histogram_of("bench_frame_handler_seconds", "", R"(type="text")");
+
+    for (auto _ : state) {
+        received.add();
+        qint64 start = tracing::now();
+        qint64 started = tracing::now();
+        queued.record(started - start);
+
+        metrics::scoped_timer timer(handled, started);
+        benchmark::DoNotOptimize(receive(sample_text));
+    }
+}
+
+void frame_sampled(benchmark::State &state) {
+    metrics::registry &registry = metrics::registry::instance();
+    metrics::counter &received = registry.counter_of("bench_frames_received_total", "", R"(type="text")");
+    metrics::histogram &queued = registry.histogram_of("bench_frame_queue_seconds", "", R"(type="text")");
+    metrics::histogram &handled = registry.histogram_of("bench_frame_handler_seconds", "", R"(type="text")");
+    quint32 untimed_frames = 0;
+
+    for (auto _ : state) {
+        received.add();
+        if (++untimed_frames < 64) {
+            benchmark::DoNotOptimize(receive(sample_text));
+            continue;
+        }
+
+        untimed_frames = 0;
+        qint64 start = tracing::now();
+        qint64 started = tracing::now();
+        queued.record(started - start);
+
+        metrics::scoped_timer timer(handled, started);
+        benchmark::DoNotOptimize(receive(sample_text));
+    }
+}
+
+void histogram_record(benchmark::State &state) {
+    metrics::histogram histogram;
+    qint64 value = 1;
+
+    for (auto _ : state) {
+        histogram.record(value);
+        value = (value * 7 + 13) % 100000000;
+    }
+}
+
+// Several threads hammering one series, as lanes and the S3 pool do
+void histogram_record_contended(benchmark::State &state) {
+    static metrics::histogram histogram;
+
+    for (auto _ : state)
+        histogram.record(25000);
+}
+
+void expose(benchmark::State &state) {
+    for (auto _ : state)
+        benchmark::DoNotOptimize(metrics::registry::instance().expose());
+}
+
+}
+
+BENCHMARK(frame_baseline);
+BENCHMARK(frame_instrumented);
+BENCHMARK(frame_sampled);
+BENCHMARK(histogram_record);
+BENCHMARK(histogram_record_contended)->Threads(1)->Threads(4)->Threads(8);
+BENCHMARK(expose);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,136 @@
+#include "message_dispatch.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <benchmark/benchmark.h>
+#include <new>
+
+namespace {
+std::atomic<qint64> allocations{0};
+}
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+
+namespace {
+
+QByteArray typing_frame() {
+    return R"({"type":"is_typing","receiver":123456789})";
+}
+
+QByteArray text_frame_bytes() {
+    return R"({"type":"text","receiver":123456789,"chatID":987654321,"message":"On my way, see you at \"the usual place\" in 10 minutes ☺","time":"2024-06-01T18:42:13Z"})";
+}
+
+QByteArray file_frame_bytes(qsizetype payload_size) {
+    QByteArray payload = QByteArray(payload_size * 3 / 4, 'x').toBase64();
+
+    return R"({"type":"file","chatID":987654321,"receiver":123456789,"file_name":"holiday.jpg","time":"2024-06-01T18:42:13Z","file_data":")" + payload + R"("})";
+}
+
+QByteArray sample(int kind) {
+    switch (kind) {
+    case 0:
+        return typing_frame();
+    case 1:
+        return text_frame_bytes();
+    default:
+        return file_frame_bytes(1024 * 1024);
+    }
+}
+
+const char *sample_name(int kind) {
+    switch (kind) {
+    case 0:
+        return "is_typing";
+    case 1:
+        return "text";
+    default:
+        return "file_1MiB";
+    }
+}
+
+void report(benchmark::State &state, qint64 allocations_before, qsizetype frame_size) {
+    state.SetBytesProcessed(state.iterations() * frame_size);
+    state.counters["allocs_per_frame"] = benchmark::Counter(static_cast<double>(allocations.load() - allocations_before), benchmark::Counter::kAvgIterations);
+}
+
+// Text frame as QString, re-encoded to UTF-8 and parsed into a QJsonDocument DOM
+void qjson_document_parse(benchmark::State &state) {
+    const QString message = QString::fromUtf8(sample(state.range(0)));
+
+    qint64 allocations_before = allocations.load();
+    for (auto _ : state) {
+        QJsonObject json_object = QJsonDocument::fromJson(message.toUtf8()).object();
+        QString type = json_object["type"].toString();
+
+        benchmark::DoNotOptimize(type);
+        benchmark::DoNotOptimize(json_object);
+    }
+
+    report(state, allocations_before, message.toUtf8().size());
+}
+
+// Same text frame, converted once to UTF-8 and read on demand
+void json_frame_parse_text(benchmark::State &state) {
+    const QString message = QString::fromUtf8(sample(state.range(0)));
+
+    qint64 allocations_before = allocations.load();
+    for (auto _ : state) {
+        json_frame json;
+        bool parsed = json.parse(message.toUtf8());
+        message_dispatch::MessageType type = message_dispatch::type_of(json);
+
+        benchmark::DoNotOptimize(parsed);
+        benchmark::DoNotOptimize(type);
+    }
+
+    report(state, allocations_before, message.toUtf8().size());
+}
+
+// Binary frame carrying raw UTF-8, parsed without any re-encoding
+void json_frame_parse_binary(benchmark::State &state) {
+    const QByteArray message = sample(state.range(0));
+
+    qint64 allocations_before = allocations.load();
+    for (auto _ : state) {
+        json_frame json;
+        bool parsed = json.parse(message);
+        message_dispatch::MessageType type = message_dispatch::type_of(json);
+
+        benchmark::DoNotOptimize(parsed);
+        benchmark::DoNotOptimize(type);
+    }
+
+    report(state, allocations_before, message.size());
+}
+
+void register_benchmarks() {
+    for (int kind = 0; kind < 3; kind++) {
+        std::string suffix = std::string("/") + sample_name(kind);
+
+        benchmark::RegisterBenchmark(("qjson_document_parse" + suffix).c_str(), qjson_document_parse)->Arg(kind);
+        benchmark::RegisterBenchmark(("json_frame_parse_text" + suffix).c_str(), json_frame_parse_text)->Arg(kind);
+        benchmark::RegisterBenchmark(("json_frame_parse_binary" + suffix).c_str(), json_frame_parse_binary)->Arg(kind);
+    }
+}
+
+}
+
+int main(int argc, char **argv) {
+    register_benchmarks();
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
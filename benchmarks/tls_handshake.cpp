@@ -0,0 +1,244 @@
+#include "metrics.hpp"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QSslCertificate>
+#include <QSslConfiguration>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <QWebSocket>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Handshake throughput against a server started with CHAT_APP_TLS_CERT and
+// CHAT_APP_TLS_KEY. A local self-signed pair is enough:
+//
+//   openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:P-256 -nodes \
+//       -keyout key.pem -out cert.pem -days 30 -subj /CN=localhost
+//
+// Two rounds run back to back. The first opens every connection cold; the
+// second offers the session ticket each loop got on its previous connection,
+// which is what a reconnecting mobile client does. A second round no faster
+// than the first means the server did not resume; the server logs
+// tls_resumption_unavailable when its TLS backend cannot share ticket keys.
+// Each connection counts from open() to the WebSocket upgrade completing,
+// then closes.
+namespace {
+
+struct round_report {
+    metrics::histogram latency{};
+    std::atomic<int> completed{0};
+    std::atomic<int> failed{0};
+    std::atomic<int> offered_tickets{0};
+};
+
+class handshaker : public QObject {
+  public:
+    handshaker(const QUrl &url, const QSslConfiguration &configuration, bool resume, int connections, round_report &results)
+        : _url(url), _configuration(configuration), _resume(resume), _remaining(connections), _results(results) {
+        connect(&_socket, &QWebSocket::connected, this, &handshaker::on_connected);
+        connect(&_socket, &QWebSocket::disconnected, this, &handshaker::on_finished);
+        connect(&_socket, &QWebSocket::errorOccurred, this, [this]() {
+            if (_in_flight)
+                _results.failed++;
+
+            on_finished();
+        });
+        connect(&_socket, &QWebSocket::sslErrors, this, [this](const QList<QSslError> &) {
+            if (_ignore_ssl_errors)
+                _socket.ignoreSslErrors();
+        });
+    }
+
+    void ignore_ssl_errors() { _ignore_ssl_errors = true; }
+
+    void start() { next(); }
+
+  private:
+    QWebSocket _socket{};
+    QUrl _url;
+    QSslConfiguration _configuration;
+    bool _resume;
+    bool _ignore_ssl_errors{false};
+    bool _in_flight{false};
+    bool _moving_on{false};
+    int _remaining;
+    round_report &_results;
+    QByteArray _ticket{};
+    QElapsedTimer _clock{};
+
+    void next() {
+        if (_remaining-- <= 0)
+            return;
+
+        QSslConfiguration configuration = _configuration;
+        if (_resume && !_ticket.isEmpty()) {
+            configuration.setSessionTicket(_ticket);
+            _results.offered_tickets++;
+        }
+
+        _socket.setSslConfiguration(configuration);
+
+        _in_flight = true;
+        _clock.start();
+        _socket.open(_url);
+    }
+
+    void on_connected() {
+        _results.latency.record(_clock.nsecsElapsed());
+        _results.completed++;
+        _in_flight = false;
+
+        if (_resume)
+            _ticket = _socket.sslConfiguration().sessionTicket();
+
+        _socket.close();
+    }
+
+    // A failed attempt may or may not also emit disconnected, so both paths
+    // land here and only the first moves on, outside the socket's own signal
+    void on_finished() {
+        if (_socket.state() != QAbstractSocket::UnconnectedState)
+            _socket.abort();
+
+        if (_moving_on)
+            return;
+
+        _in_flight = false;
+        _moving_on = true;
+        QTimer::singleShot(0, this, [this]() {
+            _moving_on = false;
+            next();
+        });
+    }
+};
+
+class worker {
+  public:
+    worker() {
+        _context = new QObject();
+        _context->moveToThread(&_thread);
+        QObject::connect(&_thread, &QThread::finished, _context, &QObject::deleteLater);
+
+        _thread.start();
+    }
+
+    ~worker() {
+        _thread.quit();
+        _thread.wait();
+    }
+
+    QObject *context() const { return _context; }
+
+  private:
+    QThread _thread{};
+    QObject *_context{nullptr};
+};
+
+QString ms(qint64 nanoseconds) {
+    return QString::number(static_cast<double>(nanoseconds) / 1e6, 'f', 2);
+}
+
+}
+
+int main(int argc, char **argv) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("TLS handshake throughput against the chat server");
+    parser.addHelpOption();
+    parser.addOptions({{"url", "Server to connect to.", "url", "wss://127.0.0.1:12345"},
+                       {"connections", "Connections per round.", "n", "2000"},
+                       {"concurrency", "Connections in flight per thread.", "n", "16"},
+                       {"threads", "Worker threads.", "n", "4"},
+                       {"ca", "Trust this certificate instead of ignoring verification errors.", "pem"}});
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const QUrl url(parser.value("url"));
+    const int connections = std::max(1, parser.value("connections").toInt());
+    const int concurrency = std::max(1, parser.value("concurrency").toInt());
+    const int thread_count = std::max(1, parser.value("threads").toInt());
+
+    QSslConfiguration configuration = QSslConfiguration::defaultConfiguration();
+    configuration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    configuration.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+
+    const bool trusted = parser.isSet("ca");
+    if (trusted) {
+        QList<QSslCertificate> ca = QSslCertificate::fromPath(parser.value("ca"));
+        if (ca.isEmpty()) {
+            err << "No certificate in " << parser.value("ca") << Qt::endl;
+            return 1;
+        }
+
+        configuration.setCaCertificates(ca);
+    }
+
+    std::vector<std::unique_ptr<worker>> workers;
+    for (int thread = 0; thread < thread_count; thread++)
+        workers.push_back(std::make_unique<worker>());
+
+    const int loops = thread_count * concurrency;
+
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8\n").arg("round", -8).arg("ok", 7).arg("failed", 7).arg("tickets", 8).arg("per s", 9).arg("p50 ms", 9).arg("p90 ms", 9).arg("p99 ms", 9);
+
+    for (bool resume : {false, true}) {
+        round_report results;
+        std::vector<handshaker *> handshakers;
+
+        QElapsedTimer elapsed;
+        elapsed.start();
+
+        for (int loop = 0; loop < loops; loop++) {
+            // The first loops take the remainder, so the round opens exactly --connections
+            const int share = connections / loops + (loop < connections % loops ? 1 : 0);
+            if (!share)
+                continue;
+
+            QObject *context = workers[loop % workers.size()]->context();
+            QMetaObject::invokeMethod(context, [&, context, share]() {
+                handshaker *loop_handshaker = new handshaker(url, configuration, resume, share, results);
+                if (!trusted)
+                    loop_handshaker->ignore_ssl_errors();
+
+                loop_handshaker->setParent(context);
+                handshakers.push_back(loop_handshaker);
+                loop_handshaker->start();
+            }, Qt::BlockingQueuedConnection);
+        }
+
+        QEventLoop wait;
+        QTimer poll;
+        QObject::connect(&poll, &QTimer::timeout, &wait, [&]() {
+            if (results.completed + results.failed >= connections || elapsed.elapsed() > 300000)
+                wait.quit();
+        });
+        poll.start(10);
+        wait.exec();
+
+        const double seconds = static_cast<double>(elapsed.nsecsElapsed()) / 1e9;
+        const bool timed = results.completed > 0;
+
+        out << QString("%1 %2 %3 %4 %5 %6 %7 %8\n")
+                   .arg(resume ? "resume" : "full", -8)
+                   .arg(results.completed.load(), 7)
+                   .arg(results.failed.load(), 7)
+                   .arg(results.offered_tickets.load(), 8)
+                   .arg(QString::number(results.completed / seconds, 'f', 1), 9)
+                   .arg(timed ? ms(results.latency.quantile(0.5)) : QString("-"), 9)
+                   .arg(timed ? ms(results.latency.quantile(0.9)) : QString("-"), 9)
+                   .arg(timed ? ms(results.latency.quantile(0.99)) : QString("-"), 9);
+        out.flush();
+
+        for (handshaker *finished : handshakers)
+            QMetaObject::invokeMethod(finished, [finished]() { delete finished; }, Qt::BlockingQueuedConnection);
+    }
+
+    return 0;
+}
@@ -0,0 +1,359 @@
+#include "metrics.hpp"
+#include "traffic_capture.hpp"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <QThread>
+#include <QWebSocket>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Replays a log written with CHAT_APP_CAPTURE_FILE against a server, at the
+// captured pace, N times faster (--speed N) or as fast as the server takes it
+// (--speed 0). Each captured connection gets its own socket, and its frames
+// keep their order. A request's latency runs until the first frame of its
+// answering type on the same connection (from this user, where the answer
+// names a sender); requests without an answer only count. Schedule lag shows
+// how far the sends fell behind the log, which means the client, not the
+// server, was the limit.
+namespace {
+
+const std::map<QString, QString> answers{{"sign_up", "sign_up"},
+                                         {"login_request", "login_end"},
+                                         {"lookup_friend", "lookup_friend"},
+                                         {"text", "text"},
+                                         {"group_text", "group_text"},
+                                         {"file", "file"},
+                                         {"group_file", "group_file"},
+                                         {"audio", "audio"},
+                                         {"group_audio", "group_audio"},
+                                         {"new_group", "added_to_group"},
+                                         {"profile_image", "profile_image"},
+                                         {"group_profile_image", "group_profile_image"},
+                                         {"retrieve_question", "question_answer"},
+                                         {"delete_account", "delete_account"},
+                                         {"batch", "batch"}};
+
+struct type_stats {
+    std::atomic<quint64> sent{0};
+    std::atomic<quint64> answered{0};
+    metrics::histogram latency{};
+};
+
+struct report {
+    std::mutex mutex{};
+    std::map<QString, std::unique_ptr<type_stats>> types{};
+    metrics::histogram lag{};
+    std::atomic<quint64> frames{0};
+    std::atomic<int> connected{0};
+    std::atomic<int> signed_up{0};
+
+    type_stats &of(const QString &type) {
+        std::lock_guard lock(mutex);
+
+        std::unique_ptr<type_stats> &stats = types[type];
+        if (!stats)
+            stats = std::make_unique<type_stats>();
+
+        return *stats;
+    }
+};
+
+qint64 now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class replayed_connection : public QObject {
+  public:
+    replayed_connection(const QUrl &url, report &results, QObject *parent)
+        : QObject(parent), _results(results) {
+        connect(&_socket, &QWebSocket::connected, this, [this]() { _results.connected++; });
+        connect(&_socket, &QWebSocket::textMessageReceived, this, [this](const QString &message) { on_message(message.toUtf8()); });
+        connect(&_socket, &QWebSocket::binaryMessageReceived, this, [this](const QByteArray &message) { on_message(message); });
+
+        _socket.open(url);
+    }
+
+    void sign_up(const QJsonObject &login) {
+        _signing_up = true;
+
+        QJsonObject frame{{"type", "sign_up"},
+                          {"phone_number", login["phone_number"]},
+                          {"first_name", "Replay"},
+                          {"last_name", "User"},
+                          {"password", login["password"]},
+                          {"secret_question", "q"},
+                          {"secret_answer", "a"}};
+
+        _socket.sendTextMessage(QString::fromUtf8(QJsonDocument(frame).toJson(QJsonDocument::Compact)));
+    }
+
+    void send(const traffic_capture::Record &record, qint64 due_ns) {
+        qint64 sent_at = now_ns();
+        if (due_ns)
+            _results.lag.record(std::max<qint64>(0, sent_at - due_ns));
+
+        if (record.closed) {
+            _socket.close();
+            return;
+        }
+
+        QJsonObject json = QJsonDocument::fromJson(record.frame).object();
+        QString type = json["type"].toString();
+
+        if (type == "login_request")
+            _user_ID = json["phone_number"].toInteger();
+
+        _results.frames++;
+        _results.of(type).sent++;
+
+        auto answer = answers.find(type);
+        if (answer != answers.end())
+            _pending[answer->second].push_back({type, sent_at});
+
+        if (record.binary)
+            _socket.sendBinaryMessage(record.frame);
+        else
+            _socket.sendTextMessage(QString::fromUtf8(record.frame));
+    }
+
+  private:
+    QWebSocket _socket{};
+    report &_results;
+    qint64 _user_ID{0};
+    bool _signing_up{false};
+
+    std::map<QString, std::deque<std::pair<QString, qint64>>> _pending{};
+
+    void on_message(const QByteArray &message) {
+        QJsonObject json = QJsonDocument::fromJson(message).object();
+        QString type = json["type"].toString();
+
+        if (_signing_up && type == "sign_up") {
+            _signing_up = false;
+            _results.signed_up++;
+            return;
+        }
+
+        // A failed login answers with login_request instead of login_end
+        if (type == "login_request")
+            type = "login_end";
+
+        if (json.contains("sender_ID") && json["sender_ID"].toInteger() != _user_ID)
+            return;
+
+        auto pending = _pending.find(type);
+        if (pending == _pending.end() || pending->second.empty())
+            return;
+
+        auto [request_type, sent_at] = pending->second.front();
+        pending->second.pop_front();
+
+        type_stats &stats = _results.of(request_type);
+        stats.answered++;
+        stats.latency.record(now_ns() - sent_at);
+    }
+};
+
+class worker {
+  public:
+    worker() {
+        _context = new QObject();
+        _context->moveToThread(&_thread);
+        QObject::connect(&_thread, &QThread::finished, _context, &QObject::deleteLater);
+
+        _thread.start();
+    }
+
+    ~worker() {
+        _thread.quit();
+        _thread.wait();
+    }
+
+    template <typename Step>
+    void post(Step step) {
+        QMetaObject::invokeMethod(_context, std::move(step));
+    }
+
+    QObject *context() const { return _context; }
+
+  private:
+    QThread _thread{};
+    QObject *_context{nullptr};
+};
+
+void wait_for(const std::function<bool()> &done, int timeout_ms) {
+    QEventLoop loop;
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, &loop, [&]() {
+        if (done() || elapsed.elapsed() > timeout_ms)
+            loop.quit();
+    });
+    poll.start(10);
+    loop.exec();
+}
+
+QString ms(qint64 nanoseconds) {
+    return QString::number(static_cast<double>(nanoseconds) / 1e6, 'f', 2);
+}
+
+}
+
+int main(int argc, char **argv) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a captured frame log against the chat server");
+    parser.addHelpOption();
+    parser.addPositionalArgument("log", "Capture written with CHAT_APP_CAPTURE_FILE.");
+    parser.addOptions({{"url", "Server to replay against.", "url", "ws://127.0.0.1:12345"},
+                       {"speed", "1 replays at the captured pace, N is N times faster, 0 as fast as possible.", "factor", "1"},
+                       {"threads", "Worker threads for the connections.", "n", "4"},
+                       {"sign-up", "Create an account for every captured login before replaying."}});
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (parser.positionalArguments().isEmpty())
+        parser.showHelp(1);
+
+    QFile log(parser.positionalArguments().first());
+    if (!log.open(QIODevice::ReadOnly) || !traffic_capture::read_header(log)) {
+        err << "Not a capture log: " << log.fileName() << Qt::endl;
+        return 1;
+    }
+
+    std::vector<traffic_capture::Record> records;
+    std::map<quint32, QJsonObject> logins;
+    qint64 captured_ns = 0;
+
+    for (traffic_capture::Record record; traffic_capture::read(log, record);) {
+        captured_ns += record.delay_ns;
+
+        if (!record.closed && !logins.count(record.connection)) {
+            QJsonObject json = QJsonDocument::fromJson(record.frame).object();
+            if (json["type"].toString() == "login_request")
+                logins[record.connection] = json;
+        }
+
+        records.push_back(std::move(record));
+    }
+
+    const QUrl url(parser.value("url"));
+    const double speed = parser.value("speed").toDouble();
+    const int thread_count = std::max(1, parser.value("threads").toInt());
+
+    report results;
+
+    std::vector<std::unique_ptr<worker>> workers;
+    for (int thread = 0; thread < thread_count; thread++)
+        workers.push_back(std::make_unique<worker>());
+
+    // Every captured connection is opened up front, so the replay times frames, not handshakes
+    std::map<quint32, std::pair<worker *, replayed_connection *>> connections;
+    for (const traffic_capture::Record &record : records) {
+        if (connections.count(record.connection))
+            continue;
+
+        worker *owner = workers[connections.size() % workers.size()].get();
+        replayed_connection *connection = nullptr;
+        QMetaObject::invokeMethod(owner->context(), [&]() { connection = new replayed_connection(url, results, owner->context()); }, Qt::BlockingQueuedConnection);
+
+        connections[record.connection] = {owner, connection};
+    }
+
+    err << "Opening " << connections.size() << " connections to " << url.toString() << Qt::endl;
+    wait_for([&]() { return results.connected >= static_cast<int>(connections.size()); }, 60000);
+
+    if (parser.isSet("sign-up")) {
+        for (const auto &[id, login] : logins) {
+            auto [owner, connection] = connections[id];
+            owner->post([connection, login = login]() { connection->sign_up(login); });
+        }
+
+        wait_for([&]() { return results.signed_up >= static_cast<int>(logins.size()); }, 60000);
+    }
+
+    err << "Replaying " << records.size() << " records (" << ms(captured_ns) << " ms captured) at "
+        << (speed > 0 ? QString::number(speed) + "x" : QString("full speed")) << Qt::endl;
+
+    // Dispatch runs on this thread; sleeping to each due time keeps the
+    // captured gaps, and the worker measures how late the send really was
+    const qint64 start_ns = now_ns();
+    qint64 offset_ns = 0;
+
+    for (const traffic_capture::Record &record : records) {
+        offset_ns += record.delay_ns;
+
+        qint64 due_ns = 0;
+        if (speed > 0) {
+            due_ns = start_ns + static_cast<qint64>(static_cast<double>(offset_ns) / speed);
+
+            qint64 wait_ns = due_ns - now_ns();
+            if (wait_ns > 2000000)
+                QThread::usleep(static_cast<unsigned long>((wait_ns - 1000000) / 1000));
+            while (now_ns() < due_ns)
+                ;
+        }
+
+        auto [owner, connection] = connections[record.connection];
+        owner->post([connection, record, due_ns]() { connection->send(record, due_ns); });
+    }
+
+    const qint64 dispatched_ns = now_ns() - start_ns;
+
+    // Answers still in flight get a grace period, then the tables are read
+    quint64 expected = 0;
+    {
+        std::lock_guard lock(results.mutex);
+        for (const auto &[type, stats] : results.types) {
+            if (answers.count(type))
+                expected += stats->sent;
+        }
+    }
+
+    wait_for([&]() {
+        quint64 answered = 0;
+        std::lock_guard lock(results.mutex);
+        for (const auto &[type, stats] : results.types)
+            answered += stats->answered;
+        return answered >= expected;
+    },
+             10000);
+
+    const qint64 elapsed_ns = now_ns() - start_ns;
+
+    out << "\nreplayed " << results.frames.load() << " frames in " << ms(elapsed_ns) << " ms (" << QString::number(results.frames.load() / (elapsed_ns / 1e9), 'f', 1) << " frames/s, dispatch " << ms(dispatched_ns) << " ms)\n";
+    if (speed > 0)
+        out << "schedule lag ms: p50 " << ms(results.lag.quantile(0.5)) << "  p99 " << ms(results.lag.quantile(0.99)) << "  p99.9 " << ms(results.lag.quantile(0.999)) << "\n";
+
+    out << QString("\n%1 %2 %3 %4 %5 %6 %7\n").arg("type", -28).arg("sent", 9).arg("answered", 9).arg("p50 ms", 9).arg("p90 ms", 9).arg("p99 ms", 9).arg("p99.9 ms", 9);
+
+    std::lock_guard lock(results.mutex);
+    for (const auto &[type, stats] : results.types) {
+        bool timed = stats->answered > 0;
+
+        out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                   .arg(type, -28)
+                   .arg(stats->sent.load(), 9)
+                   .arg(answers.count(type) ? QString::number(stats->answered.load()) : QString("-"), 9)
+                   .arg(timed ? ms(stats->latency.quantile(0.5)) : QString("-"), 9)
+                   .arg(timed ? ms(stats->latency.quantile(0.9)) : QString("-"), 9)
+                   .arg(timed ? ms(stats->latency.quantile(0.99)) : QString("-"), 9)
+                   .arg(timed ? ms(stats->latency.quantile(0.999)) : QString("-"), 9);
+    }
+    out.flush();
+
+    return 0;
+}
@@ -0,0 +1,367 @@
+#include "cluster_bus.hpp"
+#include "logger.hpp"
+#include <QDataStream>
+#include <QMessageAuthenticationCode>
+#include <QRandomGenerator>
+
+namespace {
+// An unauthenticated peer gets this much buffered before it is dropped
+constexpr qint64 MaxHelloBytes = 4096;
+constexpr int HelloTimeoutMs = 5000;
+
+// Compares without stopping at the first difference, so the proof cannot be
+// guessed byte by byte from response times
+bool same_proof(const QByteArray &left, const QByteArray &right) {
+    if (left.size() != right.size())
+        return false;
+
+    char difference = 0;
+    for (qsizetype index = 0; index < left.size(); index++)
+        difference |= left[index] ^ right[index];
+
+    return difference == 0;
+}
+}
+
+cluster_bus *cluster_bus::create(QObject *parent) {
+    const char *backend = std::getenv("CHAT_APP_CLUSTER_BUS");
+    if (!backend)
+        return nullptr;
+
+    QString node = std::getenv("CHAT_APP_CLUSTER_NODE") ? QString(std::getenv("CHAT_APP_CLUSTER_NODE")) : QString("127.0.0.1:13000");
+
+    if (QString(backend) == "local")
+        return new local_cluster_bus(node, parent);
+
+    if (QString(backend) == "tcp") {
+        QStringList peers = QString(std::getenv("CHAT_APP_CLUSTER_PEERS")).split(',', Qt::SkipEmptyParts);
+        peers.removeAll(node);
+
+        // Without it anyone who can reach the port could claim users
+        QByteArray secret(std::getenv("CHAT_APP_CLUSTER_SECRET"));
+        if (secret.isEmpty()) {
+            logger::error("cluster_secret_missing", {{"node", node}});
+            return nullptr;
+        }
+
+        return new tcp_cluster_bus(node, peers, secret, parent);
+    }
+
+    logger::error("unknown_cluster_bus", {{"backend", backend}});
+    return nullptr;
+}
+
+bool cluster_bus::owned_elsewhere(int user_ID) const {
+    return _owners.contains(user_ID) && !_local_users.contains(user_ID);
+}
+
+QString cluster_bus::owner_of(int user_ID) const {
+    return _owners.value(user_ID);
+}
+
+local_cluster_bus::local_cluster_bus(const QString &node_ID, QObject *parent)
+    : cluster_bus(parent), _node_ID(node_ID) {
+    for (local_cluster_bus *node : std::as_const(_nodes)) {
+        for (int user_ID : std::as_const(node->_local_users))
+            _owners.insert(user_ID, node->_node_ID);
+    }
+
+    _nodes.insert(_node_ID, this);
+}
+
+local_cluster_bus::~local_cluster_bus() {
+    _nodes.remove(_node_ID);
+
+    for (local_cluster_bus *node : std::as_const(_nodes)) {
+        for (int user_ID : std::as_const(_local_users)) {
+            if (node->_owners.value(user_ID) == _node_ID)
+                node->_owners.remove(user_ID);
+        }
+    }
+}
+
+void local_cluster_bus::claim(int user_ID) {
+    _local_users.insert(user_ID);
+
+    for (local_cluster_bus *node : std::as_const(_nodes)) {
+        node->_owners.insert(user_ID, _node_ID);
+
+        if (node != this && node->_local_users.remove(user_ID))
+            emit node->claim_lost(user_ID);
+    }
+}
+
+void local_cluster_bus::release(int user_ID) {
+    if (!_local_users.remove(user_ID))
+        return;
+
+    for (local_cluster_bus *node : std::as_const(_nodes)) {
+        if (node->_owners.value(user_ID) == _node_ID)
+            node->_owners.remove(user_ID);
+    }
+}
+
+bool local_cluster_bus::forward(int user_ID, const QString &frame, int kind, const QString &coalesce_key) {
+    if (!owned_elsewhere(user_ID))
+        return false;
+
+    local_cluster_bus *owner = _nodes.value(_owners.value(user_ID), nullptr);
+    if (!owner)
+        return false;
+
+    QMetaObject::invokeMethod(owner, [owner, user_ID, frame, kind, coalesce_key]() { emit owner->frame_received(user_ID, frame, kind, coalesce_key); }, Qt::QueuedConnection);
+
+    return true;
+}
+
+tcp_cluster_bus::tcp_cluster_bus(const QString &node_address, const QStringList &peer_addresses, const QByteArray &secret, QObject *parent)
+    : cluster_bus(parent), _node_address(node_address), _peer_addresses(peer_addresses), _secret(secret) {
+    connect(&_server, &QTcpServer::newConnection, this, &tcp_cluster_bus::on_new_peer);
+
+    // Only ever the node's own address; a host name would parse as null,
+    // and that must not widen into listening on every interface
+    QHostAddress host(_node_address.section(':', 0, 0));
+    quint16 port = _node_address.section(':', 1, 1).toUShort();
+
+    if (host.isNull())
+        logger::error("cluster_bus_bad_address", {{"node", _node_address}});
+    else if (!_server.listen(host, port))
+        logger::error("cluster_bus_listen_failed", {{"node", _node_address}, {"error", _server.errorString()}});
+
+    connect(&_reconnect_timer, &QTimer::timeout, this, &tcp_cluster_bus::connect_to_peers);
+    _reconnect_timer.start(2000);
+
+    connect_to_peers();
+}
+
+void tcp_cluster_bus::claim(int user_ID) {
+    _local_users.insert(user_ID);
+    _owners.insert(user_ID, _node_address);
+
+    QByteArray packet;
+    QDataStream(&packet, QIODevice::WriteOnly) << quint8(Claim) << user_ID;
+    broadcast(packet);
+}
+
+void tcp_cluster_bus::release(int user_ID) {
+    if (!_local_users.remove(user_ID))
+        return;
+
+    _owners.remove(user_ID);
+
+    QByteArray packet;
+    QDataStream(&packet, QIODevice::WriteOnly) << quint8(Release) << user_ID;
+    broadcast(packet);
+}
+
+bool tcp_cluster_bus::forward(int user_ID, const QString &frame, int kind, const QString &coalesce_key) {
+    if (!owned_elsewhere(user_ID))
+        return false;
+
+    QTcpSocket *socket = _outgoing.value(_owners.value(user_ID), nullptr);
+    if (!socket || !_greeted.contains(socket))
+        return false;
+
+    QByteArray packet;
+    QDataStream(&packet, QIODevice::WriteOnly) << quint8(Forward) << user_ID << kind << coalesce_key << frame;
+    send(socket, packet);
+
+    return true;
+}
+
+void tcp_cluster_bus::connect_to_peers() {
+    for (const QString &address : std::as_const(_peer_addresses)) {
+        if (_outgoing.contains(address))
+            continue;
+
+        QTcpSocket *socket = new QTcpSocket(this);
+        _outgoing.insert(address, socket);
+
+        // The peer speaks first, with the challenge this node has to answer
+        connect(socket, &QTcpSocket::readyRead, this, &tcp_cluster_bus::on_peer_ready_read);
+
+        connect(socket, &QTcpSocket::disconnected, this, [this, address, socket]() {
+            _outgoing.remove(address);
+            _greeted.remove(socket);
+            socket->deleteLater();
+        });
+
+        connect(socket, &QTcpSocket::errorOccurred, this, [this, address, socket]() {
+            if (socket->state() == QAbstractSocket::ConnectedState)
+                return;
+
+            _outgoing.remove(address);
+            _greeted.remove(socket);
+            socket->deleteLater();
+        });
+
+        socket->connectToHost(address.section(':', 0, 0), address.section(':', 1, 1).toUShort());
+    }
+}
+
+void tcp_cluster_bus::on_new_peer() {
+    while (QTcpSocket *socket = _server.nextPendingConnection()) {
+        QByteArray challenge(32, Qt::Uninitialized);
+        QRandomGenerator::system()->fillRange(reinterpret_cast<quint32 *>(challenge.data()), challenge.size() / sizeof(quint32));
+
+        _incoming.insert(socket, QString());
+        _challenges.insert(socket, challenge);
+
+        connect(socket, &QTcpSocket::readyRead, this, &tcp_cluster_bus::on_peer_ready_read);
+        connect(socket, &QTcpSocket::disconnected, this, &tcp_cluster_bus::on_peer_disconnected);
+
+        QByteArray packet;
+        QDataStream(&packet, QIODevice::WriteOnly) << quint8(Challenge) << challenge;
+        send(socket, packet);
+
+        QTimer::singleShot(HelloTimeoutMs, socket, [this, socket]() {
+            if (_challenges.contains(socket))
+                socket->abort();
+        });
+    }
+}
+
+void tcp_cluster_bus::on_peer_ready_read() {
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+
+    // Bounds what a peer that has not answered its challenge can make us buffer
+    if (_challenges.contains(socket) && socket->bytesAvailable() > MaxHelloBytes) {
+        logger::warning("cluster_peer_rejected", {{"address", socket->peerAddress().toString()}, {"reason", "oversized_hello"}});
+        socket->abort();
+        return;
+    }
+
+    QDataStream stream(socket);
+    while (socket->state() == QAbstractSocket::ConnectedState) {
+        stream.startTransaction();
+
+        QByteArray packet;
+        stream >> packet;
+
+        if (!stream.commitTransaction())
+            return;
+
+        QDataStream packet_stream(packet);
+        quint8 operation = 0;
+        packet_stream >> operation;
+
+        handle(socket, packet_stream, static_cast<Operation>(operation));
+    }
+}
+
+void tcp_cluster_bus::on_peer_disconnected() {
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+
+    _challenges.remove(socket);
+
+    QString node = _incoming.take(socket);
+    if (!node.isEmpty()) {
+        for (auto it = _owners.begin(); it != _owners.end();) {
+            if (it.value() == node)
+                it = _owners.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    socket->deleteLater();
+}
+
+QByteArray tcp_cluster_bus::proof(const QByteArray &challenge, const QString &node) const {
+    return QMessageAuthenticationCode::hash(challenge + node.toUtf8(), _secret, QCryptographicHash::Sha256);
+}
+
+void tcp_cluster_bus::handle(QTcpSocket *socket, QDataStream &stream, Operation operation) {
+    // Challenges come back on the links this node dialed
+    if (operation == Challenge) {
+        answer(socket, stream);
+        return;
+    }
+
+    // Anything before a valid Hello, or on an outgoing link, is not a peer talking
+    if (!_incoming.contains(socket) || (_incoming.value(socket).isEmpty() && operation != Hello)) {
+        logger::warning("cluster_peer_rejected", {{"address", socket->peerAddress().toString()}, {"reason", "unauthenticated"}});
+        socket->abort();
+        return;
+    }
+
+    switch (operation) {
+    case Hello: {
+        QString node;
+        QByteArray mac;
+        stream >> node >> mac;
+
+        if (!_challenges.contains(socket) || !_peer_addresses.contains(node) || !same_proof(mac, proof(_challenges.take(socket), node))) {
+            logger::warning("cluster_peer_rejected", {{"address", socket->peerAddress().toString()}, {"node", node}, {"reason", "bad_hello"}});
+            socket->abort();
+            return;
+        }
+
+        _incoming.insert(socket, node);
+        break;
+    }
+    case Claim: {
+        int user_ID = 0;
+        stream >> user_ID;
+
+        _owners.insert(user_ID, _incoming.value(socket));
+        if (_local_users.remove(user_ID))
+            emit claim_lost(user_ID);
+        break;
+    }
+    case Release: {
+        int user_ID = 0;
+        stream >> user_ID;
+
+        if (_owners.value(user_ID) == _incoming.value(socket))
+            _owners.remove(user_ID);
+        break;
+    }
+    case Forward: {
+        int user_ID = 0;
+        int kind = 0;
+        QString coalesce_key;
+        QString frame;
+        stream >> user_ID >> kind >> coalesce_key >> frame;
+
+        emit frame_received(user_ID, frame, kind, coalesce_key);
+        break;
+    }
+    case Challenge:
+        break;
+    }
+}
+
+void tcp_cluster_bus::answer(QTcpSocket *socket, QDataStream &stream) {
+    if (_outgoing.key(socket).isEmpty() || _greeted.contains(socket))
+        return;
+
+    QByteArray challenge;
+    stream >> challenge;
+
+    QByteArray hello;
+    QDataStream(&hello, QIODevice::WriteOnly) << quint8(Hello) << _node_address << proof(challenge, _node_address);
+    send(socket, hello);
+
+    _greeted.insert(socket);
+
+    for (int user_ID : std::as_const(_local_users)) {
+        QByteArray packet;
+        QDataStream(&packet, QIODevice::WriteOnly) << quint8(Claim) << user_ID;
+        send(socket, packet);
+    }
+}
+
+void tcp_cluster_bus::send(QTcpSocket *socket, const QByteArray &packet) {
+    QDataStream stream(socket);
+    stream << packet;
+}
+
+void tcp_cluster_bus::broadcast(const QByteArray &packet) {
+    for (QTcpSocket *socket : std::as_const(_greeted))
+        send(socket, packet);
+}
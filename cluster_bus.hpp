@@ -0,0 +1,111 @@
+#pragma once
+
+#include <QHash>
+#include <QSet>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+// Routes frames for users connected to another server instance. Each node
+// claims the users logged in on it, every node learns who owns whom, and
+// deliveries to a user that is not local are forwarded to the owning node.
+class cluster_bus : public QObject {
+    Q_OBJECT
+
+  public:
+    using QObject::QObject;
+
+    // Picks the backend from CHAT_APP_CLUSTER_BUS ("local" or "tcp"),
+    // nullptr when clustering is off
+    static cluster_bus *create(QObject *parent = nullptr);
+
+    virtual void claim(int user_ID) = 0;
+    virtual void release(int user_ID) = 0;
+
+    // False when no other node owns the user
+    virtual bool forward(int user_ID, const QString &frame, int kind, const QString &coalesce_key) = 0;
+
+    bool owned_elsewhere(int user_ID) const;
+    QString owner_of(int user_ID) const;
+
+  signals:
+    void frame_received(int user_ID, const QString &frame, int kind, const QString &coalesce_key);
+
+    // A user local to this node logged in on another one
+    void claim_lost(int user_ID);
+
+  protected:
+    QHash<int, QString> _owners{};
+    QSet<int> _local_users{};
+};
+
+// All nodes live in one process, for testing the bus itself. The server's
+// routing state is process-wide, so running several server nodes takes one
+// process each on the tcp backend.
+class local_cluster_bus : public cluster_bus {
+    Q_OBJECT
+
+  public:
+    local_cluster_bus(const QString &node_ID, QObject *parent = nullptr);
+    ~local_cluster_bus();
+
+    void claim(int user_ID) override;
+    void release(int user_ID) override;
+    bool forward(int user_ID, const QString &frame, int kind, const QString &coalesce_key) override;
+
+  private:
+    QString _node_ID;
+
+    static inline QHash<QString, local_cluster_bus *> _nodes{};
+};
+
+// Full mesh over TCP. Each node listens on its own address and dials every
+// peer. Announcements and forwarded frames travel on the outgoing links,
+// and a peer that drops loses all of its claims. A link is only trusted once
+// the dialing node has answered a random challenge with an HMAC keyed by the
+// shared secret, and names itself as one of the configured peers.
+class tcp_cluster_bus : public cluster_bus {
+    Q_OBJECT
+
+  public:
+    tcp_cluster_bus(const QString &node_address, const QStringList &peer_addresses, const QByteArray &secret, QObject *parent = nullptr);
+
+    void claim(int user_ID) override;
+    void release(int user_ID) override;
+    bool forward(int user_ID, const QString &frame, int kind, const QString &coalesce_key) override;
+
+  private slots:
+    void on_new_peer();
+    void on_peer_ready_read();
+    void on_peer_disconnected();
+    void connect_to_peers();
+
+  private:
+    enum Operation : quint8 {
+        Hello,
+        Claim,
+        Release,
+        Forward,
+        Challenge
+    };
+
+    QString _node_address;
+    QStringList _peer_addresses;
+    QByteArray _secret;
+
+    QTcpServer _server{};
+    QTimer _reconnect_timer{};
+    QHash<QString, QTcpSocket *> _outgoing{};
+    QSet<QTcpSocket *> _greeted{};
+
+    // Node name once authenticated, empty while the challenge is open
+    QHash<QTcpSocket *, QString> _incoming{};
+    QHash<QTcpSocket *, QByteArray> _challenges{};
+
+    QByteArray proof(const QByteArray &challenge, const QString &node) const;
+
+    void send(QTcpSocket *socket, const QByteArray &packet);
+    void broadcast(const QByteArray &packet);
+    void handle(QTcpSocket *socket, QDataStream &stream, Operation operation);
+    void answer(QTcpSocket *socket, QDataStream &stream);
+};
@@ -1,6 +1,39 @@
 #include "database.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
+
+namespace {
+
+metrics::histogram &account_call(const char *call) {
+    return metrics::registry::instance().histogram_of("chat_account_call_seconds", "Latency of Account database calls", QString("call=\"%1\"").arg(call));
+}
+
+metrics::histogram &s3_operation(const char *operation) {
+    return metrics::registry::instance().histogram_of("chat_s3_operation_seconds", "Latency of S3 requests", QString("operation=\"%1\"").arg(operation));
+}
+
+// Times a call into its histogram and, inside a sampled frame, traces it
+class call_scope {
+  public:
+    call_scope(metrics::histogram &latency, const char *name)
+        : _timer(latency), _span(name) {}
+
+  private:
+    metrics::scoped_timer _timer;
+    tracing::span _span;
+};
+
+metrics::counter &s3_errors(const char *operation) {
+    return metrics::registry::instance().counter_of("chat_s3_errors_total", "S3 requests that failed", QString("operation=\"%1\"").arg(operation));
+}
+
+}
 
 std::string S3::get_data_from_s3(const Aws::S3::S3Client &s3_client, const std::string &key) {
+    static metrics::histogram &latency = s3_operation("get_object");
+    call_scope scope(latency, "s3_get_object");
+
     Aws::S3::Model::GetObjectRequest request;
     request.SetBucket(std::getenv("CHAT_APP_BUCKET_NAME"));
     request.SetKey(key.c_str());
@@ -13,13 +46,17 @@ std::string S3::get_data_from_s3(const Aws::S3::S3Client &s3_client, const std::
 
         return ss.str();
     } else {
-        std::cerr << "GetObject error: " << outcome.GetError().GetExceptionName() << " - " << outcome.GetError().GetMessage() << std::endl;
+        s3_errors("get_object").add();
+        logger::error("s3_get_failed", {{"key", key}, {"exception", std::string_view(outcome.GetError().GetExceptionName())}, {"error", std::string_view(outcome.GetError().GetMessage())}});
 
         return std::string();
     }
 }
 
 std::string S3::store_data_to_s3(Aws::S3::S3Client &s3_client, const std::string &key, const std::string &data) {
+    static metrics::histogram &latency = s3_operation("put_object");
+    call_scope scope(latency, "s3_put_object");
+
     Aws::S3::Model::PutObjectRequest request;
     request.SetBucket(std::getenv("CHAT_APP_BUCKET_NAME"));
     request.SetKey(key.c_str());
@@ -30,37 +67,51 @@ std::string S3::store_data_to_s3(Aws::S3::S3Client &s3_client, const std::string
 
     Aws::S3::Model::PutObjectOutcome outcome = s3_client.PutObject(request);
     if (outcome.IsSuccess()) {
-        std::cout << "Successfully uploaded object " << key << std::endl;
+        logger::debug("s3_put", {{"key", key}});
 
         Aws::String presigned_url = s3_client.GeneratePresignedUrl(request.GetBucket(), request.GetKey(), Aws::Http::HttpMethod::HTTP_GET, 604800);
 
         return presigned_url.c_str();
     } else {
-        std::cerr << "PutObject error: "
-                  << outcome.GetError().GetExceptionName() << " - "
-                  << outcome.GetError().GetMessage() << std::endl;
+        s3_errors("put_object").add();
+        logger::error("s3_put_failed", {{"key", key}, {"exception", std::string_view(outcome.GetError().GetExceptionName())}, {"error", std::string_view(outcome.GetError().GetMessage())}});
 
         return std::string();
     }
 }
 
 bool S3::delete_data_from_s3(const Aws::S3::S3Client &s3_client, const std::string &key) {
+    static metrics::histogram &latency = s3_operation("delete_object");
+    call_scope scope(latency, "s3_delete_object");
+
     Aws::S3::Model::DeleteObjectRequest request;
     request.SetBucket(std::getenv("CHAT_APP_BUCKET_NAME"));
     request.SetKey(key.c_str());
 
     Aws::S3::Model::DeleteObjectOutcome outcome = s3_client.DeleteObject(request);
     if (outcome.IsSuccess()) {
-        std::cout << "Successfully deleted object from: " << std::getenv("CHAT_APP_BUCKET_NAME") << "/" << key << std::endl;
+        logger::debug("s3_delete", {{"bucket", std::getenv("CHAT_APP_BUCKET_NAME")}, {"key", key}});
 
         return true;
     } else {
-        std::cerr << "DeleteObject error: " << outcome.GetError().GetExceptionName() << " - " << outcome.GetError().GetMessage() << std::endl;
+        s3_errors("delete_object").add();
+        logger::error("s3_delete_failed", {{"key", key}, {"exception", std::string_view(outcome.GetError().GetExceptionName())}, {"error", std::string_view(outcome.GetError().GetMessage())}});
 
         return false;
     }
 }
 
+QString S3::owned_key(const int &owner_ID, const QString &file_name) {
+    QString name = file_name;
+    name.replace('/', '_');
+
+    return QString("media/%1/%2").arg(owner_ID).arg(name);
+}
+
+bool S3::owned_by(const int &owner_ID, const QString &key) {
+    return key.startsWith(QString("media/%1/").arg(owner_ID));
+}
+
 std::string Security::generate_random_salt(size_t length) {
     const std::string valid_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
 
@@ -91,7 +142,8 @@ std::string Security::hashing_password(const std::string &password) {
     int result = argon2_hash(t_cost, m_cost, parallelism, password.c_str(), password.length(), salt.c_str(), salt.length(), &hash[0], hash_length, nullptr, 0, Argon2_id, ARGON2_VERSION_NUMBER);
 
     if (result != ARGON2_OK) {
-        std::cerr << "Error hashing password." << std::endl;
+        logger::error("password_hash_failed", {{"error", argon2_error_message(result)}});
+        logger::flush();
 
         exit(EXIT_FAILURE);
     }
@@ -116,7 +168,8 @@ bool Security::verifying_password(const std::string &inputPassword, const std::s
     int result = argon2_hash(t_cost, m_cost, parallelism, inputPassword.c_str(), inputPassword.length(), hashed_password.c_str(), SALT_LENGTH, &hash[0], hash_length, nullptr, 0, Argon2_id, ARGON2_VERSION_NUMBER);
 
     if (result != ARGON2_OK) {
-        std::cerr << "Error verifying password." << std::endl;
+        logger::error("password_verify_failed", {{"error", argon2_error_message(result)}});
+        logger::flush();
         exit(EXIT_FAILURE);
     }
 
@@ -124,6 +177,12 @@ bool Security::verifying_password(const std::string &inputPassword, const std::s
 }
 
 bool Account::insert_document(mongocxx::database &db, const std::string &collection_name, const QJsonObject &json_object) {
+    static metrics::histogram &latency = account_call("insert_document");
+    call_scope scope(latency, "insert_document");
+
+    if (_batch)
+        return queue_write(collection_name, QJsonObject{{"insert_one", QJsonObject{{"document", json_object}}}});
+
     try {
         mongocxx::collection collection = db.collection(collection_name);
 
@@ -134,17 +193,23 @@ bool Account::insert_document(mongocxx::database &db, const std::string &collect
 
         return result && result->result().inserted_count() == 1;
     } catch (const mongocxx::exception &e) {
-        std::cerr << "MongoDB Exception: " << e.what() << std::endl;
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
 
         return false;
     } catch (const std::exception &e) {
-        std::cerr << "Error inserting document: " << e.what() << std::endl;
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
 
         return false;
     }
 }
 
 bool Account::delete_document(mongocxx::database &db, const std::string &collection_name, const QJsonObject &filter_object) {
+    static metrics::histogram &latency = account_call("delete_document");
+    call_scope scope(latency, "delete_document");
+
+    if (_batch)
+        return queue_write(collection_name, QJsonObject{{"delete_one", QJsonObject{{"filter", filter_object}}}});
+
     try {
         mongocxx::collection collection = db.collection(collection_name);
 
@@ -155,17 +220,23 @@ bool Account::delete_document(mongocxx::database &db, const std::string &collect
 
         return result && result->deleted_count() == 1;
     } catch (const mongocxx::exception &e) {
-        std::cerr << "MongoDB Exception: " << e.what() << std::endl;
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
 
         return false;
     } catch (const std::exception &e) {
-        std::cerr << "Error deleting document: " << e.what() << std::endl;
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
 
         return false;
     }
 }
 
 bool Account::update_document(mongocxx::database &db, const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object) {
+    static metrics::histogram &latency = account_call("update_document");
+    call_scope scope(latency, "update_document");
+
+    if (_batch)
+        return queue_write(collection_name, QJsonObject{{"update_one", QJsonObject{{"filter", filter_object}, {"update", update_object}}}});
+
     try {
         mongocxx::collection collection = db.collection(collection_name);
 
@@ -181,17 +252,164 @@ bool Account::update_document(mongocxx::database &db, const std::string &collect
 
         return result && result->modified_count() == 1;
     } catch (const mongocxx::exception &e) {
-        std::cerr << "MongoDB Exception: " << e.what() << std::endl;
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
+
+        return false;
+    } catch (const std::exception &e) {
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
+
+        return false;
+    }
+}
+
+bool Account::update_many(mongocxx::database &db, const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object, const QJsonArray &array_filters) {
+    static metrics::histogram &latency = account_call("update_many");
+    call_scope scope(latency, "update_many");
+
+    if (_batch)
+        return queue_write(collection_name, QJsonObject{{"update_many", QJsonObject{{"filter", filter_object}, {"update", update_object}, {"array_filters", array_filters}}}});
+
+    try {
+        mongocxx::collection collection = db.collection(collection_name);
+
+        QString filter_json_string = QJsonDocument(filter_object).toJson(QJsonDocument::Compact);
+        bsoncxx::document::value filter = bsoncxx::from_json(filter_json_string.toStdString());
+
+        QString update_json_string = QJsonDocument(update_object).toJson(QJsonDocument::Compact);
+        bsoncxx::document::value update = bsoncxx::from_json(update_json_string.toStdString());
+
+        QString filters_json_string = QJsonDocument(QJsonObject{{"filters", array_filters}}).toJson(QJsonDocument::Compact);
+        bsoncxx::document::value filters = bsoncxx::from_json(filters_json_string.toStdString());
+
+        mongocxx::options::update update_options;
+        if (!array_filters.isEmpty())
+            update_options.array_filters(filters.view()["filters"].get_array().value);
+
+        mongocxx::stdx::optional<mongocxx::result::update> result = collection.update_many(filter.view(), update.view(), update_options);
+
+        return result.has_value();
+    } catch (const mongocxx::exception &e) {
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
+
+        return false;
+    } catch (const std::exception &e) {
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
+
+        return false;
+    }
+}
+
+bool Account::bulk_write(mongocxx::database &db, const std::string &collection_name, const QJsonArray &operations, bool ordered) {
+    static metrics::histogram &latency = account_call("bulk_write");
+    call_scope scope(latency, "bulk_write");
+
+    if (operations.isEmpty())
+        return true;
+
+    try {
+        mongocxx::collection collection = db.collection(collection_name);
+
+        // Keeps the parsed documents alive until the bulk is executed
+        std::vector<bsoncxx::document::value> documents;
+        documents.reserve(operations.size());
+
+        auto to_bson = [&documents](const QJsonObject &json_object) {
+            QString json_string = QJsonDocument(json_object).toJson(QJsonDocument::Compact);
+            documents.push_back(bsoncxx::from_json(json_string.toStdString()));
+
+            return documents.back().view();
+        };
+
+        mongocxx::options::bulk_write bulk_options;
+        bulk_options.ordered(ordered);
+
+        mongocxx::bulk_write bulk = collection.create_bulk_write(bulk_options);
+
+        for (const QJsonValue &value : operations) {
+            QJsonObject operation = value.toObject();
+            QString name = operation.keys().value(0);
+            QJsonObject arguments = operation.value(name).toObject();
+
+            if (name == "insert_one") {
+                bulk.append(mongocxx::model::insert_one{to_bson(arguments["document"].toObject())});
+            } else if (name == "update_one" || name == "update_many") {
+                bsoncxx::document::view filter = to_bson(arguments["filter"].toObject());
+                bsoncxx::document::view update = to_bson(arguments["update"].toObject());
+                QJsonArray array_filters = arguments["array_filters"].toArray();
+
+                if (name == "update_one") {
+                    mongocxx::model::update_one model{filter, update};
+                    if (!array_filters.isEmpty())
+                        model.array_filters(to_bson(QJsonObject{{"filters", array_filters}})["filters"].get_array().value);
+                    if (arguments["upsert"].toBool())
+                        model.upsert(true);
+
+                    bulk.append(model);
+                } else {
+                    mongocxx::model::update_many model{filter, update};
+                    if (!array_filters.isEmpty())
+                        model.array_filters(to_bson(QJsonObject{{"filters", array_filters}})["filters"].get_array().value);
+                    if (arguments["upsert"].toBool())
+                        model.upsert(true);
+
+                    bulk.append(model);
+                }
+            } else if (name == "delete_one") {
+                bulk.append(mongocxx::model::delete_one{to_bson(arguments["filter"].toObject())});
+            } else if (name == "delete_many") {
+                bulk.append(mongocxx::model::delete_many{to_bson(arguments["filter"].toObject())});
+            } else {
+                logger::error("unknown_bulk_operation", {{"operation", name}});
+
+                return false;
+            }
+        }
+
+        mongocxx::stdx::optional<mongocxx::result::bulk_write> result = bulk.execute();
+
+        return result.has_value();
+    } catch (const mongocxx::exception &e) {
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
 
         return false;
     } catch (const std::exception &e) {
-        std::cerr << "std Exception: " << e.what() << std::endl;
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
 
         return false;
     }
 }
 
+void Account::begin_batch() {
+    _batch.emplace();
+}
+
+bool Account::commit_batch(mongocxx::database &db) {
+    static metrics::histogram &latency = account_call("commit_batch");
+    call_scope scope(latency, "commit_batch");
+
+    if (!_batch)
+        return false;
+
+    std::map<std::string, QJsonArray> batch = std::move(*_batch);
+    _batch.reset();
+
+    bool written = true;
+    for (const auto &[collection_name, operations] : batch)
+        written = bulk_write(db, collection_name, operations) && written;
+
+    return written;
+}
+
+bool Account::queue_write(const std::string &collection_name, const QJsonObject &operation) {
+    (*_batch)[collection_name].append(operation);
+
+    return true;
+}
+
 QJsonDocument Account::find_document(mongocxx::database &db, const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &fields) {
+    static metrics::histogram &latency = account_call("find_document");
+    call_scope scope(latency, "find_document");
+
     try {
         mongocxx::collection collection = db.collection(collection_name);
 
@@ -219,17 +437,20 @@ QJsonDocument Account::find_document(mongocxx::database &db, const std::string &
 
         return (result_array.size() == 1) ? QJsonDocument(result_array.first().toObject()) : QJsonDocument(result_array);
     } catch (const mongocxx::exception &e) {
-        std::cerr << "MongoDB Exception: " << e.what() << std::endl;
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
 
         return QJsonDocument();
     } catch (const std::exception &e) {
-        std::cerr << "std Exception: " << e.what() << std::endl;
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
 
         return QJsonDocument();
     }
 }
 
 QJsonDocument Account::fetch_contacts_and_chats(mongocxx::database &db, const int &account_id) {
+    static metrics::histogram &latency = account_call("fetch_contacts_and_chats");
+    call_scope scope(latency, "fetch_contacts_and_chats");
+
     try {
         mongocxx::collection collection = db.collection("accounts");
 
@@ -303,15 +524,18 @@ QJsonDocument Account::fetch_contacts_and_chats(mongocxx::database &db, const in
 
         return result_array.isEmpty() ? QJsonDocument() : QJsonDocument(result_array);
     } catch (const mongocxx::exception &e) {
-        std::cerr << "MongoDB Exception: " << e.what() << std::endl;
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
         return QJsonDocument();
     } catch (const std::exception &e) {
-        std::cerr << "std Exception: " << e.what() << std::endl;
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
         return QJsonDocument();
     }
 }
 
 QJsonDocument Account::fetch_groups_and_chats(mongocxx::database &db, const int &account_id) {
+    static metrics::histogram &latency = account_call("fetch_groups_and_chats");
+    call_scope scope(latency, "fetch_groups_and_chats");
+
     try {
         mongocxx::collection collection = db.collection("accounts");
 
@@ -355,15 +579,18 @@ QJsonDocument Account::fetch_groups_and_chats(mongocxx::database &db, const int
 
         return result_array.isEmpty() ? QJsonDocument() : QJsonDocument(result_array);
     } catch (const mongocxx::exception &e) {
-        std::cerr << "MongoDB Exception: " << e.what() << std::endl;
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
         return QJsonDocument();
     } catch (const std::exception &e) {
-        std::cerr << "std Exception: " << e.what() << std::endl;
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
         return QJsonDocument();
     }
 }
 
 QJsonArray Account::fetch_contactIDs(mongocxx::database &db, const int &account_id) {
+    static metrics::histogram &latency = account_call("fetch_contactIDs");
+    call_scope scope(latency, "fetch_contactIDs");
+
     try {
         mongocxx::collection collection = db.collection("accounts");
 
@@ -405,70 +632,312 @@ QJsonArray Account::fetch_contactIDs(mongocxx::database &db, const int &account_
 
         return contact_ids_array;
     } catch (const mongocxx::exception &e) {
-        std::cerr << "MongoDB Exception: " << e.what() << std::endl;
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
 
         return QJsonArray();
     } catch (const std::exception &e) {
-        std::cerr << "std Exception: " << e.what() << std::endl;
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
 
         return QJsonArray();
     }
 }
 
-void Account::delete_account(mongocxx::database &db, const int &account_id) {
+namespace {
+
+QJsonArray as_array(const QJsonDocument &json_doc) {
+    if (json_doc.isArray())
+        return json_doc.array();
+
+    return json_doc.isObject() ? QJsonArray{json_doc.object()} : QJsonArray();
+}
+
+QJsonArray sorted_by(const QJsonArray &array, const QString &key) {
+    QList<QJsonObject> objects;
+    for (const QJsonValue &value : array)
+        objects.append(value.toObject());
+
+    std::sort(objects.begin(), objects.end(), [&key](const QJsonObject &a, const QJsonObject &b) { return a[key].toInteger() < b[key].toInteger(); });
+
+    QJsonArray sorted;
+    for (const QJsonObject &object : objects)
+        sorted.append(object);
+
+    return sorted;
+}
+
+QJsonObject last_of(const QJsonArray &messages) {
+    return messages.isEmpty() ? QJsonObject() : messages.last().toObject();
+}
+
+QJsonObject contact_summary(const QJsonObject &contact_info, const int &chat_id, const int &unread_messages, const QJsonObject &last_message) {
+    return QJsonObject{{"contactID", contact_info["_id"].toInt()},
+                       {"first_name", contact_info["first_name"].toString()},
+                       {"last_name", contact_info["last_name"].toString()},
+                       {"image_url", contact_info["image_url"].toString()},
+                       {"chatID", chat_id},
+                       {"unread_messages", unread_messages},
+                       {"last_message", last_message}};
+}
+
+QJsonObject group_summary(const QJsonObject &group, const int &unread_messages) {
+    return QJsonObject{{"groupID", group["_id"].toInt()},
+                       {"group_name", group["group_name"].toString()},
+                       {"group_image_url", group["group_image_url"].toString()},
+                       {"group_admin", group["group_admin"].toInt()},
+                       {"group_unread_messages", unread_messages},
+                       {"last_message", last_of(group["group_messages"].toArray())}};
+}
+
+}
+
+QJsonObject Inbox::build_inbox(mongocxx::database &db, const int &account_id) {
+    QJsonArray contacts;
+    for (const QJsonValue &value : as_array(Account::fetch_contacts_and_chats(db, account_id))) {
+        QJsonObject contact = value.toObject();
+
+        contacts.append(contact_summary(contact["contactInfo"].toObject(), contact["chatID"].toInt(), contact["unread_messages"].toInt(), last_of(contact["chatMessages"].toArray())));
+    }
+
+    QJsonArray groups;
+    for (const QJsonValue &value : as_array(Account::fetch_groups_and_chats(db, account_id))) {
+        QJsonObject group = value.toObject();
+
+        groups.append(group_summary(group, group["group_unread_messages"].toInt()));
+    }
+
+    return QJsonObject{{"_id", account_id},
+                       {"contacts", sorted_by(contacts, "chatID")},
+                       {"groups", sorted_by(groups, "groupID")}};
+}
+
+bool Inbox::rebuild_inbox(mongocxx::database &db, const int &account_id) {
     try {
-        mongocxx::collection account_collection = db["accounts"];
-        mongocxx::collection group_collection = db["groups"];
-        mongocxx::collection chats_collection = db["chats"];
+        mongocxx::collection collection = db.collection("inboxes");
 
-        bsoncxx::stdx::optional<bsoncxx::document::value> account_doc = account_collection.find_one(
-            bsoncxx::builder::stream::document{} << "_id" << account_id << bsoncxx::builder::stream::finalize);
+        QString json_string = QJsonDocument(build_inbox(db, account_id)).toJson(QJsonDocument::Compact);
+        bsoncxx::document::value document = bsoncxx::from_json(json_string.toStdString());
 
-        if (!account_doc) {
-            std::cerr << "Account not found." << std::endl;
-            return;
-        }
+        mongocxx::options::replace replace_options;
+        replace_options.upsert(true);
 
-        bsoncxx::document::view account_view = account_doc->view();
+        mongocxx::stdx::optional<mongocxx::result::replace_one> result = collection.replace_one(
+            bsoncxx::builder::stream::document{} << "_id" << account_id << bsoncxx::builder::stream::finalize,
+            document.view(), replace_options);
 
-        bsoncxx::array::view groups = account_view["groups"].get_array().value;
-        for (bsoncxx::array::element group : groups) {
-            int groupID = group["groupID"].get_int32();
+        return result.has_value();
+    } catch (const mongocxx::exception &e) {
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
 
-            group_collection.update_one(
-                bsoncxx::builder::stream::document{} << "_id" << groupID << bsoncxx::builder::stream::finalize,
-                bsoncxx::builder::stream::document{} << "$pull" << bsoncxx::builder::stream::open_document
-                                                     << "group_members" << account_id
-                                                     << bsoncxx::builder::stream::close_document << bsoncxx::builder::stream::finalize);
-        }
+        return false;
+    } catch (const std::exception &e) {
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
 
-        bsoncxx::array::view contacts = account_view["contacts"].get_array().value;
-        for (bsoncxx::array::element contact : contacts) {
-            int chatID = contact["chatID"].get_int32();
-
-            account_collection.update_many(
-                bsoncxx::builder::stream::document{} << "contacts.chatID" << chatID << bsoncxx::builder::stream::finalize,
-                bsoncxx::builder::stream::document{} << "$pull" << bsoncxx::builder::stream::open_document
-                                                     << "contacts" << bsoncxx::builder::stream::open_document
-                                                     << "chatID" << chatID
-                                                     << bsoncxx::builder::stream::close_document
-                                                     << bsoncxx::builder::stream::close_document << bsoncxx::builder::stream::finalize);
-        }
+        return false;
+    }
+}
+
+bool Inbox::check_inbox(mongocxx::database &db, const int &account_id) {
+    QJsonObject stored = Account::find_document(db, "inboxes", QJsonObject{{"_id", account_id}}).object();
+    QJsonObject expected = build_inbox(db, account_id);
+
+    bool consistent = sorted_by(stored["contacts"].toArray(), "chatID") == expected["contacts"].toArray() &&
+                      sorted_by(stored["groups"].toArray(), "groupID") == expected["groups"].toArray();
+
+    if (!consistent) {
+        logger::warning("inbox_drifted", {{"id", account_id}});
+        rebuild_inbox(db, account_id);
+    }
+
+    return consistent;
+}
+
+bool Inbox::delete_inbox(mongocxx::database &db, const int &account_id) {
+    bool deleted = Account::delete_document(db, "inboxes", QJsonObject{{"_id", account_id}});
+
+    update_inboxes(db, QJsonObject{{"contacts.contactID", account_id}},
+                   QJsonObject{{"$pull", QJsonObject{{"contacts", QJsonObject{{"contactID", account_id}}}}}});
+
+    return deleted;
+}
+
+bool Inbox::add_contact(mongocxx::database &db, const int &account_id, const QJsonObject &contact_info, const int &chat_id, const QJsonObject &last_message) {
+    QJsonObject push_object{{"contacts", contact_summary(contact_info, chat_id, 1, last_message)}};
+
+    return update_inboxes(db, QJsonObject{{"_id", account_id}}, QJsonObject{{"$push", push_object}});
+}
+
+bool Inbox::add_group(mongocxx::database &db, const QJsonArray &member_ids, const QJsonObject &group) {
+    QJsonObject push_object{{"groups", group_summary(group, 1)}};
+
+    return update_inboxes(db, QJsonObject{{"_id", QJsonObject{{"$in", member_ids}}}}, QJsonObject{{"$push", push_object}});
+}
+
+bool Inbox::remove_group(mongocxx::database &db, const QJsonArray &member_ids, const int &group_id) {
+    QJsonObject pull_object{{"groups", QJsonObject{{"groupID", group_id}}}};
+
+    return update_inboxes(db, QJsonObject{{"_id", QJsonObject{{"$in", member_ids}}}}, QJsonObject{{"$pull", pull_object}});
+}
+
+bool Inbox::update_contact(mongocxx::database &db, const int &contact_id, const QJsonObject &fields) {
+    QJsonObject set_object;
+    for (auto it = fields.begin(); it != fields.end(); ++it)
+        set_object.insert("contacts.$[contact]." + it.key(), it.value());
+
+    return update_inboxes(db, QJsonObject{{"contacts.contactID", contact_id}}, QJsonObject{{"$set", set_object}},
+                          QJsonArray{QJsonObject{{"contact.contactID", contact_id}}});
+}
+
+bool Inbox::update_group(mongocxx::database &db, const int &group_id, const QJsonObject &fields) {
+    QJsonObject set_object;
+    for (auto it = fields.begin(); it != fields.end(); ++it)
+        set_object.insert("groups.$[group]." + it.key(), it.value());
+
+    return update_inboxes(db, QJsonObject{{"groups.groupID", group_id}}, QJsonObject{{"$set", set_object}},
+                          QJsonArray{QJsonObject{{"group.groupID", group_id}}});
+}
+
+bool Inbox::set_last_message(mongocxx::database &db, const int &chat_id, const QJsonObject &last_message) {
+    return update_inboxes(db, QJsonObject{{"contacts.chatID", chat_id}},
+                          QJsonObject{{"$set", QJsonObject{{"contacts.$[contact].last_message", last_message}}}},
+                          QJsonArray{QJsonObject{{"contact.chatID", chat_id}}});
+}
+
+bool Inbox::set_group_last_message(mongocxx::database &db, const int &group_id, const QJsonObject &last_message) {
+    return update_inboxes(db, QJsonObject{{"groups.groupID", group_id}},
+                          QJsonObject{{"$set", QJsonObject{{"groups.$[group].last_message", last_message}}}},
+                          QJsonArray{QJsonObject{{"group.groupID", group_id}}});
+}
+
+bool Inbox::refresh_last_message(mongocxx::database &db, const int &chat_id) {
+    QJsonDocument chat = Account::find_document(db, "chats", QJsonObject{{"_id", chat_id}}, QJsonObject{{"messages", QJsonObject{{"$slice", -1}}}});
+    QJsonObject last_message = last_of(chat.object()["messages"].toArray());
+
+    return set_last_message(db, chat_id, last_message);
+}
 
-        for (bsoncxx::array::element contact : contacts) {
-            int chatID = contact["chatID"].get_int32();
+bool Inbox::refresh_group_last_message(mongocxx::database &db, const int &group_id) {
+    QJsonDocument group = Account::find_document(db, "groups", QJsonObject{{"_id", group_id}}, QJsonObject{{"group_messages", QJsonObject{{"$slice", -1}}}});
+    QJsonObject last_message = last_of(group.object()["group_messages"].toArray());
 
-            chats_collection.delete_one(
-                bsoncxx::builder::stream::document{} << "_id" << chatID << bsoncxx::builder::stream::finalize);
+    return set_group_last_message(db, group_id, last_message);
+}
+
+bool Inbox::update_inboxes(mongocxx::database &db, const QJsonObject &filter_object, const QJsonObject &update_object, const QJsonArray &array_filters) {
+    return Account::update_many(db, "inboxes", filter_object, update_object, array_filters);
+}
+
+MongoSnapshot::MongoSnapshot(mongocxx::database &db, const int &account_id)
+    : _db(db) {
+    QJsonDocument inbox_doc = Account::find_document(db, "inboxes", QJsonObject{{"_id", account_id}});
+    if (inbox_doc.isEmpty()) {
+        Inbox::rebuild_inbox(db, account_id);
+        inbox_doc = Account::find_document(db, "inboxes", QJsonObject{{"_id", account_id}});
+    }
+
+    for (const QJsonValue &value : inbox_doc.object()["contacts"].toArray()) {
+        _contacts.insert(value.toObject()["chatID"].toInt(), value.toObject());
+        _chat_ids.append(value.toObject()["chatID"]);
+    }
+
+    for (const QJsonValue &value : inbox_doc.object()["groups"].toArray()) {
+        _groups.insert(value.toObject()["groupID"].toInt(), value.toObject());
+        _group_ids.append(value.toObject()["groupID"]);
+    }
+
+    if (!open("chats", _chat_ids, QJsonObject{})) {
+        _stage = Group;
+        if (!open("groups", _group_ids, QJsonObject{{"group_members", 1}, {"group_messages", 1}}))
+            _stage = End;
+    }
+}
+
+Snapshot::Kind MongoSnapshot::next(QJsonObject &item) {
+    try {
+        while (_stage != End) {
+            if (*_it == _cursor->end()) {
+                _it.reset();
+                _cursor.reset();
+
+                if (_stage == Contact && open("groups", _group_ids, QJsonObject{{"group_members", 1}, {"group_messages", 1}}))
+                    _stage = Group;
+                else
+                    _stage = End;
+
+                continue;
+            }
+
+            QJsonObject document = QJsonDocument::fromJson(QByteArray::fromStdString(bsoncxx::to_json(**_it))).object();
+            ++*_it;
+
+            if (_stage == Contact) {
+                QJsonObject contact = _contacts.value(document["_id"].toInt());
+
+                QJsonObject contact_info{{"_id", contact["contactID"]},
+                                         {"first_name", contact["first_name"]},
+                                         {"last_name", contact["last_name"]},
+                                         {"image_url", contact["image_url"]},
+                                         {"status", false}};
+
+                item = QJsonObject{{"contactInfo", contact_info},
+                                   {"chatID", contact["chatID"]},
+                                   {"unread_messages", contact["unread_messages"]},
+                                   {"chatMessages", document["messages"]}};
+
+                return Contact;
+            }
+
+            QJsonObject group = _groups.value(document["_id"].toInt());
+
+            item = QJsonObject{{"_id", group["groupID"]},
+                               {"group_name", group["group_name"]},
+                               {"group_unread_messages", group["group_unread_messages"]},
+                               {"group_image_url", group["group_image_url"]},
+                               {"group_admin", group["group_admin"]},
+                               {"group_members", document["group_members"]},
+                               {"group_messages", document["group_messages"]}};
+
+            return Group;
         }
+    } catch (const mongocxx::exception &e) {
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
+    } catch (const std::exception &e) {
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
+    }
+
+    _it.reset();
+    _cursor.reset();
+    _stage = End;
+
+    return End;
+}
+
+bool MongoSnapshot::open(const std::string &collection_name, const QJsonArray &ids, const QJsonObject &fields) {
+    if (ids.isEmpty())
+        return false;
+
+    try {
+        mongocxx::collection collection = _db.collection(collection_name);
+
+        QString filter_json_string = QJsonDocument(QJsonObject{{"_id", QJsonObject{{"$in", ids}}}}).toJson(QJsonDocument::Compact);
+        bsoncxx::document::value filter = bsoncxx::from_json(filter_json_string.toStdString());
+
+        QString fields_json_string = QJsonDocument(fields).toJson(QJsonDocument::Compact);
+        bsoncxx::document::value projection = bsoncxx::from_json(fields_json_string.toStdString());
+
+        mongocxx::options::find find_options;
+        find_options.projection(projection.view());
 
-        account_collection.delete_one(
-            bsoncxx::builder::stream::document{} << "_id" << account_id << bsoncxx::builder::stream::finalize);
+        _cursor.emplace(collection.find(filter.view(), find_options));
+        _it.emplace(_cursor->begin());
 
-        std::cout << "Account, associated group memberships, and chats deleted successfully." << std::endl;
+        return true;
     } catch (const mongocxx::exception &e) {
-        std::cerr << "MongoDB Exception: " << e.what() << std::endl;
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
+
+        return false;
     } catch (const std::exception &e) {
-        std::cerr << "std Exception: " << e.what() << std::endl;
+        logger::error("std_exception", {{"in", __func__}, {"error", e.what()}});
+
+        return false;
     }
 }
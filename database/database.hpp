@@ -9,8 +9,11 @@
 #include <QtWidgets>
 
 #include <argon2.h>
+#include <map>
+#include <optional>
 #include <bsoncxx/builder/stream/document.hpp>
 #include <bsoncxx/json.hpp>
+#include <mongocxx/bulk_write.hpp>
 #include <mongocxx/client.hpp>
 #include <mongocxx/exception/exception.hpp>
 #include <mongocxx/instance.hpp>
@@ -43,6 +46,12 @@ class Account {
 
     static bool update_document(mongocxx::database &db, const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object);
 
+    static bool update_many(mongocxx::database &db, const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object, const QJsonArray &array_filters = QJsonArray());
+
+    // Operations use the shell syntax, e.g. {"update_one": {"filter": {...}, "update": {...}, "array_filters": [...], "upsert": true}},
+    // also insert_one {"document"}, update_many, delete_one and delete_many {"filter"}
+    static bool bulk_write(mongocxx::database &db, const std::string &collection_name, const QJsonArray &operations, bool ordered = true);
+
     static QJsonDocument find_document(mongocxx::database &db, const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &fields = QJsonObject());
 
     static QJsonDocument fetch_contacts_and_chats(mongocxx::database &db, const int &account_id);
@@ -50,7 +59,84 @@ class Account {
     static QJsonDocument fetch_groups_and_chats(mongocxx::database &db, const int &account_id);
 
     static QJsonArray fetch_contactIDs(mongocxx::database &db, const int &account_id);
-    static void delete_account(mongocxx::database &db, const int &account_id);
+
+    // Between begin_batch and commit_batch, inserts, updates and deletes made
+    // on this thread are queued instead of sent, then written as one ordered
+    // bulk_write per collection. Reads are not deferred, so only batch writes
+    // that never read their own results.
+    static void begin_batch();
+    static bool commit_batch(mongocxx::database &db);
+
+  private:
+    static bool queue_write(const std::string &collection_name, const QJsonObject &operation);
+
+    static inline thread_local std::optional<std::map<std::string, QJsonArray>> _batch{};
+};
+
+// Materialized per-user view of contacts and groups, kept in "inboxes" so a
+// login reads one document instead of joining accounts, chats and groups.
+// Write handlers patch it in place, and rebuild_inbox recreates it from the
+// source collections when it is missing or has drifted.
+class Inbox {
+  public:
+    static bool rebuild_inbox(mongocxx::database &db, const int &account_id);
+    static bool check_inbox(mongocxx::database &db, const int &account_id);
+    static bool delete_inbox(mongocxx::database &db, const int &account_id);
+
+    static bool add_contact(mongocxx::database &db, const int &account_id, const QJsonObject &contact_info, const int &chat_id, const QJsonObject &last_message);
+    static bool add_group(mongocxx::database &db, const QJsonArray &member_ids, const QJsonObject &group);
+    static bool remove_group(mongocxx::database &db, const QJsonArray &member_ids, const int &group_id);
+
+    static bool update_contact(mongocxx::database &db, const int &contact_id, const QJsonObject &fields);
+    static bool update_group(mongocxx::database &db, const int &group_id, const QJsonObject &fields);
+
+    static bool set_last_message(mongocxx::database &db, const int &chat_id, const QJsonObject &last_message);
+    static bool set_group_last_message(mongocxx::database &db, const int &group_id, const QJsonObject &last_message);
+    static bool refresh_last_message(mongocxx::database &db, const int &chat_id);
+    static bool refresh_group_last_message(mongocxx::database &db, const int &group_id);
+
+  private:
+    static QJsonObject build_inbox(mongocxx::database &db, const int &account_id);
+    static bool update_inboxes(mongocxx::database &db, const QJsonObject &filter_object, const QJsonObject &update_object, const QJsonArray &array_filters = QJsonArray());
+};
+
+// Walks a login snapshot one contact or group at a time, so a login never
+// holds the whole account in memory. Each Repository supplies its own.
+class Snapshot {
+  public:
+    enum Kind {
+        Contact,
+        Group,
+        End
+    };
+
+    virtual ~Snapshot() = default;
+
+    virtual Kind next(QJsonObject &item) = 0;
+};
+
+// Reads the inbox, then streams straight off the chats and groups cursors,
+// so only the current chat history is in memory. Holds open cursors, so keep
+// it in one place (e.g. behind a unique_ptr).
+class MongoSnapshot : public Snapshot {
+  public:
+    MongoSnapshot(mongocxx::database &db, const int &account_id);
+
+    Kind next(QJsonObject &item) override;
+
+  private:
+    mongocxx::database &_db;
+
+    QHash<int, QJsonObject> _contacts{};
+    QHash<int, QJsonObject> _groups{};
+    QJsonArray _chat_ids{};
+    QJsonArray _group_ids{};
+
+    Kind _stage{Contact};
+    std::optional<mongocxx::cursor> _cursor{};
+    std::optional<mongocxx::cursor::iterator> _it{};
+
+    bool open(const std::string &collection_name, const QJsonArray &ids, const QJsonObject &fields);
 };
 
 class S3 {
@@ -60,4 +146,9 @@ class S3 {
     static std::string store_data_to_s3(Aws::S3::S3Client &s3_client, const std::string &key, const std::string &data);
 
     static bool delete_data_from_s3(const Aws::S3::S3Client &s3_client, const std::string &key);
+
+    // Uploads go under media/<owner>/, so a client-chosen file name never
+    // lands on, or is deleted as, another account's object
+    static QString owned_key(const int &owner_ID, const QString &file_name);
+    static bool owned_by(const int &owner_ID, const QString &key);
 };
@@ -0,0 +1,375 @@
+#include "logger.hpp"
+#include "metrics.hpp"
+#include <QDateTime>
+#include <QtGlobal>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace logger {
+
+namespace {
+
+constexpr std::array<const char *, 5> level_names{"trace", "debug", "info", "warning", "error"};
+
+struct Slot {
+    std::atomic<size_t> sequence{0};
+    quint16 length{0};
+    char text[494]{};
+};
+
+// Bounded multi-producer queue (Vyukov); the drain thread is its only consumer
+class ring {
+  public:
+    static constexpr size_t Capacity = 4096;
+
+    ring() {
+        for (size_t index = 0; index < Capacity; index++)
+            _slots[index].sequence.store(index, std::memory_order_relaxed);
+    }
+
+    bool push(const char *text, size_t length) {
+        size_t position = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &slot = _slots[position & (Capacity - 1)];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if (difference == 0) {
+                if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    std::memcpy(slot.text, text, length);
+                    slot.length = static_cast<quint16>(length);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template <typename Consume>
+    size_t pop_all(Consume consume) {
+        size_t popped = 0;
+        for (;;) {
+            Slot &slot = _slots[_head & (Capacity - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != _head + 1)
+                return popped;
+
+            consume(slot.text, slot.length);
+            slot.sequence.store(_head + Capacity, std::memory_order_release);
+
+            _head++;
+            popped++;
+        }
+    }
+
+  private:
+    std::array<Slot, Capacity> _slots{};
+    alignas(64) std::atomic<size_t> _tail{0};
+    alignas(64) size_t _head{0};
+};
+
+struct limiter_slot {
+    std::atomic<const char *> event{nullptr};
+    std::atomic<qint64> window{0};
+    std::atomic<int> count{0};
+    std::atomic<int> suppressed{0};
+};
+
+class sink {
+  public:
+    sink() {
+        if (const char *path = std::getenv("CHAT_APP_LOG_FILE"))
+            _file = std::fopen(path, "a");
+
+        if (!_file)
+            _file = stderr;
+
+        if (const char *value = std::getenv("CHAT_APP_LOG_LEVEL")) {
+            for (int index = 0; index < static_cast<int>(level_names.size()); index++) {
+                if (qstricmp(value, level_names[index]) == 0)
+                    _level = static_cast<level>(index);
+            }
+        }
+
+        if (const char *value = std::getenv("CHAT_APP_LOG_BURST"))
+            _burst = std::max(1, std::atoi(value));
+
+        _thread = std::thread([this]() { run(); });
+    }
+
+    ~sink() {
+        _running.store(false, std::memory_order_release);
+        _wake.notify_one();
+        _thread.join();
+
+        if (_file != stderr)
+            std::fclose(_file);
+    }
+
+    level threshold() const { return _level; }
+    int burst() const { return _burst; }
+
+    std::array<limiter_slot, 128> limiter{};
+
+    void push(const char *text, size_t length) {
+        static metrics::counter &dropped = metrics::registry::instance().counter_of("chat_log_dropped_total", "Log records lost to a full ring", QString());
+
+        if (!_ring.push(text, length)) {
+            dropped.add();
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (_sleeping.load(std::memory_order_acquire))
+            _wake.notify_one();
+    }
+
+    void flush() {
+        quint64 target = _pushed_marker.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+        std::unique_lock lock(_mutex);
+        _wake.notify_one();
+        _flushed.wait(lock, [this, target]() { return _flushed_marker >= target || !_running.load(std::memory_order_acquire); });
+    }
+
+  private:
+    ring _ring{};
+    FILE *_file{nullptr};
+    level _level{Info};
+    int _burst{20};
+
+    std::atomic<bool> _running{true};
+    std::atomic<bool> _sleeping{false};
+    std::atomic<quint64> _dropped{0};
+    std::atomic<quint64> _pushed_marker{0};
+    quint64 _flushed_marker{0};
+
+    std::mutex _mutex{};
+    std::condition_variable _wake{};
+    std::condition_variable _flushed{};
+    std::thread _thread{};
+
+    void run() {
+        for (;;) {
+            quint64 marker = _pushed_marker.load(std::memory_order_acquire);
+
+            size_t written = _ring.pop_all([this](const char *text, quint16 length) { std::fwrite(text, 1, length, _file); });
+
+            if (quint64 dropped = _dropped.exchange(0, std::memory_order_relaxed))
+                std::fprintf(_file, "%s level=warning event=log_records_dropped count=%llu\n", timestamp().constData(), static_cast<unsigned long long>(dropped));
+
+            if (written)
+                std::fflush(_file);
+
+            {
+                std::unique_lock lock(_mutex);
+                _flushed_marker = marker;
+                _flushed.notify_all();
+
+                if (!_running.load(std::memory_order_acquire))
+                    break;
+
+                _sleeping.store(true, std::memory_order_release);
+                _wake.wait_for(lock, std::chrono::milliseconds(100));
+                _sleeping.store(false, std::memory_order_release);
+            }
+        }
+
+        _ring.pop_all([this](const char *text, quint16 length) { std::fwrite(text, 1, length, _file); });
+        std::fflush(_file);
+    }
+
+  public:
+    static QByteArray timestamp() {
+        return QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs).toLatin1();
+    }
+};
+
+sink &instance() {
+    static sink log_sink;
+    return log_sink;
+}
+
+// Appends into a fixed buffer, truncating rather than allocating
+class line {
+  public:
+    void append(std::string_view text) {
+        size_t length = std::min(text.size(), Capacity - _length);
+        std::memcpy(_buffer + _length, text.data(), length);
+        _length += length;
+    }
+
+    void append(char character) {
+        if (_length < Capacity)
+            _buffer[_length++] = character;
+    }
+
+    // Quotes values containing spaces, quotes or '=' as logfmt expects
+    void value(std::string_view text) {
+        bool quote = text.empty() || text.find_first_of(" \"=\t") != std::string_view::npos;
+        if (!quote) {
+            append(text);
+            return;
+        }
+
+        append('"');
+        for (char character : text) {
+            if (character == '"' || character == '\\')
+                append('\\');
+
+            append(character == '\n' ? ' ' : character);
+        }
+        append('"');
+    }
+
+    const char *data() {
+        // Always ends with a newline, even when truncated
+        if (_length == Capacity)
+            _buffer[Capacity - 1] = '\n';
+        else
+            _buffer[_length++] = '\n';
+
+        return _buffer;
+    }
+
+    size_t size() const { return _length; }
+
+  private:
+    static constexpr size_t Capacity = sizeof(Slot::text);
+
+    char _buffer[Capacity];
+    size_t _length{0};
+};
+
+}
+
+level runtime_level() {
+    return instance().threshold();
+}
+
+bool admit(level severity, const char *event, int &suppressed) {
+    static metrics::counter &suppressed_total = metrics::registry::instance().counter_of("chat_log_suppressed_total", "Repeated warnings and errors not written", QString());
+
+    suppressed = 0;
+    if (severity < Warning)
+        return true;
+
+    sink &log_sink = instance();
+
+    // Events are string literals, so each claims a slot for good: probe from
+    // its hash to its own slot or a free one. Only once every slot is taken
+    // does an event share the budget of the slot it hashes to.
+    const size_t home = (reinterpret_cast<quintptr>(event) >> 3) % log_sink.limiter.size();
+    limiter_slot *claimed = &log_sink.limiter[home];
+    for (size_t probe = 0; probe < log_sink.limiter.size(); probe++) {
+        limiter_slot &candidate = log_sink.limiter[(home + probe) % log_sink.limiter.size()];
+        const char *owner = candidate.event.load(std::memory_order_relaxed);
+        if (!owner && candidate.event.compare_exchange_strong(owner, event, std::memory_order_relaxed))
+            owner = event;
+
+        if (owner == event) {
+            claimed = &candidate;
+            break;
+        }
+    }
+    limiter_slot &slot = *claimed;
+
+    qint64 second = QDateTime::currentSecsSinceEpoch();
+
+    qint64 window = slot.window.load(std::memory_order_relaxed);
+    if (window != second && slot.window.compare_exchange_strong(window, second, std::memory_order_relaxed))
+        slot.count.store(0, std::memory_order_relaxed);
+
+    if (slot.count.fetch_add(1, std::memory_order_relaxed) < log_sink.burst()) {
+        suppressed = slot.suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    slot.suppressed.fetch_add(1, std::memory_order_relaxed);
+    suppressed_total.add();
+
+    return false;
+}
+
+void record(level severity, const char *event, std::initializer_list<field> fields) {
+    int suppressed = 0;
+    if (!admit(severity, event, suppressed))
+        return;
+
+    line text;
+    text.append(std::string_view(sink::timestamp()));
+    text.append(" level=");
+    text.append(level_names[severity]);
+    text.append(" event=");
+    text.append(event);
+
+    char number[32];
+    for (const field &item : fields) {
+        text.append(' ');
+        text.append(item._key);
+        text.append('=');
+
+        switch (item._kind) {
+        case field::Integer:
+            text.append(std::string_view(number, static_cast<size_t>(std::snprintf(number, sizeof(number), "%lld", static_cast<long long>(item._integer)))));
+            break;
+        case field::Boolean:
+            text.append(item._integer ? "true" : "false");
+            break;
+        case field::Real:
+            text.append(std::string_view(number, static_cast<size_t>(std::snprintf(number, sizeof(number), "%g", item._real))));
+            break;
+        case field::Text:
+            text.value(item._text);
+            break;
+        case field::Utf16: {
+            QByteArray utf8 = item._utf16->toUtf8();
+            text.value(std::string_view(utf8.constData(), static_cast<size_t>(utf8.size())));
+            break;
+        }
+        }
+    }
+
+    if (suppressed) {
+        text.append(" suppressed=");
+        text.append(std::string_view(number, static_cast<size_t>(std::snprintf(number, sizeof(number), "%d", suppressed))));
+    }
+
+    const char *data = text.data();
+    instance().push(data, text.size());
+}
+
+void flush() {
+    instance().flush();
+}
+
+void install_qt_handler() {
+    qInstallMessageHandler([](QtMsgType type, const QMessageLogContext &, const QString &message) {
+        switch (type) {
+        case QtDebugMsg:
+            write<Debug>("qt", {{"message", message}});
+            break;
+        case QtInfoMsg:
+            write<Info>("qt", {{"message", message}});
+            break;
+        case QtWarningMsg:
+            write<Warning>("qt", {{"message", message}});
+            break;
+        case QtCriticalMsg:
+        case QtFatalMsg:
+            write<Error>("qt", {{"message", message}});
+            flush();
+            break;
+        }
+    });
+}
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+// Levels below this are compiled out; set with -DCHAT_APP_LOG_MIN_LEVEL
+#ifndef CHAT_APP_LOG_MIN_LEVEL
+#define CHAT_APP_LOG_MIN_LEVEL 1
+#endif
+
+// Structured, leveled logging that never blocks the caller. A record is
+// formatted as logfmt into a fixed-size slot of a lock-free ring and written
+// out by a background thread to stderr or CHAT_APP_LOG_FILE. Warnings and
+// errors are limited to CHAT_APP_LOG_BURST records per second per event, the
+// rest are counted and reported on the next record that gets through. The
+// runtime threshold is CHAT_APP_LOG_LEVEL (trace, debug, info, warning, error).
+//
+// Events are string literals naming what happened, e.g. "client_connected";
+// fields carry the details:
+//     logger::info("client_connected", {{"id", phone_number}});
+namespace logger {
+
+enum level {
+    Trace,
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+class field {
+  public:
+    field(const char *key, int value) : _key(key), _kind(Integer), _integer(value) {}
+    field(const char *key, qint64 value) : _key(key), _kind(Integer), _integer(value) {}
+    field(const char *key, quint64 value) : _key(key), _kind(Integer), _integer(static_cast<qint64>(value)) {}
+    field(const char *key, bool value) : _key(key), _kind(Boolean), _integer(value) {}
+    field(const char *key, double value) : _key(key), _kind(Real), _real(value) {}
+    field(const char *key, const char *value) : _key(key), _kind(Text), _text(value ? value : "") {}
+    field(const char *key, std::string_view value) : _key(key), _kind(Text), _text(value) {}
+    field(const char *key, const std::string &value) : _key(key), _kind(Text), _text(value) {}
+    field(const char *key, const QByteArray &value) : _key(key), _kind(Text), _text(value.constData(), static_cast<size_t>(value.size())) {}
+    field(const char *key, const QString &value) : _key(key), _kind(Utf16), _utf16(&value) {}
+
+  private:
+    friend void record(level, const char *, std::initializer_list<field>);
+
+    enum Kind {
+        Integer,
+        Boolean,
+        Real,
+        Text,
+        Utf16
+    };
+
+    const char *_key;
+    Kind _kind;
+    qint64 _integer{0};
+    double _real{0};
+    std::string_view _text{};
+    const QString *_utf16{nullptr};
+};
+
+level runtime_level();
+
+// Rate-limits warnings and errors per event, sets how many were suppressed
+bool admit(level severity, const char *event, int &suppressed);
+
+void record(level severity, const char *event, std::initializer_list<field> fields);
+
+// Waits until everything recorded so far has been written
+void flush();
+
+// Routes qDebug/qWarning and friends through the ring as well
+void install_qt_handler();
+
+template <level Level>
+inline void write(const char *event, std::initializer_list<field> fields) {
+    if constexpr (Level >= CHAT_APP_LOG_MIN_LEVEL) {
+        if (Level >= runtime_level())
+            record(Level, event, fields);
+    }
+}
+
+inline void trace(const char *event, std::initializer_list<field> fields = {}) { write<Trace>(event, fields); }
+inline void debug(const char *event, std::initializer_list<field> fields = {}) { write<Debug>(event, fields); }
+inline void info(const char *event, std::initializer_list<field> fields = {}) { write<Info>(event, fields); }
+inline void warning(const char *event, std::initializer_list<field> fields = {}) { write<Warning>(event, fields); }
+inline void error(const char *event, std::initializer_list<field> fields = {}) { write<Error>(event, fields); }
+
+}
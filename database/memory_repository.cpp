@@ -0,0 +1,809 @@
+#include "memory_repository.hpp"
+#include "logger.hpp"
+#include <cmath>
+#include <utility>
+
+size_t DocumentTable::home_of(qint64 id) const {
+    quint64 hash = static_cast<quint64>(id);
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+
+    return static_cast<size_t>(hash) & (_slots.size() - 1);
+}
+
+QJsonObject *DocumentTable::find(qint64 id) {
+    return const_cast<QJsonObject *>(std::as_const(*this).find(id));
+}
+
+const QJsonObject *DocumentTable::find(qint64 id) const {
+    if (_slots.empty())
+        return nullptr;
+
+    for (size_t index = home_of(id);; index = (index + 1) & (_slots.size() - 1)) {
+        const Slot &slot = _slots[index];
+        if (!slot.used)
+            return nullptr;
+        if (slot.id == id)
+            return &slot.document;
+    }
+}
+
+bool DocumentTable::insert(qint64 id, const QJsonObject &document) {
+    if (static_cast<size_t>(_size + 1) * 4 > _slots.size() * 3)
+        grow();
+
+    size_t index = home_of(id);
+    for (; _slots[index].used; index = (index + 1) & (_slots.size() - 1)) {
+        if (_slots[index].id == id)
+            return false;
+    }
+
+    _slots[index] = Slot{id, true, document};
+    _size++;
+
+    return true;
+}
+
+bool DocumentTable::erase(qint64 id) {
+    if (_slots.empty())
+        return false;
+
+    const size_t mask = _slots.size() - 1;
+
+    size_t hole = home_of(id);
+    for (; _slots[hole].id != id; hole = (hole + 1) & mask) {
+        if (!_slots[hole].used)
+            return false;
+    }
+    if (!_slots[hole].used)
+        return false;
+
+    // Pull later members of the probe run back into the hole, so lookups
+    // never need to step over a deleted slot
+    for (size_t next = (hole + 1) & mask; _slots[next].used; next = (next + 1) & mask) {
+        size_t home = home_of(_slots[next].id);
+
+        bool reachable = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+        if (reachable) {
+            _slots[hole] = std::move(_slots[next]);
+            hole = next;
+        }
+    }
+
+    _slots[hole] = Slot{};
+    _size--;
+
+    return true;
+}
+
+void DocumentTable::grow() {
+    std::vector<Slot> old = std::exchange(_slots, std::vector<Slot>(std::max<size_t>(16, _slots.size() * 2)));
+    _size = 0;
+
+    for (Slot &slot : old) {
+        if (slot.used)
+            insert(slot.id, std::move(slot.document));
+    }
+}
+
+namespace {
+
+bool is_operator_object(const QJsonValue &value) {
+    return value.isObject() && !value.toObject().isEmpty() && value.toObject().begin().key().startsWith('$');
+}
+
+bool same(const QJsonValue &a, const QJsonValue &b) {
+    if (a.isDouble() && b.isDouble())
+        return a.toDouble() == b.toDouble();
+
+    return a == b;
+}
+
+bool truthy(const QJsonValue &value) {
+    return value.isBool() ? value.toBool() : value.toDouble() != 0;
+}
+
+// Values at a dotted path, descending into arrays the way MongoDB does: an
+// array on the way is searched element by element, and an array at the end
+// counts both whole and per element
+void collect(const QJsonValue &node, QStringView path, QList<QJsonValue> &values) {
+    if (path.isEmpty()) {
+        values.append(node);
+
+        if (node.isArray()) {
+            for (const QJsonValue &element : node.toArray())
+                values.append(element);
+        }
+
+        return;
+    }
+
+    if (node.isArray()) {
+        for (const QJsonValue &element : node.toArray())
+            collect(element, path, values);
+
+        return;
+    }
+
+    if (!node.isObject())
+        return;
+
+    qsizetype dot = path.indexOf('.');
+    QJsonObject object = node.toObject();
+
+    auto it = object.constFind(dot < 0 ? path : path.left(dot));
+    if (it != object.constEnd())
+        collect(*it, dot < 0 ? QStringView() : path.mid(dot + 1), values);
+}
+
+bool compare(const QList<QJsonValue> &values, const QJsonValue &operand, const QString &op) {
+    for (const QJsonValue &value : values) {
+        int order;
+        if (value.isDouble() && operand.isDouble())
+            order = value.toDouble() < operand.toDouble() ? -1 : value.toDouble() > operand.toDouble();
+        else if (value.isString() && operand.isString())
+            order = value.toString().compare(operand.toString());
+        else
+            continue;
+
+        if ((op == "$gt" && order > 0) || (op == "$gte" && order >= 0) || (op == "$lt" && order < 0) || (op == "$lte" && order <= 0))
+            return true;
+    }
+
+    return false;
+}
+
+bool contains_any(const QList<QJsonValue> &values, const QJsonArray &candidates) {
+    for (const QJsonValue &value : values) {
+        for (const QJsonValue &candidate : candidates) {
+            if (same(value, candidate))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+bool satisfies(const QList<QJsonValue> &values, const QJsonValue &condition) {
+    if (!is_operator_object(condition))
+        return contains_any(values, QJsonArray{condition});
+
+    QJsonObject operators = condition.toObject();
+    for (auto it = operators.begin(); it != operators.end(); ++it) {
+        const QString &op = it.key();
+
+        bool satisfied;
+        if (op == "$in")
+            satisfied = contains_any(values, it.value().toArray());
+        else if (op == "$nin")
+            satisfied = !contains_any(values, it.value().toArray());
+        else if (op == "$ne")
+            satisfied = !contains_any(values, QJsonArray{it.value()});
+        else if (op == "$exists")
+            satisfied = values.isEmpty() != it.value().toBool();
+        else if (op == "$gt" || op == "$gte" || op == "$lt" || op == "$lte")
+            satisfied = compare(values, it.value(), op);
+        else if (op == "$not")
+            satisfied = !satisfies(values, it.value());
+        else {
+            logger::warning("memory_unsupported_operator", {{"operator", op}});
+            satisfied = false;
+        }
+
+        if (!satisfied)
+            return false;
+    }
+
+    return true;
+}
+
+// The empty key stands for the value itself, as in {"$in": [...]} pulls
+bool matches(const QJsonValue &document, const QJsonObject &filter_object) {
+    for (auto it = filter_object.begin(); it != filter_object.end(); ++it) {
+        QList<QJsonValue> values;
+        collect(document, it.key(), values);
+
+        if (!satisfies(values, it.value()))
+            return false;
+    }
+
+    return true;
+}
+
+// Conditions on the elements of the array at prefix, re-rooted at the element
+QJsonObject element_conditions(const QJsonObject &conditions, const QString &prefix) {
+    QJsonObject relative;
+    for (auto it = conditions.begin(); it != conditions.end(); ++it) {
+        if (it.key() == prefix)
+            relative.insert(QString(), it.value());
+        else if (it.key().startsWith(prefix + '.'))
+            relative.insert(it.key().mid(prefix.size() + 1), it.value());
+    }
+
+    return relative;
+}
+
+struct update_step {
+    QString op;
+    QJsonValue operand;
+    const QJsonObject &filter_object;
+    const QJsonArray &array_filters;
+};
+
+bool pulled(const QJsonValue &element, const QJsonValue &condition) {
+    if (is_operator_object(condition))
+        return matches(element, QJsonObject{{QString(), condition}});
+
+    if (condition.isObject() && element.isObject())
+        return matches(element, condition.toObject());
+
+    return same(element, condition);
+}
+
+QJsonValue operate(const QJsonValue &value, const update_step &step) {
+    const QString &op = step.op;
+
+    if (op == "$set")
+        return step.operand;
+    if (op == "$unset")
+        return QJsonValue(QJsonValue::Undefined);
+    if (op == "$setOnInsert")
+        return value;
+
+    if (op == "$inc") {
+        if (!value.isDouble())
+            return step.operand;
+
+        double sum = value.toDouble() + step.operand.toDouble();
+        return sum == std::floor(sum) && std::abs(sum) < 9e15 ? QJsonValue(static_cast<qint64>(sum)) : QJsonValue(sum);
+    }
+
+    if (op == "$push" || op == "$addToSet") {
+        QJsonArray array = value.toArray();
+
+        bool each = step.operand.isObject() && step.operand.toObject().contains("$each");
+        for (const QJsonValue &element : each ? step.operand.toObject()["$each"].toArray() : QJsonArray{step.operand}) {
+            if (op == "$addToSet" && contains_any({element}, array))
+                continue;
+
+            array.append(element);
+        }
+
+        return array;
+    }
+
+    if (op == "$pull") {
+        if (!value.isArray())
+            return value;
+
+        QJsonArray kept;
+        for (const QJsonValue &element : value.toArray()) {
+            if (!pulled(element, step.operand))
+                kept.append(element);
+        }
+
+        return kept;
+    }
+
+    if (op == "$pop") {
+        QJsonArray array = value.toArray();
+        if (!array.isEmpty())
+            step.operand.toInt() < 0 ? array.removeFirst() : array.removeLast();
+
+        return value.isArray() ? QJsonValue(array) : value;
+    }
+
+    logger::warning("memory_unsupported_operator", {{"operator", op}});
+
+    return value;
+}
+
+// Applies one step at the dotted path below node; prefix is the path walked
+// so far, for matching $ against the filter and $[name] against array_filters
+QJsonValue apply(const QJsonValue &node, const QStringList &segments, qsizetype depth, const QString &prefix, const update_step &step) {
+    if (depth == segments.size())
+        return operate(node, step);
+
+    const QString &segment = segments[depth];
+    QString walked = prefix.isEmpty() ? segment : prefix + '.' + segment;
+
+    if (node.isArray()) {
+        QJsonArray array = node.toArray();
+
+        QJsonObject conditions;
+        if (segment == "$") {
+            conditions = element_conditions(step.filter_object, prefix);
+        } else if (segment.startsWith("$[") && segment != "$[]") {
+            QString name = segment.mid(2, segment.size() - 3);
+
+            for (const QJsonValue &array_filter : step.array_filters) {
+                QJsonObject relative = element_conditions(array_filter.toObject(), name);
+                for (auto it = relative.begin(); it != relative.end(); ++it)
+                    conditions.insert(it.key(), it.value());
+            }
+        }
+
+        bool numeric = false;
+        qsizetype position = segment.toLongLong(&numeric);
+
+        for (qsizetype index = 0; index < array.size(); index++) {
+            if (numeric ? index != position : !segment.startsWith('$') || !matches(array[index], conditions))
+                continue;
+
+            QJsonValue updated = apply(array[index], segments, depth + 1, walked, step);
+            if (updated.isUndefined())
+                array[index] = QJsonValue::Null;
+            else
+                array[index] = updated;
+
+            // $ is the first match only
+            if (numeric || segment == "$")
+                break;
+        }
+
+        return array;
+    }
+
+    if (!node.isObject() && !node.isUndefined())
+        return node;
+
+    QJsonObject object = node.toObject();
+    QJsonValue updated = apply(object.value(segment), segments, depth + 1, walked, step);
+
+    if (updated.isUndefined())
+        object.remove(segment);
+    else
+        object.insert(segment, updated);
+
+    return node.isUndefined() && object.isEmpty() ? QJsonValue(QJsonValue::Undefined) : QJsonValue(object);
+}
+
+bool apply_update(QJsonObject &document, const QJsonObject &update_object, const QJsonObject &filter_object, const QJsonArray &array_filters, bool inserting) {
+    for (auto op = update_object.begin(); op != update_object.end(); ++op) {
+        if (!op.key().startsWith('$')) {
+            logger::warning("memory_replacement_update", {{"field", op.key()}});
+            return false;
+        }
+
+        QJsonObject paths = op.value().toObject();
+        for (auto path = paths.begin(); path != paths.end(); ++path) {
+            update_step step{inserting && op.key() == "$setOnInsert" ? QString("$set") : op.key(), path.value(), filter_object, array_filters};
+
+            document = apply(document, path.key().split('.'), 0, QString(), step).toObject();
+        }
+    }
+
+    return true;
+}
+
+// The projection as a tree: true keeps a subtree whole, an object keeps only
+// its listed children, and {"$slice": n} keeps part of an array
+QJsonValue project(const QJsonValue &value, const QJsonObject &tree) {
+    if (value.isArray()) {
+        QJsonArray projected;
+        for (const QJsonValue &element : value.toArray()) {
+            if (element.isObject())
+                projected.append(project(element, tree));
+        }
+
+        return projected;
+    }
+
+    QJsonObject source = value.toObject();
+    QJsonObject projected;
+    for (auto it = tree.begin(); it != tree.end(); ++it) {
+        auto field = source.constFind(it.key());
+        if (field == source.constEnd())
+            continue;
+
+        projected.insert(it.key(), it.value().isObject() ? project(*field, it.value().toObject()) : *field);
+    }
+
+    return projected;
+}
+
+QJsonArray slice(const QJsonArray &array, int count) {
+    qsizetype keep = std::min<qsizetype>(std::abs(count), array.size());
+
+    QJsonArray sliced;
+    for (qsizetype index = count < 0 ? array.size() - keep : 0, end = index + keep; index < end; index++)
+        sliced.append(array[index]);
+
+    return sliced;
+}
+
+QJsonObject apply_projection(const QJsonObject &document, const QJsonObject &fields) {
+    if (fields.isEmpty())
+        return document;
+
+    bool inclusion = false;
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+        if (it.key() != "_id" && !it.value().isObject() && truthy(it.value()))
+            inclusion = true;
+    }
+
+    QJsonObject projected;
+    if (inclusion) {
+        QJsonObject tree;
+        if (!fields.contains("_id") || truthy(fields["_id"]))
+            tree.insert("_id", true);
+
+        for (auto it = fields.begin(); it != fields.end(); ++it) {
+            if (it.value().isObject() || !truthy(it.value()))
+                continue;
+
+            // Nest "a.b.c" as {"a": {"b": {"c": true}}}, merging shared prefixes
+            QStringList segments = it.key().split('.');
+            std::function<QJsonObject(QJsonObject, qsizetype)> nest = [&](QJsonObject level, qsizetype depth) {
+                if (depth == segments.size() - 1) {
+                    level.insert(segments[depth], true);
+                    return level;
+                }
+
+                QJsonValue child = level.value(segments[depth]);
+                if (child.isBool())
+                    return level;
+
+                level.insert(segments[depth], nest(child.toObject(), depth + 1));
+                return level;
+            };
+
+            tree = nest(tree, 0);
+        }
+
+        projected = project(document, tree).toObject();
+    } else {
+        projected = document;
+
+        for (auto it = fields.begin(); it != fields.end(); ++it) {
+            if (!it.value().isObject())
+                projected.remove(it.key());
+        }
+    }
+
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+        if (it.value().isObject() && it.value().toObject().contains("$slice") && document.contains(it.key()))
+            projected.insert(it.key(), slice(document[it.key()].toArray(), it.value().toObject()["$slice"].toInt()));
+    }
+
+    return projected;
+}
+
+QJsonDocument as_result(const QJsonArray &documents) {
+    if (documents.isEmpty())
+        return QJsonDocument();
+
+    return documents.size() == 1 ? QJsonDocument(documents.first().toObject()) : QJsonDocument(documents);
+}
+
+}
+
+class MemorySnapshot : public Snapshot {
+  public:
+    MemorySnapshot(MemoryRepository &repository, const int &account_id)
+        : _repository(repository) {
+        std::shared_lock lock(_repository._mutex);
+
+        if (const QJsonObject *account = _repository.table("accounts").find(account_id)) {
+            _contacts = (*account)["contacts"].toArray();
+            _groups = (*account)["groups"].toArray();
+        }
+    }
+
+    // Reads each chat or group as it is asked for, like the Mongo cursors
+    Kind next(QJsonObject &item) override {
+        std::shared_lock lock(_repository._mutex);
+
+        for (; _index < _contacts.size(); _index++) {
+            const QJsonObject contact = _contacts[_index].toObject();
+
+            const QJsonObject *info = _repository.table("accounts").find(contact["contactID"].toInteger());
+            const QJsonObject *chat = _repository.table("chats").find(contact["chatID"].toInteger());
+            if (!info || !chat)
+                continue;
+
+            QJsonObject contact_info{{"_id", (*info)["_id"]},
+                                     {"first_name", (*info)["first_name"]},
+                                     {"last_name", (*info)["last_name"]},
+                                     {"image_url", (*info)["image_url"]},
+                                     {"status", false}};
+
+            item = QJsonObject{{"contactInfo", contact_info},
+                               {"chatID", contact["chatID"]},
+                               {"unread_messages", contact["unread_messages"]},
+                               {"chatMessages", (*chat)["messages"]}};
+
+            _index++;
+            return Contact;
+        }
+
+        for (; _index - _contacts.size() < _groups.size(); _index++) {
+            const QJsonObject membership = _groups[_index - _contacts.size()].toObject();
+
+            const QJsonObject *group = _repository.table("groups").find(membership["groupID"].toInteger());
+            if (!group)
+                continue;
+
+            item = QJsonObject{{"_id", (*group)["_id"]},
+                               {"group_name", (*group)["group_name"]},
+                               {"group_unread_messages", membership["group_unread_messages"]},
+                               {"group_image_url", (*group)["group_image_url"]},
+                               {"group_admin", (*group)["group_admin"]},
+                               {"group_members", (*group)["group_members"]},
+                               {"group_messages", (*group)["group_messages"]}};
+
+            _index++;
+            return Group;
+        }
+
+        return End;
+    }
+
+  private:
+    MemoryRepository &_repository;
+
+    QJsonArray _contacts{};
+    QJsonArray _groups{};
+    qsizetype _index{0};
+};
+
+DocumentTable &MemoryRepository::collection(const std::string &collection_name) {
+    return _collections[collection_name];
+}
+
+const DocumentTable &MemoryRepository::table(const std::string &collection_name) const {
+    static const DocumentTable empty{};
+
+    auto it = _collections.find(collection_name);
+    return it == _collections.end() ? empty : it->second;
+}
+
+QList<qint64> MemoryRepository::matching(const DocumentTable &table, const QJsonObject &filter_object, bool first_only) {
+    QList<qint64> ids;
+
+    // _id equality and $in go straight to their slots
+    QJsonValue id = filter_object.value("_id");
+    if (!id.isUndefined() && (!is_operator_object(id) || (id.toObject().size() == 1 && id.toObject().contains("$in")))) {
+        for (const QJsonValue &candidate : id.isObject() ? id.toObject()["$in"].toArray() : QJsonArray{id}) {
+            const QJsonObject *document = table.find(candidate.toInteger());
+
+            if (document && !ids.contains(candidate.toInteger()) && matches(*document, filter_object)) {
+                ids.append(candidate.toInteger());
+
+                if (first_only)
+                    break;
+            }
+        }
+
+        return ids;
+    }
+
+    table.for_each([&](qint64 document_id, const QJsonObject &document) {
+        if (matches(document, filter_object))
+            ids.append(document_id);
+
+        return !(first_only && !ids.isEmpty());
+    });
+
+    return ids;
+}
+
+bool MemoryRepository::insert(DocumentTable &table, QJsonObject document) {
+    if (!document.contains("_id"))
+        document.insert("_id", _next_id++);
+
+    return table.insert(document["_id"].toInteger(), document);
+}
+
+bool MemoryRepository::update(DocumentTable &table, const QJsonObject &filter_object, const QJsonObject &update_object, const QJsonArray &array_filters, bool many, bool upsert) {
+    QList<qint64> ids = matching(table, filter_object, !many);
+
+    for (qint64 id : ids) {
+        QJsonObject *document = table.find(id);
+        QJsonObject updated = *document;
+
+        if (!apply_update(updated, update_object, filter_object, array_filters, false))
+            return false;
+
+        // The _id is the slot key and stays put
+        updated.insert("_id", (*document)["_id"]);
+        *document = updated;
+    }
+
+    if (!ids.isEmpty() || !upsert)
+        return true;
+
+    // Seed the new document with the filter's plain equalities
+    QJsonObject document;
+    for (auto it = filter_object.begin(); it != filter_object.end(); ++it) {
+        if (!it.key().contains('.') && !it.key().startsWith('$') && !is_operator_object(it.value()))
+            document.insert(it.key(), it.value());
+    }
+
+    return apply_update(document, update_object, filter_object, array_filters, true) && insert(table, document);
+}
+
+bool MemoryRepository::remove(DocumentTable &table, const QJsonObject &filter_object, bool many) {
+    for (qint64 id : matching(table, filter_object, !many))
+        table.erase(id);
+
+    return true;
+}
+
+bool MemoryRepository::write(DocumentTable &table, const QJsonObject &operation) {
+    if (operation.size() != 1)
+        return false;
+
+    QString name = operation.begin().key();
+    QJsonObject arguments = operation.begin().value().toObject();
+
+    if (name == "insert_one")
+        return insert(table, arguments["document"].toObject());
+    if (name == "update_one" || name == "update_many")
+        return update(table, arguments["filter"].toObject(), arguments["update"].toObject(), arguments["array_filters"].toArray(), name == "update_many", arguments["upsert"].toBool());
+    if (name == "delete_one" || name == "delete_many")
+        return remove(table, arguments["filter"].toObject(), name == "delete_many");
+
+    logger::warning("bulk_write_unknown_operation", {{"operation", name}});
+
+    return false;
+}
+
+bool MemoryRepository::insert_document(const std::string &collection_name, const QJsonObject &json_object) {
+    std::unique_lock lock(_mutex);
+
+    return insert(collection(collection_name), json_object);
+}
+
+bool MemoryRepository::delete_document(const std::string &collection_name, const QJsonObject &filter_object) {
+    std::unique_lock lock(_mutex);
+
+    return remove(collection(collection_name), filter_object, false);
+}
+
+bool MemoryRepository::update_document(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object) {
+    std::unique_lock lock(_mutex);
+
+    return update(collection(collection_name), filter_object, update_object, QJsonArray(), false, false);
+}
+
+bool MemoryRepository::update_many(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object, const QJsonArray &array_filters) {
+    std::unique_lock lock(_mutex);
+
+    return update(collection(collection_name), filter_object, update_object, array_filters, true, false);
+}
+
+bool MemoryRepository::bulk_write(const std::string &collection_name, const QJsonArray &operations, bool ordered) {
+    std::unique_lock lock(_mutex);
+    DocumentTable &table = collection(collection_name);
+
+    bool written = true;
+    for (const QJsonValue &operation : operations) {
+        if (!write(table, operation.toObject())) {
+            written = false;
+
+            if (ordered)
+                break;
+        }
+    }
+
+    return written;
+}
+
+QJsonDocument MemoryRepository::find_document(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &fields) {
+    std::shared_lock lock(_mutex);
+    const DocumentTable &documents_table = table(collection_name);
+
+    QJsonArray documents;
+    for (qint64 id : matching(documents_table, filter_object, false))
+        documents.append(apply_projection(*documents_table.find(id), fields));
+
+    return as_result(documents);
+}
+
+bool MemoryRepository::scan_ids(const std::string &collection_name, int batch_size, const std::function<bool(const QList<int> &ids)> &visit) {
+    // Batches are copied out under the lock and visited without it
+    QList<QList<int>> batches;
+    {
+        std::shared_lock lock(_mutex);
+
+        QList<int> ids;
+        table(collection_name).for_each([&](qint64 id, const QJsonObject &) {
+            ids.append(static_cast<int>(id));
+            if (ids.size() == batch_size)
+                batches.append(std::exchange(ids, {}));
+
+            return true;
+        });
+
+        if (!ids.isEmpty())
+            batches.append(ids);
+    }
+
+    for (const QList<int> &batch : std::as_const(batches)) {
+        if (!visit(batch))
+            break;
+    }
+
+    return true;
+}
+
+QJsonDocument MemoryRepository::fetch_contacts_and_chats(const int &account_id) {
+    std::shared_lock lock(_mutex);
+
+    const QJsonObject *account = table("accounts").find(account_id);
+    if (!account)
+        return QJsonDocument();
+
+    // Same shape as the aggregation: contacts whose account and non-empty chat exist
+    QJsonArray contacts;
+    for (const QJsonValue &value : (*account)["contacts"].toArray()) {
+        const QJsonObject contact = value.toObject();
+
+        const QJsonObject *info = table("accounts").find(contact["contactID"].toInteger());
+        const QJsonObject *chat = table("chats").find(contact["chatID"].toInteger());
+        if (!info || !chat || (*chat)["messages"].toArray().isEmpty())
+            continue;
+
+        contacts.append(QJsonObject{{"contactInfo", QJsonObject{{"_id", (*info)["_id"]},
+                                                                {"first_name", (*info)["first_name"]},
+                                                                {"last_name", (*info)["last_name"]},
+                                                                {"status", (*info)["status"]},
+                                                                {"image_url", (*info)["image_url"]}}},
+                                    {"chatID", contact["chatID"]},
+                                    {"unread_messages", contact["unread_messages"]},
+                                    {"chatMessages", (*chat)["messages"]}});
+    }
+
+    return contacts.isEmpty() ? QJsonDocument() : QJsonDocument(contacts);
+}
+
+QJsonDocument MemoryRepository::fetch_groups_and_chats(const int &account_id) {
+    std::shared_lock lock(_mutex);
+
+    const QJsonObject *account = table("accounts").find(account_id);
+    if (!account)
+        return QJsonDocument();
+
+    QJsonArray groups;
+    for (const QJsonValue &value : (*account)["groups"].toArray()) {
+        const QJsonObject membership = value.toObject();
+
+        const QJsonObject *group = table("groups").find(membership["groupID"].toInteger());
+        if (!group)
+            continue;
+
+        groups.append(QJsonObject{{"_id", (*group)["_id"]},
+                                  {"group_name", (*group)["group_name"]},
+                                  {"group_unread_messages", membership["group_unread_messages"]},
+                                  {"group_image_url", (*group)["group_image_url"]},
+                                  {"group_admin", (*group)["group_admin"]},
+                                  {"group_members", (*group)["group_members"]},
+                                  {"group_messages", (*group)["group_messages"]}});
+    }
+
+    return groups.isEmpty() ? QJsonDocument() : QJsonDocument(groups);
+}
+
+QJsonArray MemoryRepository::fetch_contactIDs(const int &account_id) {
+    std::shared_lock lock(_mutex);
+
+    const QJsonObject *account = table("accounts").find(account_id);
+    if (!account)
+        return QJsonArray();
+
+    QJsonArray contact_ids_array;
+    for (const QJsonValue &contact : (*account)["contacts"].toArray()) {
+        int contact_id = contact.toObject()["contactID"].toInt();
+
+        if (!contact_ids_array.contains(contact_id))
+            contact_ids_array.append(contact_id);
+    }
+
+    return contact_ids_array;
+}
+
+std::unique_ptr<Snapshot> MemoryRepository::snapshot(const int &account_id) {
+    return std::make_unique<MemorySnapshot>(*this, account_id);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "repository.hpp"
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+// Documents of one collection keyed by their integer _id. Open addressing
+// over a single slot array with linear probing, load kept under 3/4 and
+// backward-shift erase (no tombstones), so a lookup touches one or two
+// cache lines and a scan walks memory in order.
+class DocumentTable {
+  public:
+    QJsonObject *find(qint64 id);
+    const QJsonObject *find(qint64 id) const;
+
+    // False if the _id is taken
+    bool insert(qint64 id, const QJsonObject &document);
+    bool erase(qint64 id);
+
+    qsizetype size() const { return _size; }
+
+    // Visit returns false to stop; the table must not change meanwhile
+    template <typename Visit>
+    void for_each(Visit visit) const {
+        for (const Slot &slot : _slots) {
+            if (slot.used && !visit(slot.id, slot.document))
+                return;
+        }
+    }
+
+  private:
+    struct Slot {
+        qint64 id{0};
+        bool used{false};
+        QJsonObject document{};
+    };
+
+    std::vector<Slot> _slots{};
+    qsizetype _size{0};
+
+    size_t home_of(qint64 id) const;
+    void grow();
+};
+
+// Keeps every collection in process, for profiling the server without a
+// database round trip and for small single-node deployments. Understands the
+// query and update subset the server sends: equality, $in, $nin, $ne,
+// $exists, $not and comparisons in filters; $set, $setOnInsert, $unset, $inc,
+// $push, $addToSet ($each), $pull and $pop, with $, $[] and $[name] paths;
+// inclusion, exclusion and $slice projections. There is no inbox to keep in
+// step, since a snapshot reads the source maps directly. Nothing survives a
+// restart, and nodes on a cluster bus do not share it.
+class MemoryRepository : public Repository {
+  public:
+    bool insert_document(const std::string &collection_name, const QJsonObject &json_object) override;
+    bool delete_document(const std::string &collection_name, const QJsonObject &filter_object) override;
+    bool update_document(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object) override;
+    bool update_many(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object, const QJsonArray &array_filters = QJsonArray()) override;
+    bool bulk_write(const std::string &collection_name, const QJsonArray &operations, bool ordered = true) override;
+    QJsonDocument find_document(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &fields = QJsonObject()) override;
+    bool scan_ids(const std::string &collection_name, int batch_size, const std::function<bool(const QList<int> &ids)> &visit) override;
+
+    // Every call takes _mutex, so workers can share this one
+    Repository &worker() override { return *this; }
+
+    QJsonDocument fetch_contacts_and_chats(const int &account_id) override;
+    QJsonDocument fetch_groups_and_chats(const int &account_id) override;
+    QJsonArray fetch_contactIDs(const int &account_id) override;
+
+    // Writes apply as they are made
+    void begin_batch() override {}
+    bool commit_batch() override { return true; }
+
+    bool check_inbox(const int &) override { return true; }
+    bool delete_inbox(const int &) override { return true; }
+    bool add_contact(const int &, const QJsonObject &, const int &, const QJsonObject &) override { return true; }
+    bool add_group(const QJsonArray &, const QJsonObject &) override { return true; }
+    bool remove_group(const QJsonArray &, const int &) override { return true; }
+    bool update_contact(const int &, const QJsonObject &) override { return true; }
+    bool update_group(const int &, const QJsonObject &) override { return true; }
+    bool set_last_message(const int &, const QJsonObject &) override { return true; }
+    bool set_group_last_message(const int &, const QJsonObject &) override { return true; }
+    bool refresh_last_message(const int &) override { return true; }
+    bool refresh_group_last_message(const int &) override { return true; }
+
+    std::unique_ptr<Snapshot> snapshot(const int &account_id) override;
+
+  private:
+    friend class MemorySnapshot;
+
+    mutable std::shared_mutex _mutex{};
+    std::unordered_map<std::string, DocumentTable> _collections{};
+    qint64 _next_id{1};
+
+    // Writers create collections on first use, readers see an empty one
+    DocumentTable &collection(const std::string &collection_name);
+    const DocumentTable &table(const std::string &collection_name) const;
+
+    // Callers hold _mutex
+    QList<qint64> matching(const DocumentTable &table, const QJsonObject &filter_object, bool first_only);
+    bool insert(DocumentTable &table, QJsonObject document);
+    bool update(DocumentTable &table, const QJsonObject &filter_object, const QJsonObject &update_object, const QJsonArray &array_filters, bool many, bool upsert);
+    bool remove(DocumentTable &table, const QJsonObject &filter_object, bool many);
+    bool write(DocumentTable &table, const QJsonObject &operation);
+};
@@ -0,0 +1,166 @@
+#include "metrics.hpp"
+#include <bit>
+
+namespace metrics {
+
+void histogram::record(qint64 nanoseconds) {
+    quint64 value = nanoseconds > 0 ? static_cast<quint64>(nanoseconds) : 0;
+
+    _buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+quint64 histogram::count() const {
+    return _count.load(std::memory_order_relaxed);
+}
+
+double histogram::sum_seconds() const {
+    return static_cast<double>(_sum.load(std::memory_order_relaxed)) / 1e9;
+}
+
+qint64 histogram::quantile(double q) const {
+    quint64 total = 0;
+    std::array<quint64, BucketCount> snapshot;
+    for (int index = 0; index < BucketCount; index++) {
+        snapshot[index] = bucket(index);
+        total += snapshot[index];
+    }
+
+    if (!total)
+        return 0;
+
+    quint64 rank = static_cast<quint64>(q * static_cast<double>(total - 1)) + 1;
+    quint64 seen = 0;
+    for (int index = 0; index < BucketCount; index++) {
+        seen += snapshot[index];
+        if (seen >= rank)
+            return static_cast<qint64>(upper_bound(index));
+    }
+
+    return static_cast<qint64>(upper_bound(BucketCount - 1));
+}
+
+int histogram::bucket_of(quint64 nanoseconds) {
+    if (nanoseconds < SubBuckets)
+        return static_cast<int>(nanoseconds);
+
+    int exponent = 63 - std::countl_zero(nanoseconds);
+    if (exponent > MaxExponent)
+        return BucketCount - 1;
+
+    int sub_bucket = static_cast<int>((nanoseconds >> (exponent - 3)) & (SubBuckets - 1));
+
+    return (exponent - 2) * SubBuckets + sub_bucket;
+}
+
+quint64 histogram::upper_bound(int bucket) {
+    if (bucket < SubBuckets)
+        return static_cast<quint64>(bucket) + 1;
+
+    int exponent = bucket / SubBuckets + 2;
+    int sub_bucket = bucket % SubBuckets;
+
+    return static_cast<quint64>(SubBuckets + sub_bucket + 1) << (exponent - 3);
+}
+
+registry &registry::instance() {
+    static registry metrics_registry;
+    return metrics_registry;
+}
+
+counter &registry::counter_of(const QString &name, const QString &help, const QString &labels) {
+    return *static_cast<counter *>(find(name, help, labels, Counter, [this]() -> void * { return &_counters.emplace_back(); }));
+}
+
+gauge &registry::gauge_of(const QString &name, const QString &help, const QString &labels) {
+    return *static_cast<gauge *>(find(name, help, labels, Gauge, [this]() -> void * { return &_gauges.emplace_back(); }));
+}
+
+histogram &registry::histogram_of(const QString &name, const QString &help, const QString &labels) {
+    return *static_cast<histogram *>(find(name, help, labels, Histogram, [this]() -> void * { return &_histograms.emplace_back(); }));
+}
+
+void registry::callback(const QString &name, const QString &help, const QString &labels, std::function<double()> read, bool monotonic) {
+    find(name, help, labels, monotonic ? MonotonicCallback : Callback, [this, &read]() -> void * { return &_callbacks.emplace_back(std::move(read)); });
+}
+
+void *registry::find(const QString &name, const QString &help, const QString &labels, Type type, const std::function<void *()> &create) {
+    std::lock_guard lock(_mutex);
+
+    auto family = _families.find(name);
+    if (family == _families.end())
+        family = _families.emplace(name, Family{help, type}).first;
+
+    auto series = family->second.series.find(labels);
+    if (series != family->second.series.end())
+        return series->second;
+
+    return family->second.series.emplace(labels, create()).first->second;
+}
+
+QByteArray registry::expose() const {
+    // Bounds of the exported buckets; the fine buckets fold into these
+    static constexpr std::array<double, 17> bounds{0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+                                                  0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+
+    auto series_name = [](const QString &name, const QString &labels, const QString &extra = QString()) {
+        QStringList parts;
+        if (!labels.isEmpty())
+            parts.append(labels);
+        if (!extra.isEmpty())
+            parts.append(extra);
+
+        return parts.isEmpty() ? name : name + '{' + parts.join(',') + '}';
+    };
+
+    std::lock_guard lock(_mutex);
+
+    QString text;
+    for (const auto &[name, family] : _families) {
+        static constexpr std::array<const char *, 5> types{"counter", "gauge", "histogram", "gauge", "counter"};
+
+        text += "# HELP " + name + ' ' + family.help + '\n';
+        text += "# TYPE " + name + ' ' + types[family.type] + '\n';
+
+        for (const auto &[labels, instrument] : family.series) {
+            switch (family.type) {
+            case Counter:
+                text += series_name(name, labels) + ' ' + QString::number(static_cast<counter *>(instrument)->value()) + '\n';
+                break;
+            case Gauge:
+                text += series_name(name, labels) + ' ' + QString::number(static_cast<gauge *>(instrument)->value()) + '\n';
+                break;
+            case Callback:
+            case MonotonicCallback:
+                text += series_name(name, labels) + ' ' + QString::number((*static_cast<std::function<double()> *>(instrument))(), 'g', 12) + '\n';
+                break;
+            case Histogram: {
+                const histogram *values = static_cast<histogram *>(instrument);
+
+                quint64 cumulative = 0;
+                int bucket = 0;
+                for (double bound : bounds) {
+                    quint64 bound_ns = static_cast<quint64>(bound * 1e9);
+                    for (; bucket < histogram::BucketCount && histogram::upper_bound(bucket) <= bound_ns; bucket++)
+                        cumulative += values->bucket(bucket);
+
+                    text += series_name(name + "_bucket", labels, QString("le=\"%1\"").arg(bound)) + ' ' + QString::number(cumulative) + '\n';
+                }
+
+                for (; bucket < histogram::BucketCount; bucket++)
+                    cumulative += values->bucket(bucket);
+
+                text += series_name(name + "_bucket", labels, "le=\"+Inf\"") + ' ' + QString::number(cumulative) + '\n';
+                text += series_name(name + "_sum", labels) + ' ' + QString::number(values->sum_seconds(), 'g', 12) + '\n';
+                text += series_name(name + "_count", labels) + ' ' + QString::number(cumulative) + '\n';
+                break;
+            }
+            }
+        }
+    }
+
+    return text.toUtf8();
+}
+
+}
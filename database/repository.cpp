@@ -0,0 +1,175 @@
+#include "repository.hpp"
+#include "logger.hpp"
+#include "memory_repository.hpp"
+
+std::unique_ptr<Repository> Repository::create() {
+    const char *storage = std::getenv("CHAT_APP_STORAGE");
+
+    if (storage && std::string_view(storage) == "memory") {
+        logger::info("storage_selected", {{"backend", "memory"}});
+        return std::make_unique<MemoryRepository>();
+    }
+
+    if (storage && std::string_view(storage) != "mongo")
+        logger::warning("unknown_storage", {{"backend", storage}});
+
+    const char *uri = std::getenv("MONGODB_URI");
+    logger::info("storage_selected", {{"backend", "mongo"}});
+
+    return std::make_unique<MongoRepository>(uri ? uri : "mongodb://localhost:27017", "chatAppDB");
+}
+
+namespace {
+
+mongocxx::client connect(const std::string &uri) {
+    static mongocxx::instance instance{};
+
+    return mongocxx::client{mongocxx::uri{uri}};
+}
+
+}
+
+MongoRepository::MongoRepository(const std::string &uri, const std::string &database_name)
+    : _uri(uri), _database_name(database_name), _connection(connect(uri)), _db(_connection.database(database_name)) {}
+
+bool MongoRepository::insert_document(const std::string &collection_name, const QJsonObject &json_object) {
+    return Account::insert_document(_db, collection_name, json_object);
+}
+
+bool MongoRepository::delete_document(const std::string &collection_name, const QJsonObject &filter_object) {
+    return Account::delete_document(_db, collection_name, filter_object);
+}
+
+bool MongoRepository::update_document(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object) {
+    return Account::update_document(_db, collection_name, filter_object, update_object);
+}
+
+bool MongoRepository::update_many(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object, const QJsonArray &array_filters) {
+    return Account::update_many(_db, collection_name, filter_object, update_object, array_filters);
+}
+
+bool MongoRepository::bulk_write(const std::string &collection_name, const QJsonArray &operations, bool ordered) {
+    return Account::bulk_write(_db, collection_name, operations, ordered);
+}
+
+QJsonDocument MongoRepository::find_document(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &fields) {
+    return Account::find_document(_db, collection_name, filter_object, fields);
+}
+
+QJsonDocument MongoRepository::fetch_contacts_and_chats(const int &account_id) {
+    return Account::fetch_contacts_and_chats(_db, account_id);
+}
+
+QJsonDocument MongoRepository::fetch_groups_and_chats(const int &account_id) {
+    return Account::fetch_groups_and_chats(_db, account_id);
+}
+
+QJsonArray MongoRepository::fetch_contactIDs(const int &account_id) {
+    return Account::fetch_contactIDs(_db, account_id);
+}
+
+void MongoRepository::begin_batch() {
+    Account::begin_batch();
+}
+
+bool MongoRepository::commit_batch() {
+    return Account::commit_batch(_db);
+}
+
+bool MongoRepository::check_inbox(const int &account_id) {
+    return Inbox::check_inbox(_db, account_id);
+}
+
+bool MongoRepository::delete_inbox(const int &account_id) {
+    return Inbox::delete_inbox(_db, account_id);
+}
+
+bool MongoRepository::add_contact(const int &account_id, const QJsonObject &contact_info, const int &chat_id, const QJsonObject &last_message) {
+    return Inbox::add_contact(_db, account_id, contact_info, chat_id, last_message);
+}
+
+bool MongoRepository::add_group(const QJsonArray &member_ids, const QJsonObject &group) {
+    return Inbox::add_group(_db, member_ids, group);
+}
+
+bool MongoRepository::remove_group(const QJsonArray &member_ids, const int &group_id) {
+    return Inbox::remove_group(_db, member_ids, group_id);
+}
+
+bool MongoRepository::update_contact(const int &contact_id, const QJsonObject &fields) {
+    return Inbox::update_contact(_db, contact_id, fields);
+}
+
+bool MongoRepository::update_group(const int &group_id, const QJsonObject &fields) {
+    return Inbox::update_group(_db, group_id, fields);
+}
+
+bool MongoRepository::set_last_message(const int &chat_id, const QJsonObject &last_message) {
+    return Inbox::set_last_message(_db, chat_id, last_message);
+}
+
+bool MongoRepository::set_group_last_message(const int &group_id, const QJsonObject &last_message) {
+    return Inbox::set_group_last_message(_db, group_id, last_message);
+}
+
+bool MongoRepository::refresh_last_message(const int &chat_id) {
+    return Inbox::refresh_last_message(_db, chat_id);
+}
+
+bool MongoRepository::refresh_group_last_message(const int &group_id) {
+    return Inbox::refresh_group_last_message(_db, group_id);
+}
+
+Repository &MongoRepository::worker() {
+    if (!_worker)
+        _worker = std::make_unique<MongoRepository>(_uri, _database_name);
+
+    return *_worker;
+}
+
+bool MongoRepository::scan_ids(const std::string &collection_name, int batch_size, const std::function<bool(const QList<int> &ids)> &visit) {
+    try {
+        mongocxx::client client = connect(_uri);
+        mongocxx::collection collection = client.database(_database_name).collection(collection_name);
+
+        bsoncxx::document::value projection = bsoncxx::from_json(R"({"_id": 1})");
+
+        mongocxx::options::find find_options;
+        find_options.projection(projection.view());
+        find_options.batch_size(batch_size);
+
+        QList<int> ids;
+        ids.reserve(batch_size);
+
+        for (const bsoncxx::document::view &doc : collection.find(bsoncxx::document::view{}, find_options)) {
+            bsoncxx::document::element id = doc["_id"];
+            if (id.type() == bsoncxx::type::k_int32)
+                ids.append(id.get_int32());
+            else if (id.type() == bsoncxx::type::k_int64)
+                ids.append(static_cast<int>(id.get_int64()));
+            else
+                continue;
+
+            if (ids.size() < batch_size)
+                continue;
+
+            if (!visit(ids))
+                return true;
+
+            ids.clear();
+        }
+
+        if (!ids.isEmpty())
+            visit(ids);
+
+        return true;
+    } catch (const mongocxx::exception &e) {
+        logger::error("mongodb_exception", {{"in", __func__}, {"error", e.what()}});
+
+        return false;
+    }
+}
+
+std::unique_ptr<Snapshot> MongoRepository::snapshot(const int &account_id) {
+    return std::make_unique<MongoSnapshot>(_db, account_id);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "database.hpp"
+#include <functional>
+#include <memory>
+
+// Everything the server persists, behind one interface so handlers do not
+// care where it lives. Filters, updates and projections use the MongoDB
+// shell syntax whichever backend is in use. The Inbox calls keep the
+// materialized login view in step; backends without one ignore them.
+class Repository {
+  public:
+    virtual ~Repository() = default;
+
+    // CHAT_APP_STORAGE picks the backend: "mongo" (the default, at
+    // MONGODB_URI) or "memory" for a single node with nothing to connect to
+    static std::unique_ptr<Repository> create();
+
+    virtual bool insert_document(const std::string &collection_name, const QJsonObject &json_object) = 0;
+    virtual bool delete_document(const std::string &collection_name, const QJsonObject &filter_object) = 0;
+    virtual bool update_document(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object) = 0;
+    virtual bool update_many(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object, const QJsonArray &array_filters = QJsonArray()) = 0;
+    virtual bool bulk_write(const std::string &collection_name, const QJsonArray &operations, bool ordered = true) = 0;
+    virtual QJsonDocument find_document(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &fields = QJsonObject()) = 0;
+
+    // Hands every integer _id of the collection to visit, batch_size at a
+    // time, until visit returns false. Safe to call from a worker thread
+    // while the event loop keeps using the repository. False if the scan
+    // broke off on an error.
+    virtual bool scan_ids(const std::string &collection_name, int batch_size, const std::function<bool(const QList<int> &ids)> &visit) = 0;
+
+    // The same data for one worker thread at a time to use while the event
+    // loop keeps using this repository. Lives as long as this one; take it
+    // on the event loop.
+    virtual Repository &worker() = 0;
+
+    virtual QJsonDocument fetch_contacts_and_chats(const int &account_id) = 0;
+    virtual QJsonDocument fetch_groups_and_chats(const int &account_id) = 0;
+    virtual QJsonArray fetch_contactIDs(const int &account_id) = 0;
+
+    // See Account::begin_batch
+    virtual void begin_batch() = 0;
+    virtual bool commit_batch() = 0;
+
+    virtual bool check_inbox(const int &account_id) = 0;
+    virtual bool delete_inbox(const int &account_id) = 0;
+    virtual bool add_contact(const int &account_id, const QJsonObject &contact_info, const int &chat_id, const QJsonObject &last_message) = 0;
+    virtual bool add_group(const QJsonArray &member_ids, const QJsonObject &group) = 0;
+    virtual bool remove_group(const QJsonArray &member_ids, const int &group_id) = 0;
+    virtual bool update_contact(const int &contact_id, const QJsonObject &fields) = 0;
+    virtual bool update_group(const int &group_id, const QJsonObject &fields) = 0;
+    virtual bool set_last_message(const int &chat_id, const QJsonObject &last_message) = 0;
+    virtual bool set_group_last_message(const int &group_id, const QJsonObject &last_message) = 0;
+    virtual bool refresh_last_message(const int &chat_id) = 0;
+    virtual bool refresh_group_last_message(const int &group_id) = 0;
+
+    virtual std::unique_ptr<Snapshot> snapshot(const int &account_id) = 0;
+};
+
+// Forwards to Account, Inbox and MongoSnapshot on one database
+class MongoRepository : public Repository {
+  public:
+    MongoRepository(const std::string &uri, const std::string &database_name);
+
+    bool insert_document(const std::string &collection_name, const QJsonObject &json_object) override;
+    bool delete_document(const std::string &collection_name, const QJsonObject &filter_object) override;
+    bool update_document(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object) override;
+    bool update_many(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &update_object, const QJsonArray &array_filters = QJsonArray()) override;
+    bool bulk_write(const std::string &collection_name, const QJsonArray &operations, bool ordered = true) override;
+    QJsonDocument find_document(const std::string &collection_name, const QJsonObject &filter_object, const QJsonObject &fields = QJsonObject()) override;
+
+    // On a client of its own, since one client is not safe across threads
+    bool scan_ids(const std::string &collection_name, int batch_size, const std::function<bool(const QList<int> &ids)> &visit) override;
+
+    // Likewise a second repository with its own client, opened on first use
+    Repository &worker() override;
+
+    QJsonDocument fetch_contacts_and_chats(const int &account_id) override;
+    QJsonDocument fetch_groups_and_chats(const int &account_id) override;
+    QJsonArray fetch_contactIDs(const int &account_id) override;
+
+    void begin_batch() override;
+    bool commit_batch() override;
+
+    bool check_inbox(const int &account_id) override;
+    bool delete_inbox(const int &account_id) override;
+    bool add_contact(const int &account_id, const QJsonObject &contact_info, const int &chat_id, const QJsonObject &last_message) override;
+    bool add_group(const QJsonArray &member_ids, const QJsonObject &group) override;
+    bool remove_group(const QJsonArray &member_ids, const int &group_id) override;
+    bool update_contact(const int &contact_id, const QJsonObject &fields) override;
+    bool update_group(const int &group_id, const QJsonObject &fields) override;
+    bool set_last_message(const int &chat_id, const QJsonObject &last_message) override;
+    bool set_group_last_message(const int &group_id, const QJsonObject &last_message) override;
+    bool refresh_last_message(const int &chat_id) override;
+    bool refresh_group_last_message(const int &group_id) override;
+
+    std::unique_ptr<Snapshot> snapshot(const int &account_id) override;
+
+  private:
+    std::string _uri;
+    std::string _database_name;
+    mongocxx::client _connection;
+    mongocxx::database _db;
+
+    std::unique_ptr<MongoRepository> _worker{};
+};
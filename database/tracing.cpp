@@ -0,0 +1,202 @@
+#include "tracing.hpp"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QString>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace tracing {
+
+namespace {
+
+struct Span {
+    quint64 trace_id;
+    quint64 span_id;
+    quint64 parent_id;
+    const char *name;
+    qint64 start;
+    qint64 end;
+    quint32 thread;
+};
+
+class ring {
+  public:
+    ring() {
+        qsizetype capacity = std::getenv("CHAT_APP_TRACE_CAPACITY") ? std::atoll(std::getenv("CHAT_APP_TRACE_CAPACITY")) : 65536;
+        _spans.resize(static_cast<size_t>(std::max<qsizetype>(1, capacity)));
+
+        if (const char *value = std::getenv("CHAT_APP_TRACE_SAMPLE_RATE"))
+            _sample_rate.store(std::atof(value), std::memory_order_relaxed);
+
+        // Span times are steady-clock; OTLP wants wall-clock nanoseconds
+        _wall_offset = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - now();
+    }
+
+    // Only sampled spans get here, so a plain mutex is cheap enough
+    void push(const Span &finished) {
+        std::lock_guard lock(_mutex);
+
+        _spans[_next % _spans.size()] = finished;
+        _next++;
+    }
+
+    std::vector<Span> snapshot() const {
+        std::lock_guard lock(_mutex);
+
+        std::vector<Span> spans;
+        size_t count = std::min(_next, _spans.size());
+        spans.reserve(count);
+
+        for (size_t index = _next - count; index < _next; index++)
+            spans.push_back(_spans[index % _spans.size()]);
+
+        return spans;
+    }
+
+    std::atomic<double> _sample_rate{0.0};
+    qint64 _wall_offset{0};
+
+  private:
+    mutable std::mutex _mutex{};
+    std::vector<Span> _spans{};
+    size_t _next{0};
+};
+
+ring &instance() {
+    static ring spans;
+    return spans;
+}
+
+thread_local context current_context{};
+
+quint32 thread_number() {
+    static std::atomic<quint32> next{1};
+    thread_local quint32 number = next.fetch_add(1, std::memory_order_relaxed);
+
+    return number;
+}
+
+quint64 new_id() {
+    quint64 id = 0;
+    while (!id)
+        id = QRandomGenerator::global()->generate64();
+
+    return id;
+}
+
+QString hex(quint64 value, int width) {
+    return QString::number(value, 16).rightJustified(width, '0');
+}
+
+}
+
+context start_trace() {
+    double rate = instance()._sample_rate.load(std::memory_order_relaxed);
+    if (rate <= 0.0 || (rate < 1.0 && QRandomGenerator::global()->generateDouble() >= rate))
+        return context{};
+
+    return context{new_id(), 0};
+}
+
+context current() {
+    return current_context;
+}
+
+scope::scope(const context &installed)
+    : _previous(current_context) {
+    current_context = installed;
+}
+
+scope::~scope() {
+    current_context = _previous;
+}
+
+span::span(const char *name)
+    : _name(name), _parent(current_context) {
+    if (!_parent)
+        return;
+
+    _self = context{_parent.trace_id, new_id()};
+    _start = now();
+
+    current_context = _self;
+}
+
+span::~span() {
+    if (!_parent)
+        return;
+
+    current_context = _parent;
+    instance().push(Span{_self.trace_id, _self.span_id, _parent.span_id, _name, _start, now(), thread_number()});
+}
+
+qint64 now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void record(const char *name, const context &parent, qint64 start, qint64 end) {
+    if (!parent)
+        return;
+
+    instance().push(Span{parent.trace_id, new_id(), parent.span_id, name, start, end, thread_number()});
+}
+
+void set_sample_rate(double rate) {
+    instance()._sample_rate.store(std::clamp(rate, 0.0, 1.0), std::memory_order_relaxed);
+}
+
+double sample_rate() {
+    return instance()._sample_rate.load(std::memory_order_relaxed);
+}
+
+QByteArray chrome_trace() {
+    QJsonArray events;
+    for (const Span &finished : instance().snapshot()) {
+        QJsonObject arguments{{"trace_id", hex(finished.trace_id, 16)},
+                              {"span_id", hex(finished.span_id, 16)},
+                              {"parent_id", hex(finished.parent_id, 16)}};
+
+        events.append(QJsonObject{{"name", finished.name},
+                                  {"cat", "chat_app"},
+                                  {"ph", "X"},
+                                  {"ts", static_cast<double>(finished.start) / 1000.0},
+                                  {"dur", static_cast<double>(finished.end - finished.start) / 1000.0},
+                                  {"pid", 1},
+                                  {"tid", static_cast<qint64>(finished.thread)},
+                                  {"args", arguments}});
+    }
+
+    return QJsonDocument(QJsonObject{{"traceEvents", events}, {"displayTimeUnit", "ms"}}).toJson(QJsonDocument::Compact);
+}
+
+QByteArray otlp_trace() {
+    qint64 wall_offset = instance()._wall_offset;
+
+    QJsonArray spans;
+    for (const Span &finished : instance().snapshot()) {
+        QJsonObject otlp_span{{"traceId", hex(0, 16) + hex(finished.trace_id, 16)},
+                              {"spanId", hex(finished.span_id, 16)},
+                              {"name", finished.name},
+                              {"kind", 1},
+                              {"startTimeUnixNano", QString::number(finished.start + wall_offset)},
+                              {"endTimeUnixNano", QString::number(finished.end + wall_offset)},
+                              {"attributes", QJsonArray{QJsonObject{{"key", "thread.id"}, {"value", QJsonObject{{"intValue", QString::number(finished.thread)}}}}}}};
+
+        if (finished.parent_id)
+            otlp_span["parentSpanId"] = hex(finished.parent_id, 16);
+
+        spans.append(otlp_span);
+    }
+
+    QJsonObject resource{{"attributes", QJsonArray{QJsonObject{{"key", "service.name"}, {"value", QJsonObject{{"stringValue", "chat_app_server"}}}}}}};
+    QJsonObject scope_spans{{"scope", QJsonObject{{"name", "chat_app"}}}, {"spans", spans}};
+
+    return QJsonDocument(QJsonObject{{"resourceSpans", QJsonArray{QJsonObject{{"resource", resource}, {"scopeSpans", QJsonArray{scope_spans}}}}}}).toJson(QJsonDocument::Compact);
+}
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QByteArray>
+#include <QtGlobal>
+
+// Span tracing for sampled frames. A trace is started per frame, carried on
+// the thread that handles it (and across task_scheduler hops with scope),
+// and every span opened under it lands in a bounded ring that overwrites the
+// oldest spans. Unsampled work only pays for a thread-local check. The ring
+// is exported on demand as Chrome trace JSON (chrome://tracing, Perfetto)
+// or OTLP/JSON.
+namespace tracing {
+
+struct context {
+    quint64 trace_id{0};
+    quint64 span_id{0};
+
+    explicit operator bool() const { return trace_id != 0; }
+};
+
+// Starts a trace with probability sample_rate(), an empty context otherwise
+context start_trace();
+
+context current();
+
+// Makes a context current on this thread until destroyed
+class scope {
+  public:
+    explicit scope(const context &installed);
+    ~scope();
+
+    scope(const scope &) = delete;
+    scope &operator=(const scope &) = delete;
+
+  private:
+    context _previous;
+};
+
+// Times a child of the current context and is itself current while it lives.
+// The name must outlive the ring, in practice a string literal.
+class span {
+  public:
+    explicit span(const char *name);
+    ~span();
+
+    span(const span &) = delete;
+    span &operator=(const span &) = delete;
+
+  private:
+    const char *_name;
+    context _parent;
+    context _self;
+    qint64 _start{0};
+};
+
+qint64 now();
+
+// Records a span whose bounds were taken elsewhere, e.g. time spent queued
+void record(const char *name, const context &parent, qint64 start, qint64 end);
+
+// Initially CHAT_APP_TRACE_SAMPLE_RATE, 0 when unset
+void set_sample_rate(double rate);
+double sample_rate();
+
+QByteArray chrome_trace();
+QByteArray otlp_trace();
+
+}
@@ -0,0 +1,239 @@
+#include "deletion_jobs.hpp"
+#include "logger.hpp"
+#include "task_scheduler.hpp"
+#include <QUrl>
+#include <algorithm>
+
+namespace {
+
+QJsonArray first(const QJsonArray &array, int count) {
+    QJsonArray head;
+    for (int i = 0; i < array.size() && i < count; i++)
+        head.append(array[i]);
+
+    return head;
+}
+
+QJsonArray documents_of(const QJsonDocument &json_doc) {
+    if (json_doc.isArray())
+        return json_doc.array();
+
+    return json_doc.isObject() ? QJsonArray{json_doc.object()} : QJsonArray();
+}
+
+}
+
+deletion_jobs::deletion_jobs(Repository &db, std::shared_ptr<Aws::S3::S3Client> s3_client, QObject *parent)
+    : QObject(parent), _db(db), _worker(db.worker()), _s3_client(std::move(s3_client)) {
+    if (const char *value = std::getenv("CHAT_APP_DELETION_BATCH"))
+        _batch_size = std::max(1, std::atoi(value));
+
+    for (const QJsonValue &job : documents_of(_db.find_document("deletion_jobs", QJsonObject{}, QJsonObject{{"_id", 1}})))
+        _queue.push_back(job.toObject()["_id"].toInt());
+
+    if (!_queue.empty())
+        logger::info("deletion_jobs_resumed", {{"jobs", static_cast<qint64>(_queue.size())}});
+
+    connect(&_tick_timer, &QTimer::timeout, this, &deletion_jobs::on_tick);
+    _tick_timer.start(std::getenv("CHAT_APP_DELETION_INTERVAL_MS") ? std::atoi(std::getenv("CHAT_APP_DELETION_INTERVAL_MS")) : 250);
+}
+
+bool deletion_jobs::enqueue(const int &account_ID) {
+    QJsonDocument account_doc = _db.find_document("accounts", QJsonObject{{"_id", account_ID}},
+                                                  QJsonObject{{"groups.groupID", 1}, {"contacts.chatID", 1}, {"image_url", 1}});
+    if (account_doc.isEmpty())
+        return false;
+
+    QJsonArray group_IDs;
+    for (const QJsonValue &group : account_doc.object()["groups"].toArray())
+        group_IDs.append(group.toObject()["groupID"]);
+
+    QJsonArray chat_IDs;
+    for (const QJsonValue &contact : account_doc.object()["contacts"].toArray())
+        chat_IDs.append(contact.toObject()["chatID"]);
+
+    QJsonArray keys;
+    QString image_key = media_key(account_ID, account_doc.object()["image_url"].toString());
+    if (!image_key.isEmpty())
+        keys.append(image_key);
+
+    // Merges into a job left over from an earlier account with the same number
+    QJsonObject update_object{{"$addToSet", QJsonObject{{"groups", QJsonObject{{"$each", group_IDs}}},
+                                                        {"chats", QJsonObject{{"$each", chat_IDs}}},
+                                                        {"media", QJsonObject{{"$each", keys}}}}},
+                              {"$setOnInsert", QJsonObject{{"created", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)}}}};
+
+    QJsonArray operations{QJsonObject{{"update_one", QJsonObject{{"filter", QJsonObject{{"_id", account_ID}}}, {"update", update_object}, {"upsert", true}}}}};
+    if (!_db.bulk_write("deletion_jobs", operations))
+        return false;
+
+    _db.delete_document("accounts", QJsonObject{{"_id", account_ID}});
+    _db.delete_inbox(account_ID);
+
+    // A job being finished right now may be gone before this merge lands, so
+    // it is queued again; an entry with no job left is just dropped
+    bool in_flight = _busy && _queue.front() == account_ID;
+    if (std::count(_queue.begin(), _queue.end(), account_ID) == (in_flight ? 1 : 0))
+        _queue.push_back(account_ID);
+
+    return true;
+}
+
+qsizetype deletion_jobs::pending() const {
+    return static_cast<qsizetype>(_queue.size());
+}
+
+void deletion_jobs::on_tick() {
+    if (_busy || _queue.empty())
+        return;
+
+    // Foreground traffic first
+    task_scheduler &scheduler = task_scheduler::instance();
+    if (scheduler.pending(task_scheduler::Control) || scheduler.pending(task_scheduler::Text))
+        return;
+
+    int account_ID = _queue.front();
+    _busy = true;
+
+    scheduler.run(
+        task_scheduler::Bulk, this,
+        [&worker = _worker, s3_client = _s3_client, account_ID, batch_size = _batch_size]() {
+            return step(worker, s3_client, account_ID, batch_size);
+        },
+        [this, account_ID](Step done) {
+            _busy = false;
+
+            if (done == Batched)
+                return;
+
+            // enqueue only appends, so the job is still at the front
+            _queue.pop_front();
+
+            if (done == Finished)
+                logger::info("deletion_finished", {{"id", account_ID}});
+        });
+}
+
+deletion_jobs::Step deletion_jobs::step(Repository &db, const std::shared_ptr<Aws::S3::S3Client> &s3_client, const int &account_ID, int batch_size) {
+    QJsonObject job = db.find_document("deletion_jobs", QJsonObject{{"_id", account_ID}}).object();
+    if (job.isEmpty())
+        return Missing;
+
+    if (!job["groups"].toArray().isEmpty())
+        remove_groups(db, account_ID, first(job["groups"].toArray(), batch_size));
+    else if (!job["chats"].toArray().isEmpty())
+        remove_chats(db, account_ID, first(job["chats"].toArray(), batch_size));
+    else if (!job["media"].toArray().isEmpty())
+        remove_media(db, s3_client, account_ID, first(job["media"].toArray(), batch_size));
+    else
+        return finish(db, job) ? Finished : Batched;
+
+    return Batched;
+}
+
+void deletion_jobs::remove_groups(Repository &db, const int &account_ID, const QJsonArray &group_IDs) {
+    QJsonArray operations;
+    for (const QJsonValue &group_ID : group_IDs) {
+        operations.append(QJsonObject{{"update_one", QJsonObject{{"filter", QJsonObject{{"_id", group_ID}}},
+                                                                 {"update", QJsonObject{{"$pull", QJsonObject{{"group_members", account_ID}}}}}}}});
+    }
+
+    if (!db.bulk_write("groups", operations, false))
+        return;
+
+    db.update_document("deletion_jobs", QJsonObject{{"_id", account_ID}},
+                       QJsonObject{{"$pull", QJsonObject{{"groups", QJsonObject{{"$in", group_IDs}}}}}});
+}
+
+void deletion_jobs::remove_chats(Repository &db, const int &account_ID, const QJsonArray &chat_IDs) {
+    // The account's own uploads go with the chat, so note them before it is
+    // gone; the other side's stay with the account that still owns them
+    QJsonArray keys;
+    QJsonDocument chats_doc = db.find_document("chats", QJsonObject{{"_id", QJsonObject{{"$in", chat_IDs}}}},
+                                               QJsonObject{{"messages.file_url", 1}, {"messages.audio_url", 1}});
+    for (const QJsonValue &chat : documents_of(chats_doc)) {
+        for (const QJsonValue &message : chat.toObject()["messages"].toArray()) {
+            for (const char *field : {"file_url", "audio_url"}) {
+                QString key = media_key(account_ID, message.toObject()[field].toString());
+                if (!key.isEmpty())
+                    keys.append(key);
+            }
+        }
+    }
+
+    if (!keys.isEmpty()) {
+        db.update_document("deletion_jobs", QJsonObject{{"_id", account_ID}},
+                           QJsonObject{{"$addToSet", QJsonObject{{"media", QJsonObject{{"$each", keys}}}}}});
+    }
+
+    QJsonArray operations;
+    for (const QJsonValue &chat_ID : chat_IDs) {
+        operations.append(QJsonObject{{"update_many", QJsonObject{{"filter", QJsonObject{{"contacts.chatID", chat_ID}}},
+                                                                  {"update", QJsonObject{{"$pull", QJsonObject{{"contacts", QJsonObject{{"chatID", chat_ID}}}}}}}}}});
+    }
+
+    if (!db.bulk_write("accounts", operations, false) || !db.bulk_write("inboxes", operations, false))
+        return;
+
+    QJsonArray delete_operations{QJsonObject{{"delete_many", QJsonObject{{"filter", QJsonObject{{"_id", QJsonObject{{"$in", chat_IDs}}}}}}}}};
+    if (!db.bulk_write("chats", delete_operations))
+        return;
+
+    db.update_document("deletion_jobs", QJsonObject{{"_id", account_ID}},
+                       QJsonObject{{"$pull", QJsonObject{{"chats", QJsonObject{{"$in", chat_IDs}}}}}});
+}
+
+void deletion_jobs::remove_media(Repository &db, const std::shared_ptr<Aws::S3::S3Client> &s3_client, const int &account_ID, const QJsonArray &keys) {
+    int failed = 0;
+    for (const QJsonValue &key : keys) {
+        if (!s3_client || !S3::delete_data_from_s3(*s3_client, key.toString().toStdString()))
+            failed++;
+    }
+
+    // A key that failed once is not retried forever; it is logged and dropped
+    if (failed)
+        logger::warning("deletion_media_failed", {{"id", account_ID}, {"objects", failed}});
+
+    db.update_document("deletion_jobs", QJsonObject{{"_id", account_ID}},
+                       QJsonObject{{"$pull", QJsonObject{{"media", QJsonObject{{"$in", keys}}}}}});
+}
+
+bool deletion_jobs::finish(Repository &db, const QJsonObject &job) {
+    int account_ID = job["_id"].toInt();
+    QString job_created = job["created"].toString();
+
+    // The server may have stopped between recording the job and removing the
+    // account. Only an account created before the job is that one; a newer one
+    // is the number registered again and must be left alone.
+    QJsonObject stale_account{{"_id", account_ID}, {"created", QJsonObject{{"$lt", job_created}}}};
+    if (!job_created.isEmpty() && !db.find_document("accounts", stale_account, QJsonObject{{"_id", 1}}).isEmpty()) {
+        db.delete_document("accounts", stale_account);
+        db.delete_inbox(account_ID);
+    }
+
+    // enqueue may have merged more work in since the job was read; it stays
+    // for the next tick then
+    QJsonObject empty_job{{"_id", account_ID}};
+    for (const char *field : {"groups", "chats", "media"})
+        empty_job.insert(field, job.contains(field) ? QJsonValue(QJsonArray()) : QJsonValue(QJsonObject{{"$exists", false}}));
+
+    return db.delete_document("deletion_jobs", empty_job);
+}
+
+QString deletion_jobs::media_key(const int &account_ID, const QString &url) {
+    if (url.isEmpty())
+        return QString();
+
+    QString key = QUrl(url).path(QUrl::FullyDecoded);
+    if (key.startsWith('/'))
+        key.remove(0, 1);
+
+    // Path-style presigned URLs carry the bucket as the first segment
+    QString bucket = std::getenv("CHAT_APP_BUCKET_NAME") ? QString(std::getenv("CHAT_APP_BUCKET_NAME")) : QString();
+    if (!bucket.isEmpty() && key.startsWith(bucket + '/'))
+        key.remove(0, bucket.size() + 1);
+
+    // Keys are client-chosen file names under the uploader's prefix; anything
+    // else (the shared default images, other accounts' uploads) is not ours
+    return S3::owned_by(account_ID, key) ? key : QString();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "repository.hpp"
+#include <QTimer>
+#include <deque>
+
+// Deletes accounts in the background. A job document in deletion_jobs holds
+// the groups, chats and S3 media still to clean up; each tick takes one batch
+// of CHAT_APP_DELETION_BATCH items off it with a bulk write and pulls them
+// from the job, so a restarted server resumes where it stopped. Ticks run
+// every CHAT_APP_DELETION_INTERVAL_MS, one at a time on the Bulk lane with the
+// repository's worker, and are skipped while foreground lanes have work
+// waiting.
+class deletion_jobs : public QObject {
+    Q_OBJECT
+
+  public:
+    deletion_jobs(Repository &db, std::shared_ptr<Aws::S3::S3Client> s3_client, QObject *parent = nullptr);
+
+    // Records the job and removes the account document so the number can no
+    // longer log in; everything else is left to the background ticks
+    bool enqueue(const int &account_ID);
+
+    qsizetype pending() const;
+
+  private slots:
+    void on_tick();
+
+  private:
+    // What a tick did with the job at the front of the queue
+    enum Step {
+        Batched,
+        Finished,
+        Missing
+    };
+
+    Repository &_db;
+    Repository &_worker;
+    std::shared_ptr<Aws::S3::S3Client> _s3_client{};
+
+    std::deque<int> _queue{};
+    bool _busy{false};
+
+    QTimer _tick_timer{};
+    int _batch_size{50};
+
+    // Run on a Bulk worker against _worker
+    static Step step(Repository &db, const std::shared_ptr<Aws::S3::S3Client> &s3_client, const int &account_ID, int batch_size);
+    static void remove_groups(Repository &db, const int &account_ID, const QJsonArray &group_IDs);
+    static void remove_chats(Repository &db, const int &account_ID, const QJsonArray &chat_IDs);
+    static void remove_media(Repository &db, const std::shared_ptr<Aws::S3::S3Client> &s3_client, const int &account_ID, const QJsonArray &keys);
+
+    // False if the job picked up more work meanwhile and was left in place
+    static bool finish(Repository &db, const QJsonObject &job);
+
+    // Empty unless the URL names an object uploaded by the account
+    static QString media_key(const int &account_ID, const QString &url);
+};
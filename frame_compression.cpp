@@ -0,0 +1,116 @@
+#include "frame_compression.hpp"
+#include "logger.hpp"
+#include <QFile>
+#include <QUrlQuery>
+#include <QWebSocket>
+#include <algorithm>
+
+frame_compression::frame_compression(int level, const QByteArray &dictionary, qsizetype threshold, qsizetype max_inflated)
+    : _level(std::clamp(level, 0, 9)), _threshold(threshold), _max_inflated(max_inflated), _dictionary(dictionary) {
+    deflateInit(&_deflate, std::max(1, _level));
+    inflateInit(&_inflate);
+}
+
+frame_compression::~frame_compression() {
+    deflateEnd(&_deflate);
+    inflateEnd(&_inflate);
+}
+
+frame_compression &frame_compression::instance() {
+    static frame_compression compression = [] {
+        const char *level = std::getenv("CHAT_APP_COMPRESSION_LEVEL");
+        const char *threshold = std::getenv("CHAT_APP_COMPRESSION_MIN_BYTES");
+        const char *max_inflated = std::getenv("CHAT_APP_COMPRESSION_MAX_INFLATED");
+
+        QByteArray dictionary;
+        if (const char *path = std::getenv("CHAT_APP_COMPRESSION_DICTIONARY")) {
+            QFile file(QString::fromLocal8Bit(path));
+            if (file.open(QIODevice::ReadOnly))
+                dictionary = file.readAll();
+            else
+                logger::error("compression_dictionary_unavailable", {{"path", file.fileName()}, {"error", file.errorString()}});
+        }
+
+        // Built in place: zlib streams point back at their owner and cannot move
+        return frame_compression(level ? std::atoi(level) : 6, dictionary, threshold ? std::max<qsizetype>(0, std::atoll(threshold)) : 1024,
+                                 max_inflated ? std::max<qsizetype>(4096, std::atoll(max_inflated)) : 8 * 1024 * 1024);
+    }();
+
+    return compression;
+}
+
+bool frame_compression::requested(const QWebSocket *socket) {
+    return QUrlQuery(socket->requestUrl()).queryItemValue("compression") == "deflate";
+}
+
+bool frame_compression::compressed(QByteArrayView frame) {
+    // A zlib header opens with 0x78 for the default window, which no JSON text can
+    return !frame.isEmpty() && static_cast<unsigned char>(frame[0]) == 0x78;
+}
+
+QByteArray frame_compression::compress(QByteArrayView frame) {
+    deflateReset(&_deflate);
+    if (!_dictionary.isEmpty())
+        deflateSetDictionary(&_deflate, reinterpret_cast<const Bytef *>(_dictionary.constData()), static_cast<uInt>(_dictionary.size()));
+
+    QByteArray output(static_cast<qsizetype>(deflateBound(&_deflate, static_cast<uLong>(frame.size()))), Qt::Uninitialized);
+
+    _deflate.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(frame.data()));
+    _deflate.avail_in = static_cast<uInt>(frame.size());
+    _deflate.next_out = reinterpret_cast<Bytef *>(output.data());
+    _deflate.avail_out = static_cast<uInt>(output.size());
+
+    if (deflate(&_deflate, Z_FINISH) != Z_STREAM_END || static_cast<qsizetype>(_deflate.total_out) >= frame.size())
+        return QByteArray();
+
+    output.truncate(static_cast<qsizetype>(_deflate.total_out));
+
+    _metrics.frames++;
+    _metrics.input_bytes += frame.size();
+    _metrics.output_bytes += output.size();
+
+    return output;
+}
+
+QByteArray frame_compression::decompress(QByteArrayView data, qsizetype max_size) {
+    inflateReset(&_inflate);
+
+    _inflate.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    _inflate.avail_in = static_cast<uInt>(data.size());
+
+    QByteArray output(std::min(max_size, std::max<qsizetype>(4096, data.size() * 4)), Qt::Uninitialized);
+
+    for (;;) {
+        _inflate.next_out = reinterpret_cast<Bytef *>(output.data() + _inflate.total_out);
+        _inflate.avail_out = static_cast<uInt>(output.size() - static_cast<qsizetype>(_inflate.total_out));
+
+        int result = inflate(&_inflate, Z_NO_FLUSH);
+
+        if (result == Z_NEED_DICT) {
+            if (_dictionary.isEmpty() || inflateSetDictionary(&_inflate, reinterpret_cast<const Bytef *>(_dictionary.constData()), static_cast<uInt>(_dictionary.size())) != Z_OK)
+                return QByteArray();
+
+            continue;
+        }
+
+        if (result == Z_STREAM_END)
+            break;
+
+        if (result != Z_OK && result != Z_BUF_ERROR)
+            return QByteArray();
+
+        // Out of input before the end of the stream
+        if (_inflate.avail_in == 0 && _inflate.avail_out != 0)
+            return QByteArray();
+
+        if (output.size() >= max_size)
+            return QByteArray();
+
+        output.resize(std::min(max_size, output.size() * 2));
+    }
+
+    output.truncate(static_cast<qsizetype>(_inflate.total_out));
+    _metrics.inflated_frames++;
+
+    return output;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <zlib.h>
+
+class QWebSocket;
+
+// Application-level stand-in for permessage-deflate, which QtWebSockets does
+// not implement. A client opts in by connecting with ?compression=deflate;
+// from then on frames of at least CHAT_APP_COMPRESSION_MIN_BYTES (default
+// 1024) go out as binary frames holding a zlib stream, smaller ones stay
+// text, and binary frames from the client that start with a zlib header are
+// inflated before parsing. Every frame is compressed on its own, so no
+// per-connection window is kept; CHAT_APP_COMPRESSION_DICTIONARY names a
+// preset dictionary file that wins back most of what the shared window would
+// have found, and its Adler-32 in the zlib header tells clients which one is
+// in use. CHAT_APP_COMPRESSION_LEVEL (default 6, 0 turns it off) trades CPU
+// for bytes; benchmarks/compression_benchmark measures both. A client frame
+// stops inflating at CHAT_APP_COMPRESSION_MAX_INFLATED (default 8 MiB), so a
+// small bomb cannot make the server allocate up to the frame size limit.
+class frame_compression {
+  public:
+    struct Metrics {
+        qint64 frames{0};
+        qint64 input_bytes{0};
+        qint64 output_bytes{0};
+        qint64 inflated_frames{0};
+    };
+
+    frame_compression(int level, const QByteArray &dictionary = QByteArray(), qsizetype threshold = 1024, qsizetype max_inflated = 8 * 1024 * 1024);
+    ~frame_compression();
+
+    frame_compression(const frame_compression &) = delete;
+    frame_compression &operator=(const frame_compression &) = delete;
+
+    // Configured from the environment, for the event loop thread
+    static frame_compression &instance();
+
+    static bool requested(const QWebSocket *socket);
+    static bool compressed(QByteArrayView frame);
+
+    bool enabled() const { return _level > 0; }
+    qsizetype threshold() const { return _threshold; }
+    qsizetype max_inflated() const { return _max_inflated; }
+
+    // Null when the stream would not be smaller than the frame
+    QByteArray compress(QByteArrayView frame);
+
+    // Null on a corrupt stream, a dictionary mismatch or output past max_size
+    QByteArray decompress(QByteArrayView data, qsizetype max_size);
+
+    Metrics metrics() const { return _metrics; }
+
+  private:
+    int _level;
+    qsizetype _threshold;
+    qsizetype _max_inflated;
+    QByteArray _dictionary{};
+
+    z_stream _deflate{};
+    z_stream _inflate{};
+
+    Metrics _metrics{};
+};
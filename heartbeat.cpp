@@ -0,0 +1,104 @@
+#include "heartbeat.hpp"
+#include "logger.hpp"
+#include <QWebSocket>
+
+namespace {
+constexpr qint64 tick_ms = 500;
+constexpr int slot_count = 256;
+}
+
+heartbeat::heartbeat(QObject *parent)
+    : QObject(parent), _wheel(tick_ms, slot_count) {
+    if (const char *value = std::getenv("CHAT_APP_PING_INTERVAL_MS"))
+        _interval = std::atoll(value);
+
+    if (const char *value = std::getenv("CHAT_APP_PONG_TIMEOUT_MS"))
+        _timeout = std::atoll(value);
+
+    _clock.start();
+
+    _ticker.setInterval(tick_ms);
+    connect(&_ticker, &QTimer::timeout, this, &heartbeat::on_tick);
+}
+
+void heartbeat::watch(QWebSocket *socket) {
+    if (_interval <= 0 || _keys.contains(socket))
+        return;
+
+    // The wheel stops turning while idle, catch it up before scheduling
+    if (_wheel.isEmpty()) {
+        _wheel.advance(_clock.elapsed());
+        _ticker.start();
+    }
+
+    const quint64 key = _next_key++;
+    _keys.insert(socket, key);
+    _states.insert(key, State{socket, false});
+    _wheel.schedule(key, _interval);
+
+    connect(socket, &QWebSocket::pong, this, [this, socket]() { alive(socket); });
+}
+
+void heartbeat::unwatch(QWebSocket *socket) {
+    auto it = _keys.find(socket);
+    if (it == _keys.end())
+        return;
+
+    _wheel.cancel(*it);
+    _states.remove(*it);
+    _keys.erase(it);
+
+    disconnect(socket, &QWebSocket::pong, this, nullptr);
+}
+
+void heartbeat::alive(QWebSocket *socket) {
+    // Only a pending ping needs its timer moved; a connection that is merely
+    // chatty keeps its scheduled ping, which costs one frame per interval
+    auto key = _keys.constFind(socket);
+    if (key == _keys.constEnd())
+        return;
+
+    State &state = _states[*key];
+    if (!state.awaiting_pong)
+        return;
+
+    state.awaiting_pong = false;
+    _wheel.schedule(*key, _interval);
+}
+
+qsizetype heartbeat::watched() const {
+    return _states.size();
+}
+
+heartbeat::Metrics heartbeat::metrics() const {
+    return _metrics;
+}
+
+void heartbeat::on_tick() {
+    for (quint64 key : _wheel.advance(_clock.elapsed())) {
+        auto it = _states.find(key);
+        if (it == _states.end())
+            continue;
+
+        State &state = *it;
+
+        if (!state.awaiting_pong) {
+            state.awaiting_pong = true;
+            _wheel.schedule(key, _timeout);
+
+            state.socket->ping();
+            _metrics.pings++;
+
+            continue;
+        }
+
+        // abort() emits disconnected, which unwatches the socket
+        _metrics.timeouts++;
+        logger::info("heartbeat_timeout", {{"id", state.socket->property("id").toInt()}});
+
+        state.socket->abort();
+    }
+
+    if (_wheel.isEmpty())
+        _ticker.stop();
+}
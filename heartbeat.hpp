@@ -0,0 +1,56 @@
+#pragma once
+
+#include "timer_wheel.hpp"
+#include <QElapsedTimer>
+#include <QTimer>
+
+class QWebSocket;
+
+// Pings every connection once per interval and aborts the ones that do not
+// answer within the timeout, so half-open connections leave through the
+// normal disconnected path instead of lingering until the kernel notices.
+// Any inbound frame counts as an answer. All connections share one timer
+// wheel driven by a single ticker. CHAT_APP_PING_INTERVAL_MS (default 30000)
+// and CHAT_APP_PONG_TIMEOUT_MS (default 10000) set the timings; an interval
+// of 0 turns heartbeats off.
+class heartbeat : public QObject {
+    Q_OBJECT
+
+  public:
+    struct Metrics {
+        qint64 pings{0};
+        qint64 timeouts{0};
+    };
+
+    heartbeat(QObject *parent = nullptr);
+
+    void watch(QWebSocket *socket);
+    void unwatch(QWebSocket *socket);
+
+    // The socket has shown it is alive
+    void alive(QWebSocket *socket);
+
+    qsizetype watched() const;
+    Metrics metrics() const;
+
+  private slots:
+    void on_tick();
+
+  private:
+    struct State {
+        QWebSocket *socket;
+        bool awaiting_pong;
+    };
+
+    qint64 _interval{30000};
+    qint64 _timeout{10000};
+
+    QElapsedTimer _clock{};
+    QTimer _ticker{};
+    timer_wheel _wheel;
+    QHash<quint64, State> _states{};
+    QHash<const QWebSocket *, quint64> _keys{};
+    quint64 _next_key{1};
+
+    Metrics _metrics{};
+};
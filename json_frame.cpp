@@ -0,0 +1,358 @@
+#include "json_frame.hpp"
+#include <cstring>
+
+namespace {
+int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+bool read_hex4(const char *it, const char *end, char32_t &out) {
+    if (end - it < 4)
+        return false;
+
+    out = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hex_digit(it[i]);
+        if (digit < 0)
+            return false;
+
+        out = (out << 4) | static_cast<char32_t>(digit);
+    }
+
+    return true;
+}
+
+char *write_utf8(char *out, char32_t code_point) {
+    if (code_point < 0x80) {
+        *out++ = static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (code_point >> 6));
+        *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (code_point >> 12));
+        *out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (code_point >> 18));
+        *out++ = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+
+    return out;
+}
+}
+
+bool json_frame::parse(QByteArray bytes) {
+    _bytes = std::move(bytes);
+    _count = 0;
+
+    const char *begin = _bytes.constData();
+    const char *end = begin + _bytes.size();
+
+    const char *it = skip_whitespace(begin, end);
+    if (it == end || *it != '{')
+        return false;
+
+    it = skip_whitespace(it + 1, end);
+    if (it != end && *it == '}')
+        return skip_whitespace(it + 1, end) == end;
+
+    bool any_escaped = false;
+    while (true) {
+        if (it == end || *it != '"' || _count == MaxFields)
+            return false;
+
+        bool key_escaped = false;
+        const char *key_end = scan_string(it + 1, end, key_escaped);
+        if (!key_end)
+            return false;
+
+        Field &field = _fields[_count];
+        field.key_offset = (it + 1) - begin;
+        field.key_size = key_end - (it + 1);
+
+        it = skip_whitespace(key_end + 1, end);
+        if (it == end || *it != ':')
+            return false;
+
+        it = skip_whitespace(it + 1, end);
+
+        const char *value_end = scan_value(it, end, field.kind, field.escaped);
+        if (!value_end)
+            return false;
+
+        if (field.kind == String) {
+            field.value_offset = (it + 1) - begin;
+            field.value_size = (value_end - 1) - (it + 1);
+        } else {
+            field.value_offset = it - begin;
+            field.value_size = value_end - it;
+        }
+
+        any_escaped = any_escaped || field.escaped;
+        _count++;
+
+        it = skip_whitespace(value_end, end);
+        if (it == end)
+            return false;
+
+        if (*it == '}')
+            break;
+
+        if (*it != ',')
+            return false;
+
+        it = skip_whitespace(it + 1, end);
+    }
+
+    // Escaped strings are rewritten in place on first read, so take sole
+    // ownership of the bytes now, before any view into them is handed out
+    if (any_escaped)
+        _bytes.detach();
+
+    return skip_whitespace(it + 1, end) == end;
+}
+
+int json_frame::find(std::string_view key) const {
+    const char *begin = _bytes.constData();
+
+    for (int index = 0; index < _count; index++) {
+        const Field &field = _fields[index];
+        if (std::string_view(begin + field.key_offset, field.key_size) == key)
+            return index;
+    }
+
+    return -1;
+}
+
+json_frame::Kind json_frame::kind(int index) const {
+    return (index < 0 || index >= _count) ? Missing : _fields[index].kind;
+}
+
+std::string_view json_frame::raw(int index) const {
+    const Field &field = _fields[index];
+
+    return std::string_view(_bytes.constData() + field.value_offset, field.value_size);
+}
+
+bool json_frame::elements(int index, QList<QByteArray> &out) const {
+    if (kind(index) != Array)
+        return false;
+
+    const Field &field = _fields[index];
+    const char *end = _bytes.constData() + field.value_offset + field.value_size - 1;
+
+    const char *it = skip_whitespace(_bytes.constData() + field.value_offset + 1, end);
+    while (it != end) {
+        Kind element_kind;
+        bool escaped = false;
+
+        const char *element_end = scan_value(it, end, element_kind, escaped);
+        if (!element_end)
+            return false;
+
+        out.append(QByteArray(it, element_end - it));
+
+        it = skip_whitespace(element_end, end);
+        if (it == end)
+            break;
+
+        if (*it != ',')
+            return false;
+
+        it = skip_whitespace(it + 1, end);
+        if (it == end)
+            return false;
+    }
+
+    return true;
+}
+
+std::string_view json_frame::string(int index) {
+    Field &field = _fields[index];
+
+    if (field.escaped) {
+        field.value_size = unescape(_bytes.data() + field.value_offset, field.value_size);
+        field.escaped = false;
+    }
+
+    return raw(index);
+}
+
+const char *json_frame::skip_whitespace(const char *it, const char *end) {
+    while (it != end && (*it == ' ' || *it == '\n' || *it == '\r' || *it == '\t'))
+        ++it;
+
+    return it;
+}
+
+const char *json_frame::scan_string(const char *it, const char *end, bool &escaped) {
+    // memchr is vectorized in libc, which keeps multi-megabyte base64
+    // payloads cheap to step over
+    const char *start = it;
+    while (it != end) {
+        const char *quote = static_cast<const char *>(std::memchr(it, '"', end - it));
+        if (!quote)
+            return nullptr;
+
+        const char *backslashes = quote;
+        while (backslashes != start && backslashes[-1] == '\\')
+            --backslashes;
+
+        if (((quote - backslashes) & 1) == 0) {
+            escaped = std::memchr(start, '\\', quote - start) != nullptr;
+            return quote;
+        }
+
+        it = quote + 1;
+    }
+
+    return nullptr;
+}
+
+const char *json_frame::scan_value(const char *it, const char *end, Kind &kind, bool &escaped) {
+    escaped = false;
+
+    if (it == end)
+        return nullptr;
+
+    switch (*it) {
+    case '"': {
+        kind = String;
+
+        const char *quote = scan_string(it + 1, end, escaped);
+        return quote ? quote + 1 : nullptr;
+    }
+    case '{':
+    case '[': {
+        kind = (*it == '{') ? Object : Array;
+
+        // Closers expected, innermost last
+        std::array<char, MaxDepth> closers;
+        int depth = 0;
+        while (it != end) {
+            if (*it == '"') {
+                bool nested_escaped = false;
+                it = scan_string(it + 1, end, nested_escaped);
+                if (!it)
+                    return nullptr;
+            } else if (*it == '{' || *it == '[') {
+                if (depth == MaxDepth)
+                    return nullptr;
+
+                closers[depth++] = (*it == '{') ? '}' : ']';
+            } else if (*it == '}' || *it == ']') {
+                if (*it != closers[--depth])
+                    return nullptr;
+
+                if (depth == 0)
+                    return it + 1;
+            }
+
+            ++it;
+        }
+
+        return nullptr;
+    }
+    case 't':
+    case 'f':
+    case 'n': {
+        kind = Literal;
+
+        for (std::string_view literal : {std::string_view("true"), std::string_view("false"), std::string_view("null")}) {
+            if (end - it >= static_cast<qsizetype>(literal.size()) && std::string_view(it, literal.size()) == literal)
+                return it + literal.size();
+        }
+
+        return nullptr;
+    }
+    default: {
+        if (*it != '-' && (*it < '0' || *it > '9'))
+            return nullptr;
+
+        kind = Number;
+
+        const char *start = it;
+        while (it != end && ((*it >= '0' && *it <= '9') || *it == '-' || *it == '+' || *it == '.' || *it == 'e' || *it == 'E'))
+            ++it;
+
+        return it != start ? it : nullptr;
+    }
+    }
+}
+
+qsizetype json_frame::unescape(char *begin, qsizetype size) {
+    const char *in = begin;
+    const char *end = begin + size;
+    char *out = begin;
+
+    while (in != end) {
+        if (*in != '\\') {
+            *out++ = *in++;
+            continue;
+        }
+
+        if (++in == end)
+            break;
+
+        switch (*in++) {
+        case '"':
+            *out++ = '"';
+            break;
+        case '\\':
+            *out++ = '\\';
+            break;
+        case '/':
+            *out++ = '/';
+            break;
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case 'u': {
+            char32_t code_point = 0;
+            if (!read_hex4(in, end, code_point))
+                return out - begin;
+
+            in += 4;
+
+            // A surrogate only means something as half of a pair; a lone
+            // one would come out as invalid UTF-8, so it becomes U+FFFD
+            char32_t low = 0;
+            if (code_point >= 0xD800 && code_point <= 0xDBFF && end - in >= 6 && in[0] == '\\' && in[1] == 'u' && read_hex4(in + 2, end, low) && low >= 0xDC00 && low <= 0xDFFF) {
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                in += 6;
+            } else if (code_point >= 0xD800 && code_point <= 0xDFFF) {
+                code_point = 0xFFFD;
+            }
+
+            out = write_utf8(out, code_point);
+            break;
+        }
+        default:
+            *out++ = in[-1];
+            break;
+        }
+    }
+
+    return out - begin;
+}
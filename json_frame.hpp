@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <array>
+#include <string_view>
+
+// On-demand reader for inbound frames: one pass over the UTF-8 bytes indexes
+// the top-level keys of the object, and values are only interpreted when a
+// decoder asks for them. Strings come back as views into the frame, escapes
+// are resolved in place the first time an escaped string is read, and
+// nothing is allocated while parsing or rejecting a frame.
+class json_frame {
+  public:
+    enum Kind {
+        Missing,
+        String,
+        Number,
+        Literal,
+        Array,
+        Object
+    };
+
+    static constexpr int MaxFields = 16;
+
+    // Nesting allowed inside a value, so bracket pairing is checked on a
+    // fixed stack
+    static constexpr int MaxDepth = 64;
+
+    bool parse(QByteArray bytes);
+
+    int find(std::string_view key) const;
+    Kind kind(int index) const;
+
+    // Raw JSON text of the value, without quotes for strings
+    std::string_view raw(int index) const;
+
+    // Unescaped contents of a string value
+    std::string_view string(int index);
+
+    // Raw JSON text of each element of an array value
+    bool elements(int index, QList<QByteArray> &out) const;
+
+    const QByteArray &bytes() const { return _bytes; }
+
+  private:
+    struct Field {
+        qsizetype key_offset;
+        qsizetype key_size;
+        qsizetype value_offset;
+        qsizetype value_size;
+        Kind kind;
+        bool escaped;
+    };
+
+    QByteArray _bytes{};
+    std::array<Field, MaxFields> _fields{};
+    int _count{0};
+
+    static const char *skip_whitespace(const char *it, const char *end);
+    static const char *scan_string(const char *it, const char *end, bool &escaped);
+    static const char *scan_value(const char *it, const char *end, Kind &kind, bool &escaped);
+    static qsizetype unescape(char *begin, qsizetype size);
+};
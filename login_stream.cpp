@@ -0,0 +1,107 @@
+#include "login_stream.hpp"
+#include <algorithm>
+
+login_stream::login_stream(QWebSocket *socket, Repository &db, const int &account_ID, std::function<bool(int)> is_online)
+    : QObject(socket), _socket(socket), _queue(outbound_queue::of(socket)), _snapshot(db.snapshot(account_ID)), _is_online(std::move(is_online)) {
+    static bool configured = [] {
+        if (const char *value = std::getenv("CHAT_APP_LOGIN_CHUNK_BYTES"))
+            _chunk_bytes = std::max<qsizetype>(1024, std::atoll(value));
+
+        return true;
+    }();
+    Q_UNUSED(configured);
+
+    if (_queue)
+        connect(_queue, &outbound_queue::drained, this, &login_stream::pump);
+}
+
+void login_stream::start(const QJsonObject &my_info) {
+    QJsonObject message{{"type", "login_begin"},
+                        {"status", true},
+                        {"message", "loading your data..."},
+                        {"my_info", my_info}};
+
+    send(QString::fromUtf8(QJsonDocument(message).toJson(QJsonDocument::Compact)));
+
+    pump();
+}
+
+void login_stream::pump() {
+    while (!_queue || _queue->writable()) {
+        QJsonObject item;
+
+        switch (_snapshot->next(item)) {
+        case Snapshot::Contact: {
+            QJsonObject contact_info = item["contactInfo"].toObject();
+            contact_info["status"] = _is_online(contact_info["_id"].toInt());
+            item["contactInfo"] = contact_info;
+
+            append(_contacts, item, "contacts_chunk", "contacts");
+            _contact_count++;
+            break;
+        }
+        case Snapshot::Group:
+            // Contacts always arrive before the first group
+            flush(_contacts, "contacts_chunk", "contacts");
+
+            append(_groups, item, "groups_chunk", "groups");
+            _group_count++;
+            break;
+        case Snapshot::End:
+            finish();
+            return;
+        }
+    }
+}
+
+void login_stream::append(Chunk &chunk, const QJsonObject &item, const char *type, const char *key) {
+    QByteArray serialized = QJsonDocument(item).toJson(QJsonDocument::Compact);
+
+    if (chunk.count && chunk.items.size() + serialized.size() > _chunk_bytes)
+        flush(chunk, type, key);
+
+    if (chunk.count)
+        chunk.items += ',';
+
+    chunk.items += serialized;
+    chunk.count++;
+
+    if (chunk.items.size() >= _chunk_bytes)
+        flush(chunk, type, key);
+}
+
+void login_stream::flush(Chunk &chunk, const char *type, const char *key) {
+    if (!chunk.count)
+        return;
+
+    QByteArray frame = QByteArray(R"({"type":")") + type + R"(",")" + key + R"(":[)" + chunk.items + "]}";
+    send(QString::fromUtf8(frame));
+
+    chunk = Chunk{};
+    _chunk_count++;
+}
+
+void login_stream::send(const QString &frame) {
+    if (_queue)
+        _queue->send(frame);
+    else
+        _socket->sendTextMessage(frame);
+}
+
+void login_stream::finish() {
+    flush(_contacts, "contacts_chunk", "contacts");
+    flush(_groups, "groups_chunk", "groups");
+
+    QJsonObject message{{"type", "login_end"},
+                        {"contacts", _contact_count},
+                        {"groups", _group_count},
+                        {"chunks", _chunk_count}};
+
+    send(QString::fromUtf8(QJsonDocument(message).toJson(QJsonDocument::Compact)));
+
+    if (_queue)
+        disconnect(_queue, &outbound_queue::drained, this, &login_stream::pump);
+
+    _snapshot.reset();
+    deleteLater();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "repository.hpp"
+#include "outbound_queue.hpp"
+#include <functional>
+#include <memory>
+
+// Sends a login snapshot as login_begin, contacts_chunk..., groups_chunk...,
+// login_end. Chunks are packed up to CHAT_APP_LOGIN_CHUNK_BYTES and pulled
+// off the Mongo cursors only while the connection's outbound queue is
+// writable, so a slow client costs one chunk of memory instead of its whole
+// history. Owned by the socket; deletes itself once login_end is out.
+class login_stream : public QObject {
+    Q_OBJECT
+
+  public:
+    login_stream(QWebSocket *socket, Repository &db, const int &account_ID, std::function<bool(int)> is_online);
+
+    void start(const QJsonObject &my_info);
+
+  private slots:
+    void pump();
+
+  private:
+    struct Chunk {
+        QByteArray items{};
+        int count{0};
+    };
+
+    QWebSocket *_socket{nullptr};
+    outbound_queue *_queue{nullptr};
+    std::unique_ptr<Snapshot> _snapshot{};
+    std::function<bool(int)> _is_online{};
+
+    Chunk _contacts{};
+    Chunk _groups{};
+
+    int _contact_count{0};
+    int _group_count{0};
+    int _chunk_count{0};
+
+    static inline qsizetype _chunk_bytes{256 * 1024};
+
+    void append(Chunk &chunk, const QJsonObject &item, const char *type, const char *key);
+    void flush(Chunk &chunk, const char *type, const char *key);
+    void send(const QString &frame);
+    void finish();
+};
@@ -1,10 +1,13 @@
 #include "server_manager.hpp"
+#include "logger.hpp"
 #include <QCoreApplication>
 
 int main(int argc, char **argv)
 {
     QCoreApplication app(argc, argv);
 
+    logger::install_qt_handler();
+
     server_manager Main_window(&app);
 
     return app.exec();
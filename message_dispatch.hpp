@@ -0,0 +1,441 @@
+#pragma once
+
+#include "json_frame.hpp"
+#include <QByteArrayView>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+// Perfect hash over a fixed set of names, built entirely at compile time by
+// searching for a seed that gives every name its own slot. A lookup is one
+// hash, one table read and one comparison, and never allocates.
+template <std::size_t N, std::size_t TableSize = 128>
+class perfect_hash {
+    static_assert((TableSize & (TableSize - 1)) == 0, "TableSize must be a power of two");
+    static_assert(N < TableSize, "TableSize must leave room for every name");
+
+  public:
+    constexpr perfect_hash(const std::array<std::string_view, N> &names)
+        : _names(names) {
+        while (!try_seed())
+            _seed++;
+    }
+
+    // Accepts narrow or UTF-16 names, so a QString key can be looked up in place
+    template <typename Char>
+    constexpr int find(std::basic_string_view<Char> name) const {
+        int index = _slots[hash(_seed, name) & (TableSize - 1)];
+
+        return (index >= 0 && equal(_names[index], name)) ? index : -1;
+    }
+
+    constexpr int find(std::string_view name) const { return find<char>(name); }
+
+    constexpr quint32 seed() const { return _seed; }
+
+    template <typename Char>
+    static constexpr quint32 hash(quint32 seed, std::basic_string_view<Char> name) {
+        quint32 hash = 2166136261u ^ (seed * 0x9E3779B9u);
+        for (Char c : name) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
+        }
+
+        return hash ^ (hash >> 15);
+    }
+
+  private:
+    std::array<std::string_view, N> _names{};
+    std::array<int, TableSize> _slots{};
+    quint32 _seed{1};
+
+    constexpr bool try_seed() {
+        _slots.fill(-1);
+
+        for (std::size_t i = 0; i < N; i++) {
+            int &slot = _slots[hash<char>(_seed, _names[i]) & (TableSize - 1)];
+            if (slot != -1)
+                return false;
+
+            slot = static_cast<int>(i);
+        }
+
+        return true;
+    }
+
+    template <typename Char>
+    static constexpr bool equal(std::string_view name, std::basic_string_view<Char> other) {
+        if (name.size() != other.size())
+            return false;
+
+        for (std::size_t i = 0; i < name.size(); i++) {
+            if (static_cast<unsigned char>(name[i]) != static_cast<std::make_unsigned_t<Char>>(other[i]))
+                return false;
+        }
+
+        return true;
+    }
+};
+
+// Binds a frame member to its JSON key
+template <auto Member>
+struct field {
+    static constexpr auto member = Member;
+
+    std::string_view name;
+    bool required{true};
+};
+
+struct sign_up_frame {
+    int phone_number{};
+    QString first_name;
+    QString last_name;
+    QString password;
+    QString secret_question;
+    QString secret_answer;
+
+    static constexpr auto fields() {
+        return std::tuple{field<&sign_up_frame::phone_number>{"phone_number"}, field<&sign_up_frame::first_name>{"first_name"}, field<&sign_up_frame::last_name>{"last_name"},
+                          field<&sign_up_frame::password>{"password"}, field<&sign_up_frame::secret_question>{"secret_question"}, field<&sign_up_frame::secret_answer>{"secret_answer"}};
+    }
+};
+
+struct login_request_frame {
+    int phone_number{};
+    QString password;
+    QString time_zone;
+
+    static constexpr auto fields() {
+        return std::tuple{field<&login_request_frame::phone_number>{"phone_number"}, field<&login_request_frame::password>{"password"}, field<&login_request_frame::time_zone>{"time_zone", false}};
+    }
+};
+
+struct is_typing_frame {
+    int receiver{};
+
+    static constexpr auto fields() { return std::tuple{field<&is_typing_frame::receiver>{"receiver"}}; }
+};
+
+struct profile_image_frame {
+    QString file_name;
+    QByteArrayView file_data;
+
+    static constexpr auto fields() { return std::tuple{field<&profile_image_frame::file_name>{"file_name"}, field<&profile_image_frame::file_data>{"file_data"}}; }
+};
+
+struct group_profile_image_frame {
+    int groupID{};
+    QString file_name;
+    QByteArrayView file_data;
+
+    static constexpr auto fields() {
+        return std::tuple{field<&group_profile_image_frame::groupID>{"groupID"}, field<&group_profile_image_frame::file_name>{"file_name"}, field<&group_profile_image_frame::file_data>{"file_data"}};
+    }
+};
+
+struct empty_frame {
+    static constexpr auto fields() { return std::tuple{}; }
+};
+
+struct lookup_friend_frame {
+    int phone_number{};
+
+    static constexpr auto fields() { return std::tuple{field<&lookup_friend_frame::phone_number>{"phone_number"}}; }
+};
+
+struct new_group_frame {
+    QString group_name;
+    QJsonArray group_members;
+
+    static constexpr auto fields() { return std::tuple{field<&new_group_frame::group_name>{"group_name"}, field<&new_group_frame::group_members>{"group_members"}}; }
+};
+
+struct text_frame {
+    int receiver{};
+    QString message;
+    QString time;
+    int chatID{};
+
+    static constexpr auto fields() {
+        return std::tuple{field<&text_frame::receiver>{"receiver"}, field<&text_frame::message>{"message"}, field<&text_frame::time>{"time"}, field<&text_frame::chatID>{"chatID"}};
+    }
+};
+
+struct group_text_frame {
+    int groupID{};
+    QString sender_name;
+    QString message;
+    QString time;
+
+    static constexpr auto fields() {
+        return std::tuple{field<&group_text_frame::groupID>{"groupID"}, field<&group_text_frame::sender_name>{"sender_name"}, field<&group_text_frame::message>{"message"}, field<&group_text_frame::time>{"time"}};
+    }
+};
+
+struct file_frame {
+    int chatID{};
+    int receiver{};
+    QString file_name;
+    QByteArrayView file_data;
+    QString time;
+
+    static constexpr auto fields() {
+        return std::tuple{field<&file_frame::chatID>{"chatID"}, field<&file_frame::receiver>{"receiver"}, field<&file_frame::file_name>{"file_name"}, field<&file_frame::file_data>{"file_data"},
+                          field<&file_frame::time>{"time"}};
+    }
+};
+
+struct group_file_frame {
+    int groupID{};
+    QString sender_name;
+    QString file_name;
+    QByteArrayView file_data;
+    QString time;
+
+    static constexpr auto fields() {
+        return std::tuple{field<&group_file_frame::groupID>{"groupID"}, field<&group_file_frame::sender_name>{"sender_name"}, field<&group_file_frame::file_name>{"file_name"},
+                          field<&group_file_frame::file_data>{"file_data"}, field<&group_file_frame::time>{"time"}};
+    }
+};
+
+struct group_is_typing_frame {
+    int groupID{};
+    QString sender_name;
+
+    static constexpr auto fields() { return std::tuple{field<&group_is_typing_frame::groupID>{"groupID"}, field<&group_is_typing_frame::sender_name>{"sender_name"}}; }
+};
+
+struct update_info_frame {
+    QString first_name;
+    QString last_name;
+    QString password;
+
+    static constexpr auto fields() {
+        return std::tuple{field<&update_info_frame::first_name>{"first_name"}, field<&update_info_frame::last_name>{"last_name"}, field<&update_info_frame::password>{"password"}};
+    }
+};
+
+struct update_password_frame {
+    int phone_number{};
+    QString password;
+
+    static constexpr auto fields() { return std::tuple{field<&update_password_frame::phone_number>{"phone_number"}, field<&update_password_frame::password>{"password"}}; }
+};
+
+struct group_members_frame {
+    int groupID{};
+    QJsonArray group_members;
+
+    static constexpr auto fields() { return std::tuple{field<&group_members_frame::groupID>{"groupID"}, field<&group_members_frame::group_members>{"group_members"}}; }
+};
+
+struct delete_message_frame {
+    int receiver{};
+    int chatID{};
+    QString full_time;
+
+    static constexpr auto fields() {
+        return std::tuple{field<&delete_message_frame::receiver>{"receiver"}, field<&delete_message_frame::chatID>{"chatID"}, field<&delete_message_frame::full_time>{"full_time"}};
+    }
+};
+
+struct delete_group_message_frame {
+    int groupID{};
+    QString full_time;
+
+    static constexpr auto fields() { return std::tuple{field<&delete_group_message_frame::groupID>{"groupID"}, field<&delete_group_message_frame::full_time>{"full_time"}}; }
+};
+
+struct chat_frame {
+    int chatID{};
+
+    static constexpr auto fields() { return std::tuple{field<&chat_frame::chatID>{"chatID"}}; }
+};
+
+struct group_frame {
+    int groupID{};
+
+    static constexpr auto fields() { return std::tuple{field<&group_frame::groupID>{"groupID"}}; }
+};
+
+struct audio_frame {
+    int chatID{};
+    int receiver{};
+    QString audio_name;
+    QByteArrayView audio_data;
+    QString time;
+
+    static constexpr auto fields() {
+        return std::tuple{field<&audio_frame::chatID>{"chatID"}, field<&audio_frame::receiver>{"receiver"}, field<&audio_frame::audio_name>{"audio_name"}, field<&audio_frame::audio_data>{"audio_data"},
+                          field<&audio_frame::time>{"time"}};
+    }
+};
+
+struct group_audio_frame {
+    int groupID{};
+    QString sender_name;
+    QString audio_name;
+    QByteArrayView audio_data;
+    QString time;
+
+    static constexpr auto fields() {
+        return std::tuple{field<&group_audio_frame::groupID>{"groupID"}, field<&group_audio_frame::sender_name>{"sender_name"}, field<&group_audio_frame::audio_name>{"audio_name"},
+                          field<&group_audio_frame::audio_data>{"audio_data"}, field<&group_audio_frame::time>{"time"}};
+    }
+};
+
+class message_dispatch {
+  public:
+    enum MessageType {
+        Unknown = -1,
+        SignUp,
+        LoginRequest,
+        IsTyping,
+        ProfileImage,
+        GroupProfileImage,
+        ProfileImageDeleted,
+        LookupFriend,
+        NewGroup,
+        Text,
+        GroupText,
+        File,
+        GroupFile,
+        GroupIsTyping,
+        UpdateInfo,
+        UpdatePassword,
+        RetrieveQuestion,
+        RemoveGroupMember,
+        AddGroupMember,
+        DeleteMessage,
+        DeleteGroupMessage,
+        UpdateUnreadMessage,
+        UpdateGroupUnreadMessage,
+        DeleteAccount,
+        Audio,
+        GroupAudio,
+        Batch, // Envelope of other operations, read directly from the frame
+        TypeCount
+    };
+
+    // Indexed by MessageType
+    static constexpr std::array<std::string_view, TypeCount> names{"sign_up", "login_request", "is_typing", "profile_image", "group_profile_image", "profile_image_deleted", "lookup_friend",
+                                                                   "new_group", "text", "group_text", "file", "group_file", "group_is_typing", "contact_info_updated", "update_password",
+                                                                   "retrieve_question", "remove_group_member", "add_group_member", "delete_message", "delete_group_message",
+                                                                   "update_unread_message", "update_group_unread_message", "delete_account", "audio", "group_audio", "batch"};
+
+    // Indexed by MessageType
+    using frames = std::tuple<sign_up_frame, login_request_frame, is_typing_frame, profile_image_frame, group_profile_image_frame, empty_frame, lookup_friend_frame, new_group_frame, text_frame,
+                              group_text_frame, file_frame, group_file_frame, group_is_typing_frame, update_info_frame, update_password_frame, lookup_friend_frame, group_members_frame,
+                              group_members_frame, delete_message_frame, delete_group_message_frame, chat_frame, group_frame, empty_frame, audio_frame, group_audio_frame, empty_frame>;
+
+    static_assert(std::tuple_size_v<frames> == TypeCount, "every message type needs a frame");
+
+    template <typename Char>
+    static constexpr MessageType type_of(std::basic_string_view<Char> name) {
+        int index = _hash.find(name);
+
+        return index < 0 ? Unknown : static_cast<MessageType>(index);
+    }
+
+    static constexpr MessageType type_of(std::string_view name) { return type_of<char>(name); }
+
+    // Type of a parsed frame, Unknown when missing or not a known name
+    static MessageType type_of(json_frame &json) {
+        int index = json.find("type");
+        if (json.kind(index) != json_frame::String)
+            return Unknown;
+
+        return type_of(json.string(index));
+    }
+
+    static bool decode_value(json_frame &json, int index, int &out) {
+        if (json.kind(index) != json_frame::Number)
+            return false;
+
+        std::string_view raw = json.raw(index);
+
+        long long integer = 0;
+        std::from_chars_result result = std::from_chars(raw.data(), raw.data() + raw.size(), integer);
+        if (result.ec == std::errc() && result.ptr == raw.data() + raw.size()) {
+            if (integer < std::numeric_limits<int>::min() || integer > std::numeric_limits<int>::max())
+                return false;
+
+            out = static_cast<int>(integer);
+            return true;
+        }
+
+        // Clients may encode integers as doubles, e.g. 1.0 or 1e3
+        double number = 0;
+        result = std::from_chars(raw.data(), raw.data() + raw.size(), number);
+        if (result.ec != std::errc() || result.ptr != raw.data() + raw.size() || std::trunc(number) != number)
+            return false;
+
+        if (number < std::numeric_limits<int>::min() || number > std::numeric_limits<int>::max())
+            return false;
+
+        out = static_cast<int>(number);
+        return true;
+    }
+
+    static bool decode_value(json_frame &json, int index, QString &out) {
+        if (json.kind(index) != json_frame::String)
+            return false;
+
+        std::string_view string = json.string(index);
+        out = QString::fromUtf8(string.data(), static_cast<qsizetype>(string.size()));
+        return true;
+    }
+
+    // Zero-copy view into the frame, only valid while the json_frame lives
+    static bool decode_value(json_frame &json, int index, QByteArrayView &out) {
+        if (json.kind(index) != json_frame::String)
+            return false;
+
+        std::string_view string = json.string(index);
+        out = QByteArrayView(string.data(), static_cast<qsizetype>(string.size()));
+        return true;
+    }
+
+    static bool decode_value(json_frame &json, int index, QJsonArray &out) {
+        if (json.kind(index) != json_frame::Array)
+            return false;
+
+        std::string_view raw = json.raw(index);
+
+        QJsonDocument json_doc = QJsonDocument::fromJson(QByteArray::fromRawData(raw.data(), static_cast<qsizetype>(raw.size())));
+        if (!json_doc.isArray())
+            return false;
+
+        out = json_doc.array();
+        return true;
+    }
+
+    // Fills every field of the frame in one pass over its field list. Fails on
+    // a missing required field or a value of the wrong JSON type.
+    template <typename Frame>
+    static bool decode(json_frame &json, Frame &frame) {
+        return std::apply([&](const auto &...fields) { return (decode_field(json, frame, fields) && ...); }, Frame::fields());
+    }
+
+  private:
+    static constexpr perfect_hash<TypeCount> _hash{names};
+
+    template <typename Frame, auto Member>
+    static bool decode_field(json_frame &json, Frame &frame, const field<Member> &entry) {
+        int index = json.find(entry.name);
+        if (index < 0)
+            return !entry.required;
+
+        return decode_value(json, index, frame.*Member);
+    }
+};
+
+static_assert(message_dispatch::type_of("text") == message_dispatch::Text);
+static_assert(message_dispatch::type_of("group_audio") == message_dispatch::GroupAudio);
+static_assert(message_dispatch::type_of("client_connected") == message_dispatch::Unknown);
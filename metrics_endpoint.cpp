@@ -0,0 +1,86 @@
+#include "metrics_endpoint.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
+#include <QUrlQuery>
+
+metrics_endpoint::metrics_endpoint(QObject *parent)
+    : QObject(parent) {
+    quint16 port = std::getenv("CHAT_APP_METRICS_PORT") ? static_cast<quint16>(std::atoi(std::getenv("CHAT_APP_METRICS_PORT"))) : 9464;
+    if (!port)
+        return;
+
+    QHostAddress address = std::getenv("CHAT_APP_METRICS_ADDRESS") ? QHostAddress(QString(std::getenv("CHAT_APP_METRICS_ADDRESS"))) : QHostAddress(QHostAddress::LocalHost);
+    if (address.isNull()) {
+        logger::error("metrics_bad_address", {{"address", std::getenv("CHAT_APP_METRICS_ADDRESS")}});
+        return;
+    }
+
+    connect(&_server, &QTcpServer::newConnection, this, &metrics_endpoint::on_new_connection);
+
+    if (!_server.listen(address, port))
+        logger::error("metrics_listen_failed", {{"address", address.toString()}, {"port", int(port)}, {"error", _server.errorString()}});
+    else
+        logger::info("metrics_listening", {{"address", address.toString()}, {"port", int(port)}});
+}
+
+void metrics_endpoint::on_new_connection() {
+    while (QTcpSocket *socket = _server.nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, &metrics_endpoint::on_ready_read);
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void metrics_endpoint::on_ready_read() {
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+
+    // Only the request line matters; wait for the end of the headers
+    QByteArray request = socket->peek(MaxRequestBytes);
+    if (!request.contains("\r\n\r\n") && request.size() < MaxRequestBytes)
+        return;
+
+    socket->readAll();
+
+    QList<QByteArray> request_line = request.left(request.indexOf("\r\n")).split(' ');
+
+    QUrl target(QString::fromLatin1(request_line.value(1)));
+
+    QByteArray status = "200 OK";
+    QByteArray content_type = "text/plain; version=0.0.4; charset=utf-8";
+    QByteArray body;
+    QByteArray method = request_line.value(0);
+    if (method == "POST" && target.path() == "/trace/sample") {
+        // The only request that changes state; a GET that a crawler or a
+        // prefetch can replay never does
+        QUrlQuery query(target);
+        bool valid = false;
+        double rate = query.queryItemValue("rate").toDouble(&valid);
+        if (valid) {
+            tracing::set_sample_rate(rate);
+            body = QByteArray::number(tracing::sample_rate()) + '\n';
+        } else
+            status = "400 Bad Request";
+    } else if (method != "GET") {
+        status = "405 Method Not Allowed";
+    } else if (target.path() == "/metrics") {
+        body = metrics::registry::instance().expose();
+    } else if (target.path() == "/trace/sample") {
+        body = QByteArray::number(tracing::sample_rate()) + '\n';
+    } else if (target.path() == "/trace/chrome") {
+        content_type = "application/json";
+        body = tracing::chrome_trace();
+    } else if (target.path() == "/trace/otlp") {
+        content_type = "application/json";
+        body = tracing::otlp_trace();
+    } else {
+        status = "404 Not Found";
+    }
+
+    socket->write("HTTP/1.1 " + status + "\r\n"
+                  "Content-Type: " + content_type + "\r\n"
+                  "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                  "Connection: close\r\n\r\n" + body);
+    socket->disconnectFromHost();
+}
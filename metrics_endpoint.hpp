@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QTcpServer>
+#include <QTcpSocket>
+
+// Serves the metrics registry as Prometheus text on GET /metrics, on its own
+// port (CHAT_APP_METRICS_PORT, default 9464, 0 to disable) so scrapes never
+// share a socket with chat traffic. Only loopback listens unless
+// CHAT_APP_METRICS_ADDRESS names another interface. Also exports the trace
+// ring on /trace/chrome and /trace/otlp; GET /trace/sample reads the sampling
+// rate and POST /trace/sample?rate=0.05 sets it.
+class metrics_endpoint : public QObject {
+    Q_OBJECT
+
+  public:
+    metrics_endpoint(QObject *parent = nullptr);
+
+  private slots:
+    void on_new_connection();
+    void on_ready_read();
+
+  private:
+    QTcpServer _server{};
+
+    static constexpr qint64 MaxRequestBytes = 8 * 1024;
+};
@@ -0,0 +1,193 @@
+#include "outbound_queue.hpp"
+#include "frame_compression.hpp"
+#include "logger.hpp"
+#include "slab_pool.hpp"
+
+outbound_queue::outbound_queue(QWebSocket *socket)
+    : QObject(socket), _socket(socket), _compress(frame_compression::instance().enabled() && frame_compression::requested(socket)) {
+    static bool configured = (configure(), true);
+    Q_UNUSED(configured);
+
+    _queues.insert(_socket, this);
+
+    connect(_socket, &QWebSocket::bytesWritten, this, &outbound_queue::on_bytes_written);
+}
+
+outbound_queue::~outbound_queue() {
+    _metrics.queued_frames -= static_cast<qint64>(_frames.size());
+    _metrics.queued_bytes -= _queued_bytes;
+
+    _queues.remove(_socket);
+}
+
+void *outbound_queue::operator new(std::size_t size) {
+    return size == sizeof(outbound_queue) ? slab_pool<outbound_queue>::instance().allocate() : ::operator new(size);
+}
+
+void outbound_queue::operator delete(void *pointer, std::size_t size) {
+    if (size == sizeof(outbound_queue))
+        slab_pool<outbound_queue>::instance().release(pointer);
+    else
+        ::operator delete(pointer);
+}
+
+void outbound_queue::configure() {
+    if (const char *value = std::getenv("CHAT_APP_OUTBOUND_HIGH_WATERMARK"))
+        _high_watermark = std::atoll(value);
+
+    if (const char *value = std::getenv("CHAT_APP_OUTBOUND_LOW_WATERMARK"))
+        _low_watermark = std::atoll(value);
+
+    if (const char *value = std::getenv("CHAT_APP_OUTBOUND_LIMIT"))
+        _limit = std::atoll(value);
+
+    if (const char *value = std::getenv("CHAT_APP_OUTBOUND_POLICY")) {
+        QString policy = QString(value).toLower();
+
+        if (policy == "drop_presence")
+            _policy = DropPresence;
+        else if (policy == "disconnect")
+            _policy = Disconnect;
+        else
+            _policy = CoalesceTyping;
+    }
+
+    if (_low_watermark > _high_watermark)
+        _low_watermark = _high_watermark;
+}
+
+outbound_queue *outbound_queue::of(QWebSocket *socket) {
+    return _queues.value(socket, nullptr);
+}
+
+outbound_queue::Metrics outbound_queue::metrics() {
+    return _metrics;
+}
+
+void outbound_queue::send(const QString &frame, FrameKind kind, const QString &coalesce_key) {
+    if (_evicted)
+        return;
+
+    if (_frames.empty() && _socket->bytesToWrite() < _high_watermark) {
+        write(frame);
+        return;
+    }
+
+    enqueue(frame, kind, coalesce_key);
+}
+
+qsizetype outbound_queue::queued_frames() const {
+    return static_cast<qsizetype>(_frames.size());
+}
+
+qint64 outbound_queue::queued_bytes() const {
+    return _queued_bytes;
+}
+
+bool outbound_queue::writable() const {
+    return !_evicted && _frames.empty() && _socket->bytesToWrite() < _high_watermark;
+}
+
+void outbound_queue::on_bytes_written() {
+    if (_socket->bytesToWrite() > _low_watermark)
+        return;
+
+    drain();
+
+    if (writable())
+        emit drained();
+}
+
+void outbound_queue::write(const QString &frame) {
+    // Characters stand in for bytes here, frames being mostly ASCII JSON
+    if (_compress && frame.size() >= frame_compression::instance().threshold()) {
+        QByteArray compressed = frame_compression::instance().compress(frame.toUtf8());
+        if (!compressed.isNull()) {
+            _socket->sendBinaryMessage(compressed);
+            return;
+        }
+    }
+
+    _socket->sendTextMessage(frame);
+}
+
+void outbound_queue::enqueue(const QString &frame, FrameKind kind, const QString &coalesce_key) {
+    if (kind == Typing && !coalesce_key.isEmpty()) {
+        for (Frame &queued : _frames) {
+            if (queued.kind != Typing || queued.coalesce_key != coalesce_key)
+                continue;
+
+            _queued_bytes += frame.size() - queued.payload.size();
+            _metrics.queued_bytes += frame.size() - queued.payload.size();
+            _metrics.coalesced_frames++;
+
+            queued.payload = frame;
+            return;
+        }
+    }
+
+    _frames.push_back(Frame{frame, kind, coalesce_key});
+    _queued_bytes += frame.size();
+    _metrics.queued_bytes += frame.size();
+    _metrics.queued_frames++;
+
+    if (_queued_bytes <= _limit)
+        return;
+
+    switch (_policy) {
+    case DropPresence:
+        shed(Presence);
+        [[fallthrough]];
+    case CoalesceTyping:
+        shed(Typing);
+        break;
+    case Disconnect:
+        break;
+    }
+
+    if (_queued_bytes > _limit)
+        evict();
+}
+
+void outbound_queue::drain() {
+    while (!_frames.empty() && _socket->bytesToWrite() < _high_watermark) {
+        QString payload = _frames.front().payload;
+        erase(_frames.begin());
+
+        write(payload);
+    }
+}
+
+void outbound_queue::shed(FrameKind kind) {
+    for (auto it = _frames.begin(); it != _frames.end();) {
+        if (it->kind != kind) {
+            ++it;
+            continue;
+        }
+
+        _metrics.dropped_frames++;
+        it = erase(it);
+    }
+}
+
+void outbound_queue::evict() {
+    logger::warning("client_evicted", {{"id", _socket->property("id").toInt()}, {"queued_bytes", _queued_bytes}});
+
+    _evicted = true;
+    _metrics.evictions++;
+
+    while (!_frames.empty())
+        erase(_frames.begin());
+
+    // Evictions happen inside send(), often halfway through a fan-out over
+    // _clients; aborting here would re-enter on_client_disconnected
+    QMetaObject::invokeMethod(_socket, &QWebSocket::abort, Qt::QueuedConnection);
+}
+
+std::deque<outbound_queue::Frame>::iterator outbound_queue::erase(std::deque<Frame>::iterator it) {
+    _queued_bytes -= it->payload.size();
+    _metrics.queued_bytes -= it->payload.size();
+    _metrics.queued_frames--;
+
+    return _frames.erase(it);
+}
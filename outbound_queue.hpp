@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QWebSocket>
+#include <deque>
+
+// Per-connection send queue. Frames go straight to the socket while its write
+// buffer is below the high watermark; past that they are parked here and
+// drained again once the socket has flushed down to the low watermark.
+class outbound_queue : public QObject {
+    Q_OBJECT
+
+  public:
+    enum FrameKind {
+        Message,
+        Presence,
+        Typing
+    };
+
+    // What to shed first once the queued bytes go over the limit. Whatever
+    // the policy, a client still over the limit after shedding is evicted.
+    enum OverflowPolicy {
+        CoalesceTyping,
+        DropPresence,
+        Disconnect
+    };
+
+    struct Metrics {
+        qint64 queued_frames{0};
+        qint64 queued_bytes{0};
+        qint64 coalesced_frames{0};
+        qint64 dropped_frames{0};
+        qint64 evictions{0};
+    };
+
+    outbound_queue(QWebSocket *socket);
+    ~outbound_queue();
+
+    // One per connection, so they share the session's slab allocation scheme
+    static void *operator new(std::size_t size);
+    static void operator delete(void *pointer, std::size_t size);
+
+    static outbound_queue *of(QWebSocket *socket);
+    static Metrics metrics();
+
+    // Typing frames carrying the same coalesce_key replace each other while queued
+    void send(const QString &frame, FrameKind kind = Message, const QString &coalesce_key = QString());
+
+    qsizetype queued_frames() const;
+    qint64 queued_bytes() const;
+
+    // True while a send would go straight to the socket
+    bool writable() const;
+
+  signals:
+    // The queue has emptied and the socket is back under the high watermark
+    void drained();
+
+  private slots:
+    void on_bytes_written();
+
+  private:
+    struct Frame {
+        QString payload;
+        FrameKind kind;
+        QString coalesce_key;
+    };
+
+    QWebSocket *_socket{nullptr};
+    bool _compress{false};
+    std::deque<Frame> _frames{};
+    qint64 _queued_bytes{0};
+    bool _evicted{false};
+
+    static inline qint64 _high_watermark{256 * 1024};
+    static inline qint64 _low_watermark{64 * 1024};
+    static inline qint64 _limit{4 * 1024 * 1024};
+    static inline OverflowPolicy _policy{CoalesceTyping};
+
+    static inline QHash<QWebSocket *, outbound_queue *> _queues{};
+    static inline Metrics _metrics{};
+
+    static void configure();
+
+    void write(const QString &frame);
+    void enqueue(const QString &frame, FrameKind kind, const QString &coalesce_key);
+    void drain();
+    void shed(FrameKind kind);
+    void evict();
+    std::deque<Frame>::iterator erase(std::deque<Frame>::iterator it);
+};
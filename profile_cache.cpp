@@ -0,0 +1,214 @@
+#include "profile_cache.hpp"
+#include "logger.hpp"
+#include "task_scheduler.hpp"
+#include <algorithm>
+#include <utility>
+
+const QJsonObject profile_cache::fields{{"_id", 1}, {"first_name", 1}, {"last_name", 1}, {"image_url", 1}, {"status", 1}};
+
+QJsonObject profile_cache::Profile::to_json() const {
+    return QJsonObject{{"_id", phone_number},
+                       {"status", status},
+                       {"first_name", first_name},
+                       {"last_name", last_name},
+                       {"image_url", image_url}};
+}
+
+double profile_cache::Metrics::hit_rate() const {
+    qint64 lookups = hits + misses + filtered;
+
+    return lookups ? static_cast<double>(hits + filtered) / lookups : 0.0;
+}
+
+profile_cache::profile_cache(Repository &db, bool complete_filter, QObject *parent)
+    : QObject(parent), _db(db) {
+    if (const char *value = std::getenv("CHAT_APP_PROFILE_CACHE_SIZE"))
+        _capacity = std::max<qsizetype>(1, std::atoll(value));
+
+    if (const char *value = std::getenv("CHAT_APP_PROFILE_TTL_MS"))
+        _ttl = std::atoll(value);
+
+    _clock.start();
+
+    // Another node may register a number this one never hears about
+    if (complete_filter)
+        build_filter();
+
+    connect(&_report_timer, &QTimer::timeout, this, &profile_cache::report);
+    _report_timer.start(std::getenv("CHAT_APP_PROFILE_REPORT_MS") ? std::atoi(std::getenv("CHAT_APP_PROFILE_REPORT_MS")) : 60000);
+}
+
+std::optional<profile_cache::Profile> profile_cache::find(const int &phone_number) {
+    auto it = _index.find(phone_number);
+    if (it != _index.end()) {
+        if (_clock.elapsed() - (*it)->loaded < _ttl) {
+            _entries.splice(_entries.begin(), _entries, *it);
+            _metrics.hits++;
+
+            return (*it)->profile;
+        }
+
+        _entries.erase(*it);
+        _index.erase(it);
+    }
+
+    if (!may_exist(phone_number)) {
+        _metrics.filtered++;
+        return std::nullopt;
+    }
+
+    _metrics.misses++;
+
+    QJsonDocument json_doc = _db.find_document("accounts", QJsonObject{{"_id", phone_number}}, fields);
+    if (json_doc.isEmpty())
+        return std::nullopt;
+
+    return insert(json_doc.object());
+}
+
+profile_cache::Profile profile_cache::insert(const QJsonObject &account) {
+    Profile profile{account["_id"].toInt(),
+                    account["first_name"].toString(),
+                    account["last_name"].toString(),
+                    account["image_url"].toString(),
+                    account["status"].toBool()};
+
+    return store(profile);
+}
+
+void profile_cache::update(const int &phone_number, const QJsonObject &fields) {
+    auto it = _index.find(phone_number);
+    if (it == _index.end())
+        return;
+
+    Profile &profile = (*it)->profile;
+
+    if (fields.contains("first_name"))
+        profile.first_name = fields["first_name"].toString();
+
+    if (fields.contains("last_name"))
+        profile.last_name = fields["last_name"].toString();
+
+    if (fields.contains("image_url"))
+        profile.image_url = fields["image_url"].toString();
+
+    if (fields.contains("status"))
+        profile.status = fields["status"].toBool();
+}
+
+void profile_cache::remove(const int &phone_number) {
+    auto it = _index.find(phone_number);
+    if (it == _index.end())
+        return;
+
+    _entries.erase(*it);
+    _index.erase(it);
+}
+
+void profile_cache::registered(const int &phone_number) {
+    // Also while the filter is still being built, so no sign-up is missed
+    if (_filter.empty())
+        return;
+
+    for (quint64 bit : filter_bits(phone_number, static_cast<quint64>(_filter.size()) * 64))
+        _filter[bit / 64] |= quint64(1) << (bit % 64);
+}
+
+profile_cache::Metrics profile_cache::metrics() const {
+    return _metrics;
+}
+
+void profile_cache::report() {
+    Metrics window{_metrics.hits - _reported.hits,
+                   _metrics.misses - _reported.misses,
+                   _metrics.filtered - _reported.filtered,
+                   _metrics.evictions - _reported.evictions};
+    _reported = _metrics;
+
+    if (!window.hits && !window.misses && !window.filtered)
+        return;
+
+    logger::info("profile_cache", {{"hit_rate", window.hit_rate()}, {"hits", window.hits}, {"misses", window.misses},
+                                   {"filtered", window.filtered}, {"evictions", window.evictions}, {"size", static_cast<qint64>(_entries.size())}});
+}
+
+void profile_cache::build_filter() {
+    qint64 bits = std::getenv("CHAT_APP_PROFILE_FILTER_BITS") ? std::atoll(std::getenv("CHAT_APP_PROFILE_FILTER_BITS")) : qint64(1) << 24;
+    _filter.assign(static_cast<size_t>(std::max<qint64>(64, bits) / 64), 0);
+
+    // A private filter of the same size is filled off the event loop, then
+    // merged; a scan that breaks off leaves the filter disabled for good
+    task_scheduler::instance().run(
+        task_scheduler::Bulk, this,
+        [&db = _db, words = _filter.size()]() {
+            std::vector<quint64> filter(words, 0);
+            qint64 accounts = 0;
+
+            bool complete = db.scan_ids("accounts", FilterScanBatch, [&](const QList<int> &ids) {
+                for (int phone_number : ids) {
+                    for (quint64 bit : filter_bits(phone_number, static_cast<quint64>(words) * 64))
+                        filter[bit / 64] |= quint64(1) << (bit % 64);
+                }
+
+                accounts += ids.size();
+                return true;
+            });
+
+            return std::make_pair(complete ? std::move(filter) : std::vector<quint64>(), accounts);
+        },
+        [this](std::pair<std::vector<quint64>, qint64> scanned) {
+            if (scanned.first.size() != _filter.size()) {
+                logger::warning("profile_filter_incomplete", {{"accounts", scanned.second}});
+                return;
+            }
+
+            for (size_t word = 0; word < _filter.size(); word++)
+                _filter[word] |= scanned.first[word];
+
+            _filter_enabled = true;
+            logger::info("profile_filter_built", {{"accounts", scanned.second}});
+        });
+}
+
+std::array<quint64, 4> profile_cache::filter_bits(const int &phone_number, quint64 size) {
+    // Double hashing over a splitmix64 of the number
+    quint64 x = static_cast<quint64>(static_cast<quint32>(phone_number)) + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+
+    quint64 h1 = x & 0xffffffff;
+    quint64 h2 = (x >> 32) | 1;
+
+    return {h1 % size, (h1 + h2) % size, (h1 + 2 * h2) % size, (h1 + 3 * h2) % size};
+}
+
+bool profile_cache::may_exist(const int &phone_number) const {
+    if (!_filter_enabled)
+        return true;
+
+    for (quint64 bit : filter_bits(phone_number, static_cast<quint64>(_filter.size()) * 64)) {
+        if (!(_filter[bit / 64] & (quint64(1) << (bit % 64))))
+            return false;
+    }
+
+    return true;
+}
+
+profile_cache::Profile &profile_cache::store(const Profile &profile) {
+    remove(profile.phone_number);
+
+    _entries.push_front(Entry{profile, _clock.elapsed()});
+    _index.insert(profile.phone_number, _entries.begin());
+
+    while (_entries.size() > static_cast<size_t>(_capacity)) {
+        _index.remove(_entries.back().profile.phone_number);
+        _entries.pop_back();
+        _metrics.evictions++;
+    }
+
+    // Registered even if the filter was built before this account existed
+    registered(profile.phone_number);
+
+    return _entries.front().profile;
+}
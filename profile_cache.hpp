@@ -0,0 +1,93 @@
+#pragma once
+
+#include "repository.hpp"
+#include <QElapsedTimer>
+#include <QTimer>
+#include <array>
+#include <list>
+#include <optional>
+#include <vector>
+
+// Bounded LRU of the public part of accounts (name, status, avatar), so
+// contact-info reads stop going to Mongo. A bloom filter of every account
+// number answers lookups of numbers that were never registered without a
+// query; it only gets false positives, which fall through to Mongo. It is
+// filled from a cursor on the Bulk lane and only consulted once complete. Entries
+// expire after CHAT_APP_PROFILE_TTL_MS to pick up writes from other nodes,
+// and the filter is bypassed when it cannot see every sign-up.
+class profile_cache : public QObject {
+    Q_OBJECT
+
+  public:
+    struct Profile {
+        int phone_number{0};
+        QString first_name{};
+        QString last_name{};
+        QString image_url{};
+        bool status{false};
+
+        // The contactInfo shape sent to clients
+        QJsonObject to_json() const;
+    };
+
+    struct Metrics {
+        qint64 hits{0};
+        qint64 misses{0};
+        qint64 filtered{0};
+        qint64 evictions{0};
+
+        double hit_rate() const;
+    };
+
+    // Fields read from accounts to build a Profile
+    static const QJsonObject fields;
+
+    profile_cache(Repository &db, bool complete_filter, QObject *parent = nullptr);
+
+    std::optional<Profile> find(const int &phone_number);
+
+    // Caches an account read elsewhere, e.g. by the login query
+    Profile insert(const QJsonObject &account);
+
+    // Patches a cached profile with the $set fields of an account write
+    void update(const int &phone_number, const QJsonObject &fields);
+    void remove(const int &phone_number);
+
+    // Marks a newly registered number in the filter
+    void registered(const int &phone_number);
+
+    Metrics metrics() const;
+
+  private slots:
+    void report();
+
+  private:
+    struct Entry {
+        Profile profile;
+        qint64 loaded;
+    };
+
+    Repository &_db;
+
+    std::list<Entry> _entries{};
+    QHash<int, std::list<Entry>::iterator> _index{};
+    qsizetype _capacity{100000};
+    qint64 _ttl{300000};
+
+    std::vector<quint64> _filter{};
+    bool _filter_enabled{false};
+
+    static constexpr int FilterScanBatch = 10000;
+
+    QElapsedTimer _clock{};
+    QTimer _report_timer{};
+
+    Metrics _metrics{};
+    Metrics _reported{};
+
+    void build_filter();
+    static std::array<quint64, 4> filter_bits(const int &phone_number, quint64 size);
+    bool may_exist(const int &phone_number) const;
+
+    Profile &store(const Profile &profile);
+};
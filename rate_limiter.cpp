@@ -0,0 +1,150 @@
+#include "rate_limiter.hpp"
+#include "logger.hpp"
+#include <QRegularExpression>
+#include <algorithm>
+#include <optional>
+
+namespace {
+constexpr std::array<const char *, rate_limiter::ScopeCount> scope_names{"connection", "account", "address"};
+}
+
+rate_limiter::rate_limiter(QObject *parent)
+    : QObject(parent) {
+    configure();
+
+    metrics::registry &registry = metrics::registry::instance();
+    for (int type = 0; type < message_dispatch::TypeCount; type++) {
+        for (int scope = 0; scope < ScopeCount; scope++) {
+            if (_limits[type][scope].tokens <= 0)
+                continue;
+
+            QString labels = QString("type=\"%1\",scope=\"%2\"").arg(QLatin1StringView(message_dispatch::names[type].data(), message_dispatch::names[type].size()), scope_names[scope]);
+            _shed[type][scope] = &registry.counter_of("chat_frames_rate_limited_total", "Frames shed by a rate limit", labels);
+        }
+    }
+
+    _clock.start();
+
+    connect(&_sweep_timer, &QTimer::timeout, this, &rate_limiter::sweep);
+    _sweep_timer.start(60000);
+}
+
+void rate_limiter::configure() {
+    const char *value = std::getenv("CHAT_APP_RATE_LIMITS");
+    if (!value) {
+        // Password guessing is bounded per target account across addresses,
+        // and per address across accounts
+        limit(message_dispatch::LoginRequest, Connection, 5, 60);
+        limit(message_dispatch::LoginRequest, Account, 10, 300);
+        limit(message_dispatch::LoginRequest, Address, 30, 60);
+        limit(message_dispatch::SignUp, Address, 10, 60);
+        limit(message_dispatch::RetrieveQuestion, Connection, 5, 60);
+        limit(message_dispatch::RetrieveQuestion, Address, 20, 60);
+        limit(message_dispatch::UpdatePassword, Account, 5, 300);
+        limit(message_dispatch::LookupFriend, Connection, 30, 60);
+        limit(message_dispatch::LookupFriend, Account, 60, 60);
+        limit(message_dispatch::Text, Account, 30, 1);
+        limit(message_dispatch::GroupText, Account, 20, 1);
+
+        return;
+    }
+
+    for (const QString &entry : QString(value).split(',', Qt::SkipEmptyParts)) {
+        // type:scope=tokens/seconds
+        QStringList parts = entry.trimmed().split(QRegularExpression("[:=/]"));
+
+        message_dispatch::MessageType type = parts.size() == 4 ? message_dispatch::type_of(parts[0].toStdString()) : message_dispatch::Unknown;
+        qsizetype scope = parts.size() == 4 ? std::find(scope_names.begin(), scope_names.end(), parts[1].toStdString()) - scope_names.begin() : ScopeCount;
+
+        if (type == message_dispatch::Unknown || scope == ScopeCount) {
+            logger::warning("rate_limit_ignored", {{"entry", entry}});
+            continue;
+        }
+
+        limit(type, static_cast<Scope>(scope), parts[2].toDouble(), parts[3].toDouble());
+    }
+}
+
+void rate_limiter::limit(message_dispatch::MessageType type, Scope scope, double tokens, double seconds) {
+    if (tokens <= 0 || seconds <= 0)
+        return;
+
+    _limits[type][scope] = Limit{tokens, tokens / (seconds * 1000)};
+}
+
+bool rate_limiter::allow(message_dispatch::MessageType type, const void *connection, int account_ID, const QHostAddress &address) {
+    const std::array<Limit, ScopeCount> &limits = _limits[type];
+    if (limits[Connection].tokens <= 0 && limits[Account].tokens <= 0 && limits[Address].tokens <= 0)
+        return true;
+
+    const qint64 now = _clock.elapsed();
+    const quint8 type_index = static_cast<quint8>(type);
+
+    // IPv4 comes back as ::ffff:a.b.c.d, so one layout covers both families
+    const Q_IPV6ADDR ip = address.toIPv6Address();
+    quint64 address_high = 0;
+    quint64 address_low = 0;
+    for (int byte = 0; byte < 8; byte++) {
+        address_high = (address_high << 8) | ip[byte];
+        address_low = (address_low << 8) | ip[byte + 8];
+    }
+
+    std::array<std::optional<Key>, ScopeCount> keys{};
+    keys[Connection] = Key{0, reinterpret_cast<quintptr>(connection), type_index, Connection};
+    if (account_ID != 0)
+        keys[Account] = Key{0, static_cast<quint64>(static_cast<quint32>(account_ID)), type_index, Account};
+    if (!address.isNull())
+        keys[Address] = Key{address_high, address_low, type_index, Address};
+
+    // Every scope is checked before any is charged, so a frame shed by one
+    // limit does not drain the buckets of the others
+    for (int scope = 0; scope < ScopeCount; scope++) {
+        if (limits[scope].tokens <= 0 || !keys[scope])
+            continue;
+
+        if (!refill(*keys[scope], limits[scope], now)) {
+            _shed[type][scope]->add();
+            return false;
+        }
+    }
+
+    for (int scope = 0; scope < ScopeCount; scope++) {
+        if (limits[scope].tokens > 0 && keys[scope])
+            _buckets.find(*keys[scope])->tokens -= 1;
+    }
+
+    return true;
+}
+
+bool rate_limiter::refill(const Key &key, const Limit &limit, qint64 now) {
+    auto it = _buckets.find(key);
+    if (it == _buckets.end())
+        it = _buckets.insert(key, Bucket{limit.tokens, now});
+
+    it->tokens = std::min(limit.tokens, it->tokens + static_cast<double>(now - it->updated) * limit.per_ms);
+    it->updated = now;
+
+    return it->tokens >= 1;
+}
+
+void rate_limiter::forget(const void *connection) {
+    const quint64 id = reinterpret_cast<quintptr>(connection);
+
+    for (int type = 0; type < message_dispatch::TypeCount; type++) {
+        if (_limits[type][Connection].tokens > 0)
+            _buckets.remove(Key{0, id, static_cast<quint8>(type), Connection});
+    }
+}
+
+qsizetype rate_limiter::buckets() const {
+    return _buckets.size();
+}
+
+void rate_limiter::sweep() {
+    const qint64 now = _clock.elapsed();
+
+    _buckets.removeIf([&](const QHash<Key, Bucket>::iterator &it) {
+        const Limit &limit = _limits[it.key().type][it.key().scope];
+        return it->tokens + static_cast<double>(now - it->updated) * limit.per_ms >= limit.tokens;
+    });
+}
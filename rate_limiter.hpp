@@ -0,0 +1,77 @@
+#pragma once
+
+#include "message_dispatch.hpp"
+#include "metrics.hpp"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QTimer>
+#include <array>
+
+// Token buckets per message type, kept separately per connection, per
+// account and per source address. A frame is admitted only if every bucket
+// its type is limited on still holds a token, and a shed frame takes none of
+// them. Addresses key on all 128 bits, IPv4 as mapped. The check runs on the type and
+// keys alone, before the frame body is decoded, so shedding a flood costs
+// about as much as reading its type. Idle buckets are swept once they have
+// refilled, which is when forgetting them changes nothing.
+//
+// CHAT_APP_RATE_LIMITS replaces the built-in limits with a comma separated
+// list of type:scope=tokens/seconds entries, scope being connection, account
+// or address, e.g. "login_request:address=30/60,text:account=20/1". A bucket
+// holds up to tokens and refills at tokens per seconds.
+class rate_limiter : public QObject {
+    Q_OBJECT
+
+  public:
+    enum Scope {
+        Connection,
+        Account,
+        Address,
+        ScopeCount
+    };
+
+    rate_limiter(QObject *parent = nullptr);
+
+    // account_ID is 0 when the frame cannot be tied to an account
+    bool allow(message_dispatch::MessageType type, const void *connection, int account_ID, const QHostAddress &address);
+
+    // Drops the buckets of a closed connection, whose address may be reused
+    void forget(const void *connection);
+
+    qsizetype buckets() const;
+
+  private:
+    struct Limit {
+        double tokens{0};
+        double per_ms{0};
+    };
+
+    struct Bucket {
+        double tokens;
+        qint64 updated;
+    };
+
+    // Connections and accounts only use low; an address fills both halves
+    struct Key {
+        quint64 high;
+        quint64 low;
+        quint8 type;
+        quint8 scope;
+
+        bool operator==(const Key &other) const = default;
+        friend size_t qHash(const Key &key, size_t seed = 0) { return qHashMulti(seed, key.high, key.low, key.type, key.scope); }
+    };
+
+    std::array<std::array<Limit, ScopeCount>, message_dispatch::TypeCount> _limits{};
+    std::array<std::array<metrics::counter *, ScopeCount>, message_dispatch::TypeCount> _shed{};
+
+    QHash<Key, Bucket> _buckets{};
+    QElapsedTimer _clock{};
+    QTimer _sweep_timer{};
+
+    void configure();
+    void limit(message_dispatch::MessageType type, Scope scope, double tokens, double seconds);
+    bool refill(const Key &key, const Limit &limit, qint64 now);
+    void sweep();
+};
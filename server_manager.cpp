@@ -1,22 +1,62 @@
 #include "server_manager.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
+#include <QCoreApplication>
+#include <QStringEncoder>
+
+namespace {
+
+struct frame_instruments {
+    metrics::counter *received;
+    metrics::histogram *queued;
+    metrics::histogram *handled;
+};
+
+const frame_instruments &instruments_of(message_dispatch::MessageType type) {
+    static const std::array<frame_instruments, message_dispatch::TypeCount> instruments = [] {
+        metrics::registry &registry = metrics::registry::instance();
+
+        std::array<frame_instruments, message_dispatch::TypeCount> table{};
+        for (int type = 0; type < message_dispatch::TypeCount; type++) {
+            QString labels = QString("type=\"%1\"").arg(QLatin1StringView(message_dispatch::names[type].data(), message_dispatch::names[type].size()));
+
+            table[type] = frame_instruments{&registry.counter_of("chat_frames_received_total", "Frames received per message type", labels),
+                                            &registry.histogram_of("chat_frame_queue_seconds", "Time a frame waited on its lane, sampled frames only", labels),
+                                            &registry.histogram_of("chat_frame_handler_seconds", "Time spent in the frame handler, sampled frames only", labels)};
+        }
+
+        return table;
+    }();
+
+    return instruments[type];
+}
+
+}
 
 server_manager::server_manager(QObject *parent)
     : QObject(parent) {
+    const bool secure = tls_config::requested();
+
     _server = new QWebSocketServer(QString("ChatApp Server"), QWebSocketServer::NonSecureMode, this);
     connect(_server, &QWebSocketServer::newConnection, this, &server_manager::on_new_connection);
 
-    map_initialization();
+    _typing = new typing_engine(this);
+    connect(_typing, &typing_engine::typing_changed, this, &server_manager::on_typing_changed);
 
-    static mongocxx::instance instance{};
-    static mongocxx::uri uri{std::getenv("MONGODB_URI")};
+    _heartbeat = new heartbeat(this);
+    _limiter = new rate_limiter(this);
 
-    static mongocxx::client connection{uri};
-    if (!connection) {
-        qDebug() << "DB initialization failed";
-        return;
+    _cluster = cluster_bus::create(this);
+    if (_cluster) {
+        connect(_cluster, &cluster_bus::frame_received, this, &server_manager::on_cluster_frame);
+        connect(_cluster, &cluster_bus::claim_lost, this, &server_manager::on_cluster_claim_lost);
     }
 
-    _chatAppDB = connection.database("chatAppDB");
+    _repository = Repository::create();
+
+    _unread = new unread_counters(*_repository, this);
+    _profiles = new profile_cache(*_repository, _cluster == nullptr, this);
 
     Aws::InitAPI(_options);
 
@@ -24,156 +64,355 @@ server_manager::server_manager(QObject *parent)
     Aws::Client::ClientConfiguration clientConfig;
     clientConfig.region = std::getenv("CHAT_APP_BUCKET_REGION");
 
-    _s3_client = std::make_shared<Aws::S3::S3Client>(credentials, clientConfig, Aws::Client::AWSAuthV4Signer::PayloadSigningPolicy::Never, true);
+    // A local S3 stand-in (e.g. MinIO) only serves path-style addressing
+    const char *endpoint = std::getenv("CHAT_APP_S3_ENDPOINT");
+    if (endpoint)
+        clientConfig.endpointOverride = endpoint;
+
+    _s3_client = std::make_shared<Aws::S3::S3Client>(credentials, clientConfig, Aws::Client::AWSAuthV4Signer::PayloadSigningPolicy::Never, endpoint == nullptr);
     if (!_s3_client) {
-        qDebug() << "S3Client initialization failed";
+        logger::error("s3_client_init_failed");
         return;
     }
 
-    _server->listen(_ip, _port);
-    qDebug() << "Server is running on port:" << _port;
+    _deletions = new deletion_jobs(*_repository, _s3_client, this);
+
+    register_metrics();
+    new metrics_endpoint(this);
+    _traffic = traffic_capture::create(this);
+
+    if (secure) {
+        // A certificate that fails to load must not fall back to plain ws://,
+        // nor leave a process running that serves nothing
+        QSslConfiguration tls;
+        if (!tls_config::load(tls)) {
+            QMetaObject::invokeMethod(QCoreApplication::instance(), []() { QCoreApplication::exit(1); }, Qt::QueuedConnection);
+            return;
+        }
+
+        _tls_server = new QSslServer(this);
+        _tls_server->setSslConfiguration(tls);
+
+        connect(_tls_server, &QSslServer::startedEncryptionHandshake, this, [](QSslSocket *socket) { tls_config::share_tickets(socket); });
+        connect(_tls_server, &QSslServer::pendingConnectionAvailable, this, [this]() {
+            while (QTcpSocket *socket = _tls_server->nextPendingConnection())
+                _server->handleConnection(socket);
+        });
+
+        // Only emitted while a socket is still handshaking
+        static metrics::counter &handshake_errors = metrics::registry::instance().counter_of("chat_tls_handshake_errors_total", "TLS handshakes that failed");
+        connect(_tls_server, &QSslServer::errorOccurred, this, [](QSslSocket *socket, QAbstractSocket::SocketError) {
+            handshake_errors.add();
+            logger::warning("tls_handshake_failed", {{"peer", socket->peerAddress().toString()}, {"error", socket->errorString()}});
+        });
+        connect(_tls_server, &QSslServer::handshakeInterruptedOnError, this, [](QSslSocket *socket, const QSslError &error) {
+            handshake_errors.add();
+            logger::warning("tls_handshake_failed", {{"peer", socket->peerAddress().toString()}, {"error", error.errorString()}});
+        });
+    }
+
+    // Same variable as the Go server, so several nodes can share a host
+    if (const char *port = std::getenv("CHAT_APP_SERVER_PORT"))
+        _port = std::atoi(port);
+
+    if (_tls_server)
+        _tls_server->listen(_ip, _port);
+    else
+        _server->listen(_ip, _port);
+
+    logger::info("server_listening", {{"port", _port}, {"tls", secure}});
 }
 
 server_manager::~server_manager() {
-    Aws::ShutdownAPI(_options);
+    if (_server)
+        Aws::ShutdownAPI(_options);
 }
 
 server_manager::server_manager(std::shared_ptr<QWebSocket> client, QObject *parent)
-    : QObject(parent), _socket(client) { connect(_socket.get(), &QWebSocket::textMessageReceived, this, &server_manager::on_text_message_received); }
+    : QObject(parent), _socket(client) {
+    connect(_socket.get(), &QWebSocket::textMessageReceived, this, &server_manager::on_text_message_received);
+    connect(_socket.get(), &QWebSocket::binaryMessageReceived, this, &server_manager::on_binary_message_received);
+}
+
+void *server_manager::operator new(std::size_t size) {
+    return size == sizeof(server_manager) ? slab_pool<server_manager>::instance().allocate() : ::operator new(size);
+}
+
+void server_manager::operator delete(void *pointer, std::size_t size) {
+    if (size == sizeof(server_manager))
+        slab_pool<server_manager>::instance().release(pointer);
+    else
+        ::operator delete(pointer);
+}
 
 void server_manager::on_new_connection() {
-    std::shared_ptr<QWebSocket> client(_server->nextPendingConnection());
+    // The socket goes once the session and _clients have both let go of it;
+    // deleteLater because the last reference may drop inside one of its signals
+    std::shared_ptr<QWebSocket> client(_server->nextPendingConnection(), [](QWebSocket *socket) { socket->deleteLater(); });
+    new outbound_queue(client.get());
+
+    // Qt would otherwise buffer a message of up to 2 GiB before handing it
+    // over; the default leaves room for a base64 upload
+    static const quint64 max_message_bytes = std::getenv("CHAT_APP_MAX_MESSAGE_BYTES") ? std::strtoull(std::getenv("CHAT_APP_MAX_MESSAGE_BYTES"), nullptr, 10) : 32 * 1024 * 1024;
+    client->setMaxAllowedIncomingMessageSize(max_message_bytes);
+    client->setMaxAllowedIncomingFrameSize(max_message_bytes);
 
     connect(client.get(), &QWebSocket::disconnected, this, &server_manager::on_client_disconnected);
+    _heartbeat->watch(client.get());
 
-    server_manager *server = new server_manager(client, this);
+    server_manager *session = new server_manager(client, this);
+    connect(client.get(), &QWebSocket::disconnected, session, [session]() { task_scheduler::instance().retire(session); });
 }
 
 void server_manager::on_client_disconnected() {
     QWebSocket *client = qobject_cast<QWebSocket *>(sender());
     if (client) {
+        _heartbeat->unwatch(client);
+        _limiter->forget(client);
+
+        if (_traffic)
+            _traffic->closed(client);
+
+        // The user may already be on a newer socket, here or on another node;
+        // then this one going away changes nothing they or their contacts see
         int id = client->property("id").toInt();
+        if (!id || _clients.value(id).get() != client)
+            return;
+
         _clients.remove(id);
 
-        qDebug() << "Client: " << id << " is disconnected";
+        if (_cluster && _cluster->owned_elsewhere(id))
+            return;
+
+        if (_cluster)
+            _cluster->release(id);
+
+        _unread->flush(id);
+
+        logger::info("client_disconnected", {{"id", id}});
 
         QJsonObject filter_object{{"_id", id}};
         QJsonObject update_field{{"$set", QJsonObject{{"status", false}}}};
-        Account::update_document(_chatAppDB, "accounts", filter_object, update_field);
+        _repository->update_document("accounts", filter_object, update_field);
+        _profiles->update(id, QJsonObject{{"status", false}});
 
-        QJsonArray contactIDs = Account::fetch_contactIDs(_chatAppDB, id);
+        QJsonArray contactIDs = _repository->fetch_contactIDs(id);
         for (const QJsonValue &ID : contactIDs) {
-            std::shared_ptr<QWebSocket> client = _clients.value(ID.toInt());
-            if (client) {
+            if (is_online(ID.toInt())) {
                 QJsonObject message{{"type", "client_disconnected"},
                                     {"phone_number", id}};
 
-                client->sendTextMessage(QString::fromUtf8(QJsonDocument(message).toJson()));
+                deliver(ID.toInt(), message, outbound_queue::Presence);
             }
         }
     }
 }
 
-void server_manager::sign_up(const int &phone_number, const QString &first_name, const QString &last_name, const QString &password, const QString &secret_question, const QString &secret_answer) {
-    const QString &hashed_password = QString::fromStdString(Security::hashing_password(password.toStdString()));
+void server_manager::send_message(const std::shared_ptr<QWebSocket> &client, const QJsonObject &message, outbound_queue::FrameKind kind, const QString &coalesce_key) {
+    if (_captured && client.get() == _capture_socket) {
+        _captured->append(message);
+        return;
+    }
+
+    send_frame(client, QString::fromUtf8(QJsonDocument(message).toJson()), kind, coalesce_key);
+}
+
+void server_manager::send_frame(const std::shared_ptr<QWebSocket> &client, const QString &frame, outbound_queue::FrameKind kind, const QString &coalesce_key) {
+    outbound_queue *queue = outbound_queue::of(client.get());
+    if (queue)
+        queue->send(frame, kind, coalesce_key);
+    else
+        client->sendTextMessage(frame);
+}
+
+void server_manager::deliver(const int &user_ID, const QJsonObject &message, outbound_queue::FrameKind kind, const QString &coalesce_key) {
+    if (_held) {
+        _held->append([user_ID, message, kind, coalesce_key]() { deliver(user_ID, message, kind, coalesce_key); });
+        return;
+    }
 
-    QJsonObject json_object{{"_id", phone_number},
-                            {"first_name", first_name},
-                            {"last_name", last_name},
-                            {"image_url", QString()},
-                            {"status", false},
-                            {"hashed_password", hashed_password},
-                            {"secret_question", secret_question},
-                            {"secret_answer", secret_answer},
-                            {"contacts", QJsonArray{}},
-                            {"groups", QJsonArray{}}};
+    tracing::span span("deliver");
 
-    bool succeeded_or_failed = Account::insert_document(_chatAppDB, "accounts", json_object);
+    std::shared_ptr<QWebSocket> client = _clients.value(user_ID);
+    if (client) {
+        send_message(client, message, kind, coalesce_key);
+        return;
+    }
+
+    if (_cluster && _cluster->owned_elsewhere(user_ID))
+        _cluster->forward(user_ID, QString::fromUtf8(QJsonDocument(message).toJson()), kind, coalesce_key);
+}
 
-    QJsonObject response_object{{"type", "sign_up"},
-                                {"status", succeeded_or_failed},
-                                {"message", succeeded_or_failed ? "Account Created Successfully, Reconnect" : "Failed to Create Account, try again"}};
+void server_manager::count_unread(int account_ID, int conversation_ID, bool group) {
+    if (_held) {
+        _held->append([account_ID, conversation_ID, group]() { _unread->increment(account_ID, conversation_ID, group); });
+        return;
+    }
 
-    QJsonDocument response_doc(response_object);
+    _unread->increment(account_ID, conversation_ID, group);
+}
 
-    _socket->sendTextMessage(QString::fromUtf8(response_doc.toJson()));
+bool server_manager::is_online(const int &user_ID) {
+    return _clients.contains(user_ID) || (_cluster && _cluster->owned_elsewhere(user_ID));
+}
+
+void server_manager::on_cluster_frame(int user_ID, const QString &frame, int kind, const QString &coalesce_key) {
+    std::shared_ptr<QWebSocket> client = _clients.value(user_ID);
+    if (client)
+        send_frame(client, frame, static_cast<outbound_queue::FrameKind>(kind), coalesce_key);
+}
+
+void server_manager::on_cluster_claim_lost(int user_ID) {
+    std::shared_ptr<QWebSocket> client = _clients.take(user_ID);
+    if (!client)
+        return;
+
+    // Deliveries now go to the other node; the session here is stale
+    logger::info("client_moved", {{"id", user_ID}, {"node", _cluster->owner_of(user_ID)}});
+    QMetaObject::invokeMethod(client.get(), [client]() { client->close(QWebSocketProtocol::CloseCodeNormal, "Logged in elsewhere"); }, Qt::QueuedConnection);
+}
+
+void server_manager::upload_to_s3(const QString &file_name, QByteArrayView data, std::function<void(const QString &url)> done) {
+    // Stored under the uploader, which is what deletion_jobs checks before removing it
+    std::string key = S3::owned_key(_account_ID, file_name).toStdString();
+
+    task_scheduler::instance().run(
+        task_scheduler::Bulk, this,
+        [key = std::move(key), data = data.toByteArray()]() {
+            QByteArray decoded_data;
+            {
+                tracing::span decode_span("base64_decode");
+                decoded_data = QByteArray::fromBase64(data);
+            }
+
+            return S3::store_data_to_s3(*_s3_client, key, decoded_data.toStdString());
+        },
+        [done = std::move(done)](const std::string &url) { done(QString::fromStdString(url)); });
+}
+
+void server_manager::sign_up(const int &phone_number, const QString &first_name, const QString &last_name, const QString &password, const QString &secret_question, const QString &secret_answer) {
+    task_scheduler::instance().run(
+        task_scheduler::Control, this,
+        [password = password.toStdString()]() { return Security::hashing_password(password); },
+        [=, this](const std::string &hash) {
+            QJsonObject json_object{{"_id", phone_number},
+                                    {"first_name", first_name},
+                                    {"last_name", last_name},
+                                    {"image_url", QString()},
+                                    {"status", false},
+                                    {"hashed_password", QString::fromStdString(hash)},
+                                    {"secret_question", secret_question},
+                                    {"secret_answer", secret_answer},
+                                    {"created", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+                                    {"contacts", QJsonArray{}},
+                                    {"groups", QJsonArray{}}};
+
+            bool succeeded_or_failed = _repository->insert_document("accounts", json_object);
+            if (succeeded_or_failed)
+                _profiles->registered(phone_number);
+
+            QJsonObject response_object{{"type", "sign_up"},
+                                        {"status", succeeded_or_failed},
+                                        {"message", succeeded_or_failed ? "Account Created Successfully, Reconnect" : "Failed to Create Account, try again"}};
+
+            send_message(_socket, response_object);
+        });
 }
 
 void server_manager::login_request(const int &phone_number, const QString &password, const QString &time_zone) {
     if (!phone_number)
         return;
 
+    // The hash, the public profile and the lists clients read from my_info;
+    // the secrets stay on the server
+    QJsonObject fields = profile_cache::fields;
+    fields["hashed_password"] = 1;
+    fields["contacts"] = 1;
+    fields["groups"] = 1;
+
     QJsonObject filter_object{{"_id", phone_number}};
-    QJsonDocument json_doc = Account::find_document(_chatAppDB, "accounts", filter_object);
+    QJsonDocument json_doc = _repository->find_document("accounts", filter_object, fields);
 
     if (json_doc.isEmpty()) {
         QJsonObject json_message{{"type", "login_request"},
                                  {"status", false},
                                  {"message", "Account Doesn't exist in our Database, verify and try again"}};
 
-        QJsonDocument json_doc(json_message);
-
-        _socket->sendTextMessage(QString::fromUtf8(json_doc.toJson()));
+        send_message(_socket, json_message);
 
         return;
     }
 
-    if (!Security::verifying_password(password.toStdString(), json_doc.object()["hashed_password"].toString().toStdString())) {
-        QJsonObject json_message{{"type", "login_request"},
-                                 {"status", false},
-                                 {"message", "Password Incorrect"}};
+    task_scheduler::instance().run(
+        task_scheduler::Control, this,
+        [password = password.toStdString(), hashed_password = json_doc.object()["hashed_password"].toString().toStdString()]() { return Security::verifying_password(password, hashed_password); },
+        [this, phone_number, json_doc](bool verified) {
+            if (!verified) {
+                QJsonObject json_message{{"type", "login_request"},
+                                         {"status", false},
+                                         {"message", "Password Incorrect"}};
+
+                send_message(_socket, json_message);
 
-        QJsonDocument json_doc(json_message);
+                return;
+            }
 
-        _socket->sendTextMessage(QString::fromUtf8(json_doc.toJson()));
+            QJsonObject account = json_doc.object();
+            QJsonObject my_info = _profiles->insert(account).to_json();
+            my_info["contacts"] = account["contacts"].toArray();
+            my_info["groups"] = account["groups"].toArray();
 
-        return;
-    }
+            login_succeeded(phone_number, my_info);
+        });
+}
 
-    qDebug() << "Client: " << phone_number << " is connected";
+void server_manager::login_succeeded(const int &phone_number, const QJsonObject &my_info) {
+    QJsonObject filter_object{{"_id", phone_number}};
+
+    logger::info("client_connected", {{"id", phone_number}});
 
     _clients.insert(phone_number, _socket);
     _socket->setProperty("id", phone_number);
 
+    if (_cluster)
+        _cluster->claim(phone_number);
+
     QJsonObject update_field{{"$set", QJsonObject{{"status", true}}}};
-    Account::update_document(_chatAppDB, "accounts", filter_object, update_field);
+    _repository->update_document("accounts", filter_object, update_field);
+    _profiles->update(phone_number, QJsonObject{{"status", true}});
 
-    QJsonDocument contacts = Account::fetch_contacts_and_chats(_chatAppDB, phone_number);
-    QJsonDocument groups = Account::fetch_groups_and_chats(_chatAppDB, phone_number);
+    _unread->flush(phone_number);
 
-    QJsonObject message{{"type", "login_request"},
-                        {"status", true},
-                        {"message", "loading your data..."},
-                        {"my_info", json_doc.object()},
-                        {"contacts", QJsonValue::fromVariant(contacts.toVariant())},
-                        {"groups", QJsonValue::fromVariant(groups.toVariant())}};
+    login_stream *stream = new login_stream(_socket.get(), *_repository, phone_number, [](int user_ID) { return is_online(user_ID); });
+    stream->start(my_info);
 
-    _socket->sendTextMessage(QString::fromUtf8(QJsonDocument(message).toJson()));
+    // Sample logins to catch inboxes that drifted from the source collections
+    static const double inbox_check_rate = std::getenv("CHAT_APP_INBOX_CHECK_RATE") ? std::atof(std::getenv("CHAT_APP_INBOX_CHECK_RATE")) : 0.01;
+    if (QRandomGenerator::global()->generateDouble() < inbox_check_rate)
+        task_scheduler::instance().post(task_scheduler::Bulk, this, [phone_number]() { _repository->check_inbox(phone_number); });
 
-    QJsonArray contactIDs = Account::fetch_contactIDs(_chatAppDB, phone_number);
+    QJsonArray contactIDs = _repository->fetch_contactIDs(phone_number);
     for (const QJsonValue &ID : contactIDs) {
-        std::shared_ptr<QWebSocket> client = _clients.value(ID.toInt());
-        if (client) {
+        if (is_online(ID.toInt())) {
             QJsonObject message{{"type", "client_connected"},
                                 {"phone_number", phone_number}};
 
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message).toJson()));
+            deliver(ID.toInt(), message, outbound_queue::Presence);
         }
     }
 }
 
 void server_manager::lookup_friend(const int &phone_number) {
     QJsonObject filter_object{{"_id", phone_number}};
-    QJsonObject field{{"first_name", 1}};
 
     // Check if the account exists in the database
-    QJsonDocument check_up = Account::find_document(_chatAppDB, "accounts", filter_object, field);
-    if (check_up.isEmpty()) {
+    std::optional<profile_cache::Profile> friend_profile = _profiles->find(phone_number);
+    if (!friend_profile) {
         QJsonObject message{{"type", "lookup_friend"},
                             {"status", "failed"},
                             {"message", "The Account: " + QString::number(phone_number) + " doesn't exist in our Database"}};
 
-        _socket->sendTextMessage(QString::fromUtf8(QJsonDocument(message).toJson()));
+        send_message(_socket, message);
         return;
     }
 
@@ -184,13 +423,13 @@ void server_manager::lookup_friend(const int &phone_number) {
     int chatID = distribution(generator);
 
     // Add friend to the user's contact list
-    if (_clients.key(_socket) != phone_number) // Check to avoid adding the user to their own contact list
+    if (_account_ID != phone_number) // Check to avoid adding the user to their own contact list
     {
-        QJsonObject push_object{{"contacts", QJsonObject{{"contactID", _clients.key(_socket)},
+        QJsonObject push_object{{"contacts", QJsonObject{{"contactID", _account_ID},
                                                          {"chatID", chatID},
                                                          {"unread_messages", 1}}}};
         QJsonObject update_object{{"$push", push_object}};
-        Account::update_document(_chatAppDB, "accounts", filter_object, update_object);
+        _repository->update_document("accounts", filter_object, update_object);
     }
 
     // Prepare and insert the first message into the new chat
@@ -202,21 +441,17 @@ void server_manager::lookup_friend(const int &phone_number) {
 
     QJsonObject insert_object{{"_id", chatID},
                               {"messages", messages_array}};
-    Account::insert_document(_chatAppDB, "chats", insert_object);
+    _repository->insert_document("chats", insert_object);
 
     // Fetch contact info and send a message to the friend (if online)
-    QJsonObject fields{{"_id", 1},
-                       {"status", 1},
-                       {"first_name", 1},
-                       {"last_name", 1},
-                       {"image_url", 1}};
-    std::shared_ptr<QWebSocket> client = _clients.value(phone_number);
-    if (client) {
-        filter_object[QStringLiteral("_id")] = _clients.key(_socket);
+    filter_object[QStringLiteral("_id")] = _account_ID;
+    QJsonObject contact_info = _profiles->find(_account_ID).value_or(profile_cache::Profile{}).to_json();
 
-        QJsonDocument contact_info = Account::find_document(_chatAppDB, "accounts", filter_object, fields);
+    if (_account_ID != phone_number)
+        _repository->add_contact(phone_number, contact_info, chatID, first_message);
 
-        QJsonObject obj1{{"contactInfo", contact_info.object()},
+    if (is_online(phone_number)) {
+        QJsonObject obj1{{"contactInfo", contact_info},
                          {"chatMessages", messages_array},
                          {"chatID", chatID}};
 
@@ -227,24 +462,25 @@ void server_manager::lookup_friend(const int &phone_number) {
                             {"message", _socket->property("id").toString() + " added You as Friend"},
                             {"json_array", json_array}};
 
-        client->sendTextMessage(QString::fromUtf8(QJsonDocument(message).toJson()));
+        deliver(phone_number, message);
     }
 
     // Add the user to the friend's contact list if they're not the same user
-    if (_clients.key(_socket) != phone_number) {
+    if (_account_ID != phone_number) {
         QJsonObject push_object{{"contacts", QJsonObject{{"contactID", phone_number},
                                                          {"chatID", chatID},
                                                          {"unread_messages", 1}}}};
         QJsonObject update_object{{"$push", push_object}};
-        Account::update_document(_chatAppDB, "accounts", filter_object, update_object);
+        _repository->update_document("accounts", filter_object, update_object);
     }
 
-    // Fetch contact info and send a success message to the user
-    filter_object[QStringLiteral("_id")] = phone_number;
+    // Send a success message to the user
+    QJsonObject contact_info2 = friend_profile->to_json();
 
-    QJsonDocument contact_info2 = Account::find_document(_chatAppDB, "accounts", filter_object, fields);
+    if (_account_ID != phone_number)
+        _repository->add_contact(_account_ID, contact_info2, chatID, first_message);
 
-    QJsonObject obj2{{"contactInfo", contact_info2.object()},
+    QJsonObject obj2{{"contactInfo", contact_info2},
                      {"chatMessages", messages_array},
                      {"chatID", chatID}};
 
@@ -253,76 +489,73 @@ void server_manager::lookup_friend(const int &phone_number) {
 
     QJsonObject message2{{"type", "lookup_friend"},
                          {"status", "succeeded"},
-                         {"message", QString::number(phone_number) + " also known as " + check_up.object()["first_name"].toString() + " is now Your friend"},
+                         {"message", QString::number(phone_number) + " also known as " + friend_profile->first_name + " is now Your friend"},
                          {"json_array", json_array2}};
 
-    _socket->sendTextMessage(QString::fromUtf8(QJsonDocument(message2).toJson()));
+    send_message(_socket, message2);
 }
 
-void server_manager::profile_image(const QString &file_name, const QString &data) {
-    QByteArray decoded_data = QByteArray::fromBase64(data.toUtf8());
-    std::string decoded_string = decoded_data.toStdString();
+void server_manager::profile_image(const QString &file_name, QByteArrayView data) {
+    int sender_ID = _account_ID;
 
-    std::string presigned_url = S3::store_data_to_s3(*_s3_client, file_name.toStdString(), decoded_string);
+    upload_to_s3(file_name, data, [=, this](const QString &presigned_url) {
+        QJsonObject filter_object{{"_id", sender_ID}};
+        QJsonObject update_field{{"$set", QJsonObject{{"image_url", presigned_url}}}};
+        _repository->update_document("accounts", filter_object, update_field);
+        _repository->update_contact(sender_ID, QJsonObject{{"image_url", presigned_url}});
+        _profiles->update(sender_ID, QJsonObject{{"image_url", presigned_url}});
 
-    QJsonObject filter_object{{"_id", _clients.key(_socket)}};
-    QJsonObject update_field{{"$set", QJsonObject{{"image_url", QString::fromStdString(presigned_url)}}}};
-    Account::update_document(_chatAppDB, "accounts", filter_object, update_field);
+        QJsonObject message1{{"type", "profile_image"},
+                             {"image_url", presigned_url}};
 
-    QJsonObject message1{{"type", "profile_image"},
-                         {"image_url", QString::fromStdString(presigned_url)}};
+        send_message(_socket, message1);
 
-    _socket->sendTextMessage(QString::fromUtf8(QJsonDocument(message1).toJson()));
-
-    QJsonArray contactIDs = Account::fetch_contactIDs(_chatAppDB, _clients.key(_socket));
-    for (const QJsonValue &ID : contactIDs) {
-        std::shared_ptr<QWebSocket> client = _clients.value(ID.toInt());
-        if (client) {
-            QJsonObject message2{{"type", "client_profile_image"},
-                                 {"phone_number", _clients.key(_socket)},
-                                 {"image_url", QString::fromStdString(presigned_url)}};
+        QJsonArray contactIDs = _repository->fetch_contactIDs(sender_ID);
+        for (const QJsonValue &ID : contactIDs) {
+            if (is_online(ID.toInt())) {
+                QJsonObject message2{{"type", "client_profile_image"},
+                                     {"phone_number", sender_ID},
+                                     {"image_url", presigned_url}};
 
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message2).toJson()));
-        };
-    }
+                deliver(ID.toInt(), message2);
+            };
+        }
+    });
 }
 
-void server_manager::group_profile_image(const int &group_ID, const QString &file_name, const QString &data) {
-    QByteArray decoded_data = QByteArray::fromBase64(data.toUtf8());
-    std::string decoded_string = decoded_data.toStdString();
-
-    std::string url = S3::store_data_to_s3(*_s3_client, file_name.toStdString(), decoded_string);
+void server_manager::group_profile_image(const int &group_ID, const QString &file_name, QByteArrayView data) {
+    upload_to_s3(file_name, data, [=, this](const QString &url) {
+        QJsonObject filter_object{{"_id", group_ID}};
+        QJsonObject update_field{{"$set", QJsonObject{{"group_image_url", url}}}};
+        _repository->update_document("groups", filter_object, update_field);
+        _repository->update_group(group_ID, QJsonObject{{"group_image_url", url}});
 
-    QJsonObject filter_object{{"_id", group_ID}};
-    QJsonObject update_field{{"$set", QJsonObject{{"group_image_url", QString::fromStdString(url)}}}};
-    Account::update_document(_chatAppDB, "groups", filter_object, update_field);
+        QJsonObject message{{"type", "group_profile_image"},
+                            {"groupID", group_ID},
+                            {"group_image_url", url}};
 
-    QJsonObject message{{"type", "group_profile_image"},
-                        {"groupID", group_ID},
-                        {"group_image_url", QString::fromStdString(url)}};
-
-    QJsonDocument json_doc = Account::find_document(_chatAppDB, "groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
-    for (const QJsonValue &phone_number : json_doc.object().value("group_members").toArray()) {
-        std::shared_ptr<QWebSocket> client = _clients.value(phone_number.toInt());
-        if (client)
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message).toJson()));
-    }
+        QJsonDocument json_doc = _repository->find_document("groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
+        for (const QJsonValue &phone_number : json_doc.object().value("group_members").toArray()) {
+            deliver(phone_number.toInt(), message);
+        }
+    });
 }
 
 void server_manager::profile_image_deleted() {
-    QJsonObject filter_object{{"_id", _clients.key(_socket)}};
+    QJsonObject filter_object{{"_id", _account_ID}};
     QJsonObject update_field{{"$set", QJsonObject{{"image_url", QString(std::getenv("AWS_LINK")) + "contact.png"}}}};
-    Account::update_document(_chatAppDB, "accounts", filter_object, update_field);
+    _repository->update_document("accounts", filter_object, update_field);
+    _repository->update_contact(_account_ID, QJsonObject{{"image_url", QString(std::getenv("AWS_LINK")) + "contact.png"}});
+    _profiles->update(_account_ID, QJsonObject{{"image_url", QString(std::getenv("AWS_LINK")) + "contact.png"}});
 
-    QJsonArray contactIDs = Account::fetch_contactIDs(_chatAppDB, _clients.key(_socket));
+    QJsonArray contactIDs = _repository->fetch_contactIDs(_account_ID);
     for (const QJsonValue &ID : contactIDs) {
-        std::shared_ptr<QWebSocket> client = _clients.value(ID.toInt());
-        if (client) {
+        if (is_online(ID.toInt())) {
             QJsonObject message2{{"type", "client_profile_image"},
-                                 {"phone_number", _clients.key(_socket)},
+                                 {"phone_number", _account_ID},
                                  {"image_url", QString(std::getenv("AWS_LINK")) + "contact.png"}};
 
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message2).toJson()));
+            deliver(ID.toInt(), message2);
         };
     }
 }
@@ -330,29 +563,27 @@ void server_manager::profile_image_deleted() {
 void server_manager::text_received(const int &receiver, const QString &message, const QString &time, const int &chat_ID) {
     QJsonObject message_obj{{"type", "text"},
                             {"chatID", chat_ID},
-                            {"sender_ID", _clients.key(_socket)},
+                            {"sender_ID", _account_ID},
                             {"message", message},
                             {"time", time}};
 
-    _socket->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+    send_message(_socket, message_obj);
 
-    std::shared_ptr<QWebSocket> client = _clients.value(receiver);
-    if (client)
-        client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+    deliver(receiver, message_obj);
 
     QJsonObject filter_object{{"_id", chat_ID}};
 
-    QJsonObject push_object{{"messages", QJsonObject{{"message", message},
-                                                     {"sender", _clients.key(_socket)},
-                                                     {"time", time}}}};
+    QJsonObject chat_message{{"message", message},
+                             {"sender", _account_ID},
+                             {"time", time}};
 
-    QJsonObject update_object{{"$push", push_object}};
-    Account::update_document(_chatAppDB, "chats", filter_object, update_object);
+    QJsonObject push_object{{"messages", chat_message}};
 
-    QJsonObject filter_object2{{"_id", receiver}, {"contacts.chatID", chat_ID}};
-    QJsonObject increment_object{{"$inc", QJsonObject{{"contacts.$.unread_messages", 1}}}};
+    QJsonObject update_object{{"$push", push_object}};
+    _repository->update_document("chats", filter_object, update_object);
+    _repository->set_last_message(chat_ID, chat_message);
 
-    Account::update_document(_chatAppDB, "accounts", filter_object2, increment_object);
+    count_unread(receiver, chat_ID, false);
 }
 
 void server_manager::new_group(const QString &group_name, QJsonArray group_members) {
@@ -371,24 +602,23 @@ void server_manager::new_group(const QString &group_name, QJsonArray group_membe
 
     QJsonObject new_group{{"_id", groupID},
                           {"group_name", group_name},
-                          {"group_admin", _clients.key(_socket)},
+                          {"group_admin", _account_ID},
                           {"group_image_url", QString(std::getenv("AWS_LINK")) + "networking.png"},
                           {"group_members", group_members},
                           {"group_messages", messages_array}};
-    Account::insert_document(_chatAppDB, "groups", new_group);
+    _repository->insert_document("groups", new_group);
+    _repository->add_group(group_members, new_group);
 
     QJsonObject push_object{{"groups", QJsonObject{{"groupID", groupID},
                                                    {"group_unread_messages", 1}}}};
     QJsonObject update_object{{"$push", push_object}};
-    for (const QJsonValue &phone_number : group_members) {
-        QJsonObject filter_object{{"_id", phone_number.toInt()}};
-        Account::update_document(_chatAppDB, "accounts", filter_object, update_object);
+    _repository->update_many("accounts", QJsonObject{{"_id", QJsonObject{{"$in", group_members}}}}, update_object);
 
-        std::shared_ptr<QWebSocket> client = _clients.value(phone_number.toInt());
-        if (client) {
+    for (const QJsonValue &phone_number : group_members) {
+        if (is_online(phone_number.toInt())) {
             QJsonObject group_info{{"_id", groupID},
                                    {"group_name", group_name},
-                                   {"group_admin", _clients.key(_socket)},
+                                   {"group_admin", _account_ID},
                                    {"group_messages", messages_array},
                                    {"group_members", group_members},
                                    {"group_image_url", QString(std::getenv("AWS_LINK")) + "networking.png"},
@@ -403,7 +633,7 @@ void server_manager::new_group(const QString &group_name, QJsonArray group_membe
                                  {"message", notification},
                                  {"groups", groups}};
 
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message1).toJson()));
+            deliver(phone_number.toInt(), message1);
         }
     }
 }
@@ -413,168 +643,176 @@ void server_manager::group_text_received(const int &groupID, QString sender_name
 
     QJsonObject message_obj{{"type", "group_text"},
                             {"groupID", groupID},
-                            {"sender_ID", _clients.key(_socket)},
+                            {"sender_ID", _account_ID},
                             {"sender_name", sender_name},
                             {"message", message},
                             {"time", time}};
 
-    QJsonObject increment_object{{"$inc", QJsonObject{{"groups.$.group_unread_messages", 1}}}};
-
-    QJsonDocument json_doc = Account::find_document(_chatAppDB, "groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
+    QJsonDocument json_doc = _repository->find_document("groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
     for (const QJsonValue &phone_number : json_doc.object().value("group_members").toArray()) {
-        QJsonObject account_filter{{"_id", phone_number.toInt()}, {"groups.groupID", groupID}};
-        Account::update_document(_chatAppDB, "accounts", account_filter, increment_object);
+        count_unread(phone_number.toInt(), groupID, true);
 
-        std::shared_ptr<QWebSocket> client = _clients.value(phone_number.toInt());
-        if (client)
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+        deliver(phone_number.toInt(), message_obj);
     }
 
-    QJsonObject push_object{{"group_messages", QJsonObject{{"message", message},
-                                                           {"sender_ID", _clients.key(_socket)},
-                                                           {"sender_name", sender_name},
-                                                           {"time", time}}}};
+    QJsonObject group_message{{"message", message},
+                              {"sender_ID", _account_ID},
+                              {"sender_name", sender_name},
+                              {"time", time}};
+
+    QJsonObject push_object{{"group_messages", group_message}};
 
     QJsonObject update_object{{"$push", push_object}};
-    Account::update_document(_chatAppDB, "groups", filter_object, update_object);
+    _repository->update_document("groups", filter_object, update_object);
+    _repository->set_group_last_message(groupID, group_message);
 }
 
-void server_manager::file_received(const int &chatID, const int &receiver, const QString &file_name, const QString &file_data, const QString &time) {
-    QByteArray decoded_data = QByteArray::fromBase64(file_data.toUtf8());
-    std::string decoded_string = decoded_data.toStdString();
+void server_manager::file_received(const int &chatID, const int &receiver, const QString &file_name, QByteArrayView file_data, const QString &time) {
+    int sender_ID = _account_ID;
 
-    std::string file_url = S3::store_data_to_s3(*_s3_client, file_name.toStdString(), decoded_string);
+    upload_to_s3(file_name, file_data, [=, this](const QString &file_url) {
+        QJsonObject message_obj{{"type", "file"},
+                                {"chatID", chatID},
+                                {"sender_ID", sender_ID},
+                                {"file_url", file_url},
+                                {"time", time}};
+        deliver(receiver, message_obj);
 
-    QJsonObject message_obj{{"type", "file"},
-                            {"chatID", chatID},
-                            {"sender_ID", _clients.key(_socket)},
-                            {"file_url", QString::fromStdString(file_url)},
-                            {"time", time}};
-    std::shared_ptr<QWebSocket> client = _clients.value(receiver);
-    if (client)
-        client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
-
-    _socket->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+        send_message(_socket, message_obj);
 
-    QJsonObject filter_object{{"_id", chatID}};
+        QJsonObject filter_object{{"_id", chatID}};
 
-    QJsonObject push_field{{"file_url", QString::fromStdString(file_url)},
-                           {"sender", _clients.key(_socket)},
-                           {"time", time}};
-    QJsonObject push_object{{"messages", push_field}};
-
-    QJsonObject update_object{{"$push", push_object}};
+        QJsonObject push_field{{"file_url", file_url},
+                               {"sender", sender_ID},
+                               {"time", time}};
+        QJsonObject push_object{{"messages", push_field}};
 
-    Account::update_document(_chatAppDB, "chats", filter_object, update_object);
+        QJsonObject update_object{{"$push", push_object}};
 
-    QJsonObject account_filter{{"_id", receiver}, {"contacts.chatID", chatID}};
-    QJsonObject increment_object{{"$inc", QJsonObject{{"contacts.$.unread_messages", 1}}}};
+        _repository->update_document("chats", filter_object, update_object);
+        _repository->set_last_message(chatID, push_field);
 
-    Account::update_document(_chatAppDB, "accounts", account_filter, increment_object);
+        count_unread(receiver, chatID, false);
+    });
 }
 
-void server_manager::group_file_received(const int &groupID, const QString &sender_name, const QString &file_name, const QString &file_data, const QString &time) {
-    QByteArray decoded_data = QByteArray::fromBase64(file_data.toUtf8());
-    std::string decoded_string = decoded_data.toStdString();
-
-    std::string file_url = S3::store_data_to_s3(*_s3_client, file_name.toStdString(), decoded_string);
+void server_manager::group_file_received(const int &groupID, const QString &sender_name, const QString &file_name, QByteArrayView file_data, const QString &time) {
+    int sender_ID = _account_ID;
 
-    QJsonObject filter_object{{"_id", groupID}};
+    upload_to_s3(file_name, file_data, [=, this](const QString &file_url) {
+        QJsonObject filter_object{{"_id", groupID}};
 
-    QJsonObject message_obj{{"type", "group_file"},
-                            {"groupID", groupID},
-                            {"sender_ID", _clients.key(_socket)},
-                            {"sender_name", sender_name},
-                            {"file_url", QString::fromStdString(file_url)},
-                            {"time", time}};
+        QJsonObject message_obj{{"type", "group_file"},
+                                {"groupID", groupID},
+                                {"sender_ID", sender_ID},
+                                {"sender_name", sender_name},
+                                {"file_url", file_url},
+                                {"time", time}};
 
-    QJsonObject increment_object{{"$inc", QJsonObject{{"groups.$.group_unread_messages", 1}}}};
+        QJsonDocument json_doc = _repository->find_document("groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
+        for (const QJsonValue &phone_number : json_doc.object().value("group_members").toArray()) {
+            deliver(phone_number.toInt(), message_obj);
+        }
 
-    QJsonDocument json_doc = Account::find_document(_chatAppDB, "groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
-    for (const QJsonValue &phone_number : json_doc.object().value("group_members").toArray()) {
-        std::shared_ptr<QWebSocket> client = _clients.value(phone_number.toInt());
-        if (client)
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
-    }
+        QJsonObject group_message{{"file_url", file_url},
+                                  {"sender_ID", sender_ID},
+                                  {"sender_name", sender_name},
+                                  {"time", time}};
 
-    QJsonObject push_object{{"group_messages", QJsonObject{{"file_url", QString::fromStdString(file_url)},
-                                                           {"sender_ID", _clients.key(_socket)},
-                                                           {"sender_name", sender_name},
-                                                           {"time", time}}}};
+        QJsonObject push_object{{"group_messages", group_message}};
 
-    QJsonObject update_object{{"$push", push_object}};
-    Account::update_document(_chatAppDB, "groups", filter_object, update_object);
+        QJsonObject update_object{{"$push", push_object}};
+        _repository->update_document("groups", filter_object, update_object);
+        _repository->set_group_last_message(groupID, group_message);
+    });
 }
 
 void server_manager::is_typing_received(const int &receiver) {
-    std::shared_ptr<QWebSocket> client = _clients.value(receiver);
-    if (client) {
-        QJsonObject message_obj{{"type", "is_typing"},
-                                {"sender_ID", _clients.key(_socket)}};
-
-        client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
-    }
+    _typing->typing(_account_ID, receiver, false);
 }
 
 void server_manager::group_is_typing_received(const int &groupID, const QString &sender_name) {
-    QJsonObject filter_object{{"_id", groupID}};
+    _typing->typing(_account_ID, groupID, true, sender_name);
+}
 
-    QJsonObject message_obj{{"type", "group_is_typing"},
-                            {"groupID", groupID},
+void server_manager::on_typing_changed(int sender_ID, int conversation_ID, bool group, const QString &sender_name, bool is_typing) {
+    if (!group) {
+        if (is_online(conversation_ID)) {
+            QJsonObject message_obj{{"type", is_typing ? "is_typing" : "stopped_typing"},
+                                    {"sender_ID", sender_ID}};
+
+            deliver(conversation_ID, message_obj, outbound_queue::Typing, QString("is_typing:%1").arg(sender_ID));
+        }
+
+        return;
+    }
+
+    QJsonObject filter_object{{"_id", conversation_ID}};
+
+    QJsonObject message_obj{{"type", is_typing ? "group_is_typing" : "group_stopped_typing"},
+                            {"groupID", conversation_ID},
                             {"sender_name", sender_name}};
 
-    QJsonDocument json_doc = Account::find_document(_chatAppDB, "groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
+    QJsonDocument json_doc = _repository->find_document("groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
     for (const QJsonValue &phone_number : json_doc.object().value("group_members").toArray()) {
-        if (phone_number.toInt() == _clients.key(_socket))
+        if (phone_number.toInt() == sender_ID)
             continue;
 
-        std::shared_ptr<QWebSocket> client = _clients.value(phone_number.toInt());
-        if (client)
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+        deliver(phone_number.toInt(), message_obj, outbound_queue::Typing, QString("group_is_typing:%1:%2").arg(conversation_ID).arg(sender_name));
     }
 }
 
 void server_manager::update_info_received(const QString &first_name, const QString &last_name, const QString &password) {
-    const QString &hashed_password = QString::fromStdString(Security::hashing_password(password.toStdString()));
-
-    QJsonObject filter_object{{"_id", _clients.key(_socket)}};
-    QJsonObject update_field{{"$set", QJsonObject{{"first_name", first_name},
-                                                  {"last_name", last_name},
-                                                  {"hashed_password", hashed_password}}}};
-    Account::update_document(_chatAppDB, "accounts", filter_object, update_field);
-
-    QJsonArray contactIDs = Account::fetch_contactIDs(_chatAppDB, _clients.key(_socket));
-    for (const QJsonValue &ID : contactIDs) {
-        std::shared_ptr<QWebSocket> client = _clients.value(ID.toInt());
-        if (client) {
-            QJsonObject message2{{"type", "contact_info_updated"},
-                                 {"phone_number", _clients.key(_socket)},
-                                 {"first_name", first_name},
-                                 {"last_name", last_name}};
-
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message2).toJson()));
-        };
-    }
+    // Read before hashing; the socket may be gone from _clients by the time it finishes
+    int phone_number = _account_ID;
+
+    task_scheduler::instance().run(
+        task_scheduler::Control, this,
+        [password = password.toStdString()]() { return Security::hashing_password(password); },
+        [=, this](const std::string &hash) {
+            QJsonObject filter_object{{"_id", phone_number}};
+            QJsonObject update_field{{"$set", QJsonObject{{"first_name", first_name},
+                                                          {"last_name", last_name},
+                                                          {"hashed_password", QString::fromStdString(hash)}}}};
+            _repository->update_document("accounts", filter_object, update_field);
+            _repository->update_contact(phone_number, QJsonObject{{"first_name", first_name}, {"last_name", last_name}});
+            _profiles->update(phone_number, QJsonObject{{"first_name", first_name}, {"last_name", last_name}});
+
+            QJsonArray contactIDs = _repository->fetch_contactIDs(phone_number);
+            for (const QJsonValue &ID : contactIDs) {
+                if (is_online(ID.toInt())) {
+                    QJsonObject message2{{"type", "contact_info_updated"},
+                                         {"phone_number", phone_number},
+                                         {"first_name", first_name},
+                                         {"last_name", last_name}};
+
+                    deliver(ID.toInt(), message2);
+                };
+            }
+        });
 }
 
 void server_manager::update_password(const int &phone_number, const QString &password) {
-    const QString &hashed_password = QString::fromStdString(Security::hashing_password(password.toStdString()));
-
-    QJsonObject filter_object{{"_id", phone_number}};
-    QJsonObject update_field{{"$set", QJsonObject{{"hashed_password", hashed_password}}}};
-    Account::update_document(_chatAppDB, "accounts", filter_object, update_field);
+    task_scheduler::instance().run(
+        task_scheduler::Control, this,
+        [password = password.toStdString()]() { return Security::hashing_password(password); },
+        [phone_number](const std::string &hash) {
+            QJsonObject filter_object{{"_id", phone_number}};
+            QJsonObject update_field{{"$set", QJsonObject{{"hashed_password", QString::fromStdString(hash)}}}};
+            _repository->update_document("accounts", filter_object, update_field);
+        });
 }
 
 void server_manager::retrieve_question(const int &phone_number) {
     QJsonObject filter_object{{"_id", phone_number}};
 
-    QJsonDocument json_doc = Account::find_document(_chatAppDB, "accounts", filter_object, QJsonObject{{"secret_question", 1}, {"secret_answer", 1}});
+    QJsonDocument json_doc = _repository->find_document("accounts", filter_object, QJsonObject{{"secret_question", 1}, {"secret_answer", 1}});
 
     QJsonObject message_obj{{"type", "question_answer"},
                             {"secret_question", json_doc.object()["secret_question"].toString()},
                             {"secret_answer", json_doc.object()["secret_answer"].toString()}};
 
-    _socket->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+    send_message(_socket, message_obj);
 }
 
 void server_manager::remove_group_member(const int &groupID, QJsonArray group_members) {
@@ -583,37 +821,31 @@ void server_manager::remove_group_member(const int &groupID, QJsonArray group_me
     QJsonObject pull_elements{{"$in", group_members}};
     QJsonObject pull_object{{"group_members", pull_elements}};
     QJsonObject update_object{{"$pull", pull_object}};
-    Account::update_document(_chatAppDB, "groups", filter_object, update_object);
-
-    for (const QJsonValue &phone_number : group_members) {
-        QJsonObject filter_object2{{"_id", phone_number}};
+    _repository->update_document("groups", filter_object, update_object);
+    _repository->remove_group(group_members, groupID);
 
-        QJsonObject pull_object2{{"groups", QJsonObject{{"groupID", groupID}}}};
-        QJsonObject update_object2{{"$pull", pull_object2}};
+    QJsonObject pull_object2{{"groups", QJsonObject{{"groupID", groupID}}}};
+    QJsonObject update_object2{{"$pull", pull_object2}};
+    _repository->update_many("accounts", QJsonObject{{"_id", QJsonObject{{"$in", group_members}}}}, update_object2);
 
-        Account::update_document(_chatAppDB, "accounts", filter_object2, update_object2);
+    for (const QJsonValue &phone_number : group_members) {
         QString message = QString("You have been removed from the group: %1").arg(QString::number(groupID));
 
         QJsonObject message_obj{{"type", "removed_from_group"},
                                 {"message", message},
                                 {"groupID", groupID}};
 
-        std::shared_ptr<QWebSocket> client = _clients.value(phone_number.toInt());
-        if (client)
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+        deliver(phone_number.toInt(), message_obj);
     }
 
-    Account::update_document(_chatAppDB, "accounts", filter_object, update_object);
-
-    QJsonDocument json_doc = Account::find_document(_chatAppDB, "groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
+    QJsonDocument json_doc = _repository->find_document("groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
     for (const QJsonValue &phone_number : json_doc.object().value("group_members").toArray()) {
-        std::shared_ptr<QWebSocket> client = _clients.value(phone_number.toInt());
-        if (client) {
+        if (is_online(phone_number.toInt())) {
             QJsonObject message_obj{{"type", "remove_group_member"},
                                     {"groupID", groupID},
                                     {"group_members", group_members}};
 
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+            deliver(phone_number.toInt(), message_obj);
         }
     }
 }
@@ -621,17 +853,16 @@ void server_manager::remove_group_member(const int &groupID, QJsonArray group_me
 void server_manager::add_group_member(const int &groupID, QJsonArray group_members) {
     QJsonObject filter_object{{"_id", groupID}};
 
-    QJsonDocument json_doc = Account::find_document(_chatAppDB, "groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
+    QJsonDocument json_doc = _repository->find_document("groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
 
     QJsonArray current_group_members = json_doc.object().value("group_members").toArray();
     for (const QJsonValue &phone_number : current_group_members) {
-        std::shared_ptr<QWebSocket> client = _clients.value(phone_number.toInt());
-        if (client) {
+        if (is_online(phone_number.toInt())) {
             QJsonObject message_obj{{"type", "add_group_member"},
                                     {"groupID", groupID},
                                     {"group_members", group_members}};
 
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+            deliver(phone_number.toInt(), message_obj);
         }
     }
 
@@ -639,21 +870,19 @@ void server_manager::add_group_member(const int &groupID, QJsonArray group_membe
     QJsonObject push_object{{"group_members", push_elements}};
     QJsonObject update_object{{"$push", push_object}};
 
-    Account::update_document(_chatAppDB, "groups", filter_object, update_object);
+    _repository->update_document("groups", filter_object, update_object);
 
-    QJsonDocument updated_group_doc = Account::find_document(_chatAppDB, "groups", filter_object);
+    QJsonDocument updated_group_doc = _repository->find_document("groups", filter_object);
     QJsonObject updated_group = updated_group_doc.object();
+    _repository->add_group(group_members, updated_group);
 
-    for (const QJsonValue &phone_number : group_members) {
-        QJsonObject filter_object2{{"_id", phone_number.toInt()}};
-
-        QJsonObject push_object2{{"groups", QJsonObject{{"groupID", groupID},
-                                                        {"group_unread_messages", 1}}}};
-        QJsonObject update_object2{{"$push", push_object2}};
-        Account::update_document(_chatAppDB, "accounts", filter_object2, update_object2);
+    QJsonObject push_object2{{"groups", QJsonObject{{"groupID", groupID},
+                                                    {"group_unread_messages", 1}}}};
+    QJsonObject update_object2{{"$push", push_object2}};
+    _repository->update_many("accounts", QJsonObject{{"_id", QJsonObject{{"$in", group_members}}}}, update_object2);
 
-        std::shared_ptr<QWebSocket> client = _clients.value(phone_number.toInt());
-        if (client) {
+    for (const QJsonValue &phone_number : group_members) {
+        if (is_online(phone_number.toInt())) {
             QJsonObject group_info{{"_id", groupID},
                                    {"group_name", updated_group.value("group_name").toString()},
                                    {"group_admin", updated_group.value("group_admin").toInt()},
@@ -668,7 +897,7 @@ void server_manager::add_group_member(const int &groupID, QJsonArray group_membe
             QJsonObject message1{{"type", "added_to_group"},
                                  {"groups", groups}};
 
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message1).toJson()));
+            deliver(phone_number.toInt(), message1);
         }
     }
 }
@@ -678,18 +907,17 @@ void server_manager::delete_message(const int &receiver, const int &chat_ID, con
                             {"chatID", chat_ID},
                             {"full_time", full_time}};
 
-    _socket->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+    send_message(_socket, message_obj);
 
-    std::shared_ptr<QWebSocket> client = _clients.value(receiver);
-    if (client)
-        client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+    deliver(receiver, message_obj);
 
     QJsonObject filter_object{{"_id", chat_ID}};
 
     QJsonObject pull_field{{"messages", QJsonObject{{"time", full_time}}}};
     QJsonObject update_object{{"$pull", pull_field}};
 
-    Account::update_document(_chatAppDB, "chats", filter_object, update_object);
+    _repository->update_document("chats", filter_object, update_object);
+    _repository->refresh_last_message(chat_ID);
 }
 
 void server_manager::delete_group_message(const int &groupID, const QString &full_time) {
@@ -699,227 +927,430 @@ void server_manager::delete_group_message(const int &groupID, const QString &ful
                             {"groupID", groupID},
                             {"full_time", full_time}};
 
-    QJsonDocument json_doc = Account::find_document(_chatAppDB, "groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
+    QJsonDocument json_doc = _repository->find_document("groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
     for (const QJsonValue &phone_number : json_doc.object().value("group_members").toArray()) {
-        std::shared_ptr<QWebSocket> client = _clients.value(phone_number.toInt());
-        if (client)
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+        deliver(phone_number.toInt(), message_obj);
     }
 
     QJsonObject pull_field{{"group_messages", QJsonObject{{"time", full_time}}}};
     QJsonObject update_object{{"$pull", pull_field}};
 
-    Account::update_document(_chatAppDB, "groups", filter_object, update_object);
+    _repository->update_document("groups", filter_object, update_object);
+    _repository->refresh_group_last_message(groupID);
 }
 
 void server_manager::update_unread_message(const int &chatID) {
-    QJsonObject filter_object{{"_id", _clients.key(_socket)},
-                              {"contacts.chatID", chatID}};
-
-    QJsonObject update_object{{"$set", QJsonObject{{"contacts.$.unread_messages", 0}}}};
-
-    Account::update_document(_chatAppDB, "accounts", filter_object, update_object);
+    _unread->reset(_account_ID, chatID, false);
 }
 
 void server_manager::update_group_unread_message(const int &groupID) {
-    QJsonObject filter_object{{"_id", _clients.key(_socket)},
-                              {"groups.groupID", groupID}};
-
-    QJsonObject update_object{{"$set", QJsonObject{{"groups.$.group_unread_messages", 0}}}};
-
-    Account::update_document(_chatAppDB, "accounts", filter_object, update_object);
+    _unread->reset(_account_ID, groupID, true);
 }
 
 void server_manager::delete_account() {
-    Account::delete_account(_chatAppDB, _clients.key(_socket));
+    bool accepted = _deletions->enqueue(_account_ID);
+    if (accepted)
+        _profiles->remove(_account_ID);
+
+    QJsonObject message{{"type", "delete_account"},
+                        {"status", accepted},
+                        {"message", accepted ? "Your account is being deleted" : "Account deletion failed"}};
+
+    send_message(_socket, message);
 }
 
-void server_manager::audio_received(const int &chatID, const int &receiver, const QString &audio_name, const QString &audio_data, const QString &time) {
-    QByteArray decoded_data = QByteArray::fromBase64(audio_data.toUtf8());
-    std::string decoded_string = decoded_data.toStdString();
+void server_manager::audio_received(const int &chatID, const int &receiver, const QString &audio_name, QByteArrayView audio_data, const QString &time) {
+    int sender_ID = _account_ID;
 
-    std::string audio_url = S3::store_data_to_s3(*_s3_client, audio_name.toStdString(), decoded_string);
+    upload_to_s3(audio_name, audio_data, [=, this](const QString &audio_url) {
+        QJsonObject message_obj{{"type", "audio"},
+                                {"chatID", chatID},
+                                {"sender_ID", sender_ID},
+                                {"audio_url", audio_url},
+                                {"time", time}};
+        deliver(receiver, message_obj);
 
-    QJsonObject message_obj{{"type", "audio"},
-                            {"chatID", chatID},
-                            {"sender_ID", _clients.key(_socket)},
-                            {"audio_url", QString::fromStdString(audio_url)},
-                            {"time", time}};
-    std::shared_ptr<QWebSocket> client = _clients.value(receiver);
-    if (client)
-        client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+        send_message(_socket, message_obj);
+
+        QJsonObject filter_object{{"_id", chatID}};
 
-    _socket->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+        QJsonObject push_field{{"audio_url", audio_url},
+                               {"sender", sender_ID},
+                               {"time", time}};
+        QJsonObject push_object{{"messages", push_field}};
 
-    QJsonObject filter_object{{"_id", chatID}};
+        QJsonObject update_object{{"$push", push_object}};
 
-    QJsonObject push_field{{"audio_url", QString::fromStdString(audio_url)},
-                           {"sender", _clients.key(_socket)},
-                           {"time", time}};
-    QJsonObject push_object{{"messages", push_field}};
+        _repository->update_document("chats", filter_object, update_object);
+        _repository->set_last_message(chatID, push_field);
 
-    QJsonObject update_object{{"$push", push_object}};
+        count_unread(receiver, chatID, false);
+    });
+}
+
+void server_manager::group_audio_received(const int &groupID, const QString &sender_name, const QString &audio_name, QByteArrayView audio_data, const QString &time) {
+    int sender_ID = _account_ID;
+
+    upload_to_s3(audio_name, audio_data, [=, this](const QString &audio_url) {
+        QJsonObject filter_object{{"_id", groupID}};
+
+        QJsonObject message_obj{{"type", "group_audio"},
+                                {"groupID", groupID},
+                                {"sender_ID", sender_ID},
+                                {"sender_name", sender_name},
+                                {"audio_url", audio_url},
+                                {"time", time}};
 
-    Account::update_document(_chatAppDB, "chats", filter_object, update_object);
+        QJsonDocument json_doc = _repository->find_document("groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
+        for (const QJsonValue &phone_number : json_doc.object().value("group_members").toArray()) {
+            deliver(phone_number.toInt(), message_obj);
+        }
+
+        QJsonObject group_message{{"audio_url", audio_url},
+                                  {"sender_ID", sender_ID},
+                                  {"sender_name", sender_name},
+                                  {"time", time}};
 
-    QJsonObject account_filter{{"_id", receiver}, {"contacts.chatID", chatID}};
-    QJsonObject increment_object{{"$inc", QJsonObject{{"contacts.$.unread_messages", 1}}}};
+        QJsonObject push_object{{"group_messages", group_message}};
 
-    Account::update_document(_chatAppDB, "accounts", account_filter, increment_object);
+        QJsonObject update_object{{"$push", push_object}};
+        _repository->update_document("groups", filter_object, update_object);
+        _repository->set_group_last_message(groupID, group_message);
+    });
 }
 
-void server_manager::group_audio_received(const int &groupID, const QString &sender_name, const QString &audio_name, const QString &audio_data, const QString &time) {
-    QByteArray decoded_data = QByteArray::fromBase64(audio_data.toUtf8());
-    std::string decoded_string = decoded_data.toStdString();
+void server_manager::on_text_message_received(const QString &message) {
+    QByteArray frame;
+
+    QStringEncoder encoder(QStringEncoder::Utf8);
+    qsizetype required = encoder.requiredSpace(message.size());
+
+    if (required > MaxRetainedFrame) {
+        frame = message.toUtf8();
+    } else {
+        _inbound.resize(required);
+        char *end = encoder.appendToBuffer(_inbound.data(), message);
+        _inbound.resize(end - _inbound.data());
+        frame = _inbound;
+    }
 
-    std::string audio_url = S3::store_data_to_s3(*_s3_client, audio_name.toStdString(), decoded_string);
+    _heartbeat->alive(_socket.get());
+    if (_traffic)
+        _traffic->record(_socket.get(), frame, false);
 
-    QJsonObject filter_object{{"_id", groupID}};
+    on_frame_received(frame);
+}
 
-    QJsonObject message_obj{{"type", "group_audio"},
-                            {"groupID", groupID},
-                            {"sender_ID", _clients.key(_socket)},
-                            {"sender_name", sender_name},
-                            {"audio_url", QString::fromStdString(audio_url)},
-                            {"time", time}};
+void server_manager::on_binary_message_received(const QByteArray &message) {
+    static metrics::counter &corrupt_frames = metrics::registry::instance().counter_of("chat_frames_rejected_total", "Frames dropped before dispatch", R"(reason="bad_compression")");
 
-    QJsonObject increment_object{{"$inc", QJsonObject{{"groups.$.group_unread_messages", 1}}}};
+    _heartbeat->alive(_socket.get());
 
-    QJsonDocument json_doc = Account::find_document(_chatAppDB, "groups", filter_object, QJsonObject{{"_id", 0}, {"group_members", 1}});
-    for (const QJsonValue &phone_number : json_doc.object().value("group_members").toArray()) {
-        std::shared_ptr<QWebSocket> client = _clients.value(phone_number.toInt());
-        if (client)
-            client->sendTextMessage(QString::fromUtf8(QJsonDocument(message_obj).toJson()));
+    QByteArray frame = message;
+    if (frame_compression::instance().enabled() && frame_compression::compressed(message)) {
+        frame = frame_compression::instance().decompress(message, frame_compression::instance().max_inflated());
+        if (frame.isNull()) {
+            corrupt_frames.add();
+            logger::warning("invalid_compressed_frame");
+            return;
+        }
     }
 
-    QJsonObject push_object{{"group_messages", QJsonObject{{"audio_url", QString::fromStdString(audio_url)},
-                                                           {"sender_ID", _clients.key(_socket)},
-                                                           {"sender_name", sender_name},
-                                                           {"time", time}}}};
+    if (_traffic)
+        _traffic->record(_socket.get(), frame, true);
 
-    QJsonObject update_object{{"$push", push_object}};
-    Account::update_document(_chatAppDB, "groups", filter_object, update_object);
+    on_frame_received(frame);
 }
 
-void server_manager::on_text_message_received(const QString &message) {
-    QJsonDocument json_doc = QJsonDocument::fromJson(message.toUtf8());
-    if (json_doc.isNull() || !json_doc.isObject()) {
-        qWarning() << "Invalid JSON received.";
+void server_manager::on_frame_received(const QByteArray &message) {
+    static metrics::counter &invalid_frames = metrics::registry::instance().counter_of("chat_frames_rejected_total", "Frames dropped before dispatch", R"(reason="invalid_json")");
+    static metrics::counter &unknown_frames = metrics::registry::instance().counter_of("chat_frames_rejected_total", "Frames dropped before dispatch", R"(reason="unknown_type")");
+
+    tracing::scope trace(tracing::start_trace());
+    std::optional<tracing::span> parse_span(std::in_place, "parse");
+
+    json_frame json;
+    if (!json.parse(message)) {
+        invalid_frames.add();
+        logger::warning("invalid_json");
         return;
     }
 
-    QJsonObject json_object = json_doc.object();
-    MessageType type = _map.value(json_object["type"].toString());
+    MessageType type = message_dispatch::type_of(json);
+    if (type == message_dispatch::Unknown) {
+        unknown_frames.add();
+        logger::warning("unknown_message_type");
+        return;
+    }
+
+    parse_span.reset();
+
+    const frame_instruments &instruments = instruments_of(type);
+    instruments.received->add();
 
+    // Resolved now; the handler may only run after the socket has left _clients
+    const int account_ID = _socket->property("id").toInt();
+    if (!account_ID && needs_login(type)) {
+        logger::warning("frame_before_login", {{"type", message_dispatch::names[type]}});
+        return;
+    }
+
+    if (!admitted(type, json))
+        return;
+
+    // The clock is only read for traced frames and one frame in
+    // CHAT_APP_LATENCY_SAMPLE_EVERY (default 64); the latency histograms are
+    // that sample, the received counter stays exact
+    static const quint32 latency_every = std::max(1, std::getenv("CHAT_APP_LATENCY_SAMPLE_EVERY") ? std::atoi(std::getenv("CHAT_APP_LATENCY_SAMPLE_EVERY")) : 64);
+    static quint32 untimed_frames = 0;
+
+    const bool timed = tracing::current() || ++untimed_frames >= latency_every;
+    if (timed)
+        untimed_frames = 0;
+
+    task_scheduler::instance().post(lane_of(type), this, [this, type, account_ID, json = std::move(json), &instruments, received = timed ? tracing::now() : 0]() mutable {
+        _account_ID = account_ID;
+
+        if (!received) {
+            (this->*_invokers[type])(json);
+            return;
+        }
+
+        qint64 started = tracing::now();
+        instruments.queued->record(started - received);
+        tracing::record("queued", tracing::current(), received, started);
+
+        metrics::scoped_timer timer(*instruments.handled, started);
+        tracing::span handler_span(message_dispatch::names[type].data());
+        (this->*_invokers[type])(json);
+    });
+}
+
+bool server_manager::admitted(MessageType type, json_frame &json) {
+    // Before login a frame counts against the account it names, so guesses
+    // at one password are bounded however many connections they come from
+    int account_ID = _socket->property("id").toInt();
+    if (!account_ID)
+        message_dispatch::decode_value(json, json.find("phone_number"), account_ID);
+
+    return _limiter->allow(type, _socket.get(), account_ID, _socket->peerAddress());
+}
+
+void server_manager::register_metrics() {
+    metrics::registry &registry = metrics::registry::instance();
+
+    registry.callback("chat_connected_clients", "Clients logged in on this node", QString(), []() { return static_cast<double>(_clients.size()); });
+    registry.callback("chat_sessions", "Connection sessions alive, logged in or not", QString(), []() { return static_cast<double>(slab_pool<server_manager>::instance().in_use()); });
+    registry.callback("chat_session_slots", "Session slots allocated in the slab pool", QString(), []() { return static_cast<double>(slab_pool<server_manager>::instance().capacity()); });
+
+    static constexpr std::array<const char *, task_scheduler::LaneCount> lanes{"control", "text", "bulk"};
+    for (int lane = 0; lane < task_scheduler::LaneCount; lane++) {
+        registry.callback("chat_lane_pending_tasks", "Tasks waiting on a scheduler lane", QString("lane=\"%1\"").arg(lanes[lane]),
+                          [lane]() { return static_cast<double>(task_scheduler::instance().pending(static_cast<task_scheduler::Lane>(lane))); });
+    }
+
+    registry.callback("chat_outbound_queued_frames", "Frames parked in outbound queues", QString(), []() { return static_cast<double>(outbound_queue::metrics().queued_frames); });
+    registry.callback("chat_outbound_queued_bytes", "Bytes parked in outbound queues", QString(), []() { return static_cast<double>(outbound_queue::metrics().queued_bytes); });
+    registry.callback("chat_outbound_coalesced_total", "Typing frames replaced while queued", QString(), []() { return static_cast<double>(outbound_queue::metrics().coalesced_frames); }, true);
+    registry.callback("chat_outbound_dropped_total", "Frames shed from outbound queues", QString(), []() { return static_cast<double>(outbound_queue::metrics().dropped_frames); }, true);
+    registry.callback("chat_outbound_evictions_total", "Clients evicted for a full outbound queue", QString(), []() { return static_cast<double>(outbound_queue::metrics().evictions); }, true);
+
+    registry.callback("chat_unread_mutations_total", "Unread counter updates buffered in memory", QString(), []() { return static_cast<double>(_unread->metrics().mutations); }, true);
+    registry.callback("chat_unread_writes_total", "Bulk writes issued by unread counter flushes", QString(), []() { return static_cast<double>(_unread->metrics().writes); }, true);
+
+    registry.callback("chat_profile_cache_hits_total", "Profile lookups served from the cache", QString(), []() { return static_cast<double>(_profiles->metrics().hits); }, true);
+    registry.callback("chat_profile_cache_misses_total", "Profile lookups that went to MongoDB", QString(), []() { return static_cast<double>(_profiles->metrics().misses); }, true);
+    registry.callback("chat_profile_cache_filtered_total", "Lookups of unknown numbers answered by the filter", QString(), []() { return static_cast<double>(_profiles->metrics().filtered); }, true);
+
+    registry.callback("chat_heartbeat_watched", "Connections under heartbeat", QString(), []() { return static_cast<double>(_heartbeat->watched()); });
+    registry.callback("chat_heartbeat_pings_total", "Pings sent to quiet connections", QString(), []() { return static_cast<double>(_heartbeat->metrics().pings); }, true);
+    registry.callback("chat_heartbeat_timeouts_total", "Connections aborted for a missed pong", QString(), []() { return static_cast<double>(_heartbeat->metrics().timeouts); }, true);
+
+    registry.callback("chat_compressed_frames_total", "Frames sent deflated", QString(), []() { return static_cast<double>(frame_compression::instance().metrics().frames); }, true);
+    registry.callback("chat_compression_input_bytes_total", "Bytes of frames before deflate", QString(), []() { return static_cast<double>(frame_compression::instance().metrics().input_bytes); }, true);
+    registry.callback("chat_compression_output_bytes_total", "Bytes of frames after deflate", QString(), []() { return static_cast<double>(frame_compression::instance().metrics().output_bytes); }, true);
+    registry.callback("chat_inflated_frames_total", "Deflated frames received from clients", QString(), []() { return static_cast<double>(frame_compression::instance().metrics().inflated_frames); }, true);
+
+    registry.callback("chat_rate_limit_buckets", "Token buckets tracked by the rate limiter", QString(), []() { return static_cast<double>(_limiter->buckets()); });
+
+    registry.callback("chat_deletion_jobs_pending", "Account deletions still running", QString(), []() { return static_cast<double>(_deletions->pending()); });
+}
+
+task_scheduler::Lane server_manager::lane_of(MessageType type) {
     switch (type) {
-    case SignUp:
-        sign_up(json_object["phone_number"].toInt(), json_object["first_name"].toString(), json_object["last_name"].toString(), json_object["password"].toString(), json_object["secret_question"].toString(), json_object["secret_answer"].toString());
-        break;
-    case LoginRequest:
-        login_request(json_object["phone_number"].toInt(), json_object["password"].toString(), json_object["time_zone"].toString());
-        break;
-    case LookupFriend:
-        lookup_friend(json_object["phone_number"].toInt());
-        break;
-    case ProfileImage:
-        profile_image(json_object["file_name"].toString(), json_object["file_data"].toString());
-        break;
-    case GroupProfileImage:
-        group_profile_image(json_object["groupID"].toInt(), json_object["file_name"].toString(), json_object["file_data"].toString());
-        break;
-    case ProfileImageDeleted:
-        profile_image_deleted();
-        break;
-    case Text:
-        text_received(json_object["receiver"].toInt(), json_object["message"].toString(), json_object["time"].toString(), json_object["chatID"].toInt());
-        break;
-    case NewGroup:
-        new_group(json_object["group_name"].toString(), json_object["group_members"].toArray());
-        break;
-    case GroupText:
-        group_text_received(json_object["groupID"].toInt(), json_object["sender_name"].toString(), json_object["message"].toString(), json_object["time"].toString());
-        break;
-    case File:
-        file_received(json_object["chatID"].toInt(), json_object["receiver"].toInt(), json_object["file_name"].toString(), json_object["file_data"].toString(), json_object["time"].toString());
-        break;
-    case GroupFile:
-        group_file_received(json_object["groupID"].toInt(), json_object["sender_name"].toString(), json_object["file_name"].toString(), json_object["file_data"].toString(), json_object["time"].toString());
-        break;
-    case IsTyping:
-        is_typing_received(json_object["receiver"].toInt());
-        break;
-    case GroupIsTyping:
-        group_is_typing_received(json_object["groupID"].toInt(), json_object["sender_name"].toString());
-        break;
-    case UpdateInfo:
-        update_info_received(json_object["first_name"].toString(), json_object["last_name"].toString(), json_object["password"].toString());
-        break;
-    case UpdatePassword:
-        update_password(json_object["phone_number"].toInt(), json_object["password"].toString());
-        break;
-    case RetrieveQuestion:
-        retrieve_question(json_object["phone_number"].toInt());
-        break;
-    case RemoveGroupMember:
-        remove_group_member(json_object["groupID"].toInt(), json_object["group_members"].toArray());
-        break;
-    case AddGroupMember:
-        add_group_member(json_object["groupID"].toInt(), json_object["group_members"].toArray());
-        break;
-    case DeleteMessage:
-        delete_message(json_object["receiver"].toInt(), json_object["chatID"].toInt(), json_object["full_time"].toString());
-        break;
-    case DeleteGroupMessage:
-        delete_group_message(json_object["groupID"].toInt(), json_object["full_time"].toString());
-        break;
-    case UpdateUnreadMessage:
-        update_unread_message(json_object["chatID"].toInt());
-        break;
-    case UpdateGroupUnreadMessage:
-        update_group_unread_message(json_object["groupID"].toInt());
-        break;
-    case DeleteAccount:
-        delete_account();
-        break;
-    case Audio:
-        audio_received(json_object["chatID"].toInt(), json_object["receiver"].toInt(), json_object["audio_name"].toString(), json_object["audio_data"].toString(), json_object["time"].toString());
-        break;
-    case GroupAudio:
-        group_audio_received(json_object["groupID"].toInt(), json_object["sender_name"].toString(), json_object["audio_name"].toString(), json_object["audio_data"].toString(), json_object["time"].toString());
-        break;
+    case message_dispatch::File:
+    case message_dispatch::GroupFile:
+    case message_dispatch::Audio:
+    case message_dispatch::GroupAudio:
+    case message_dispatch::ProfileImage:
+    case message_dispatch::GroupProfileImage:
+        return task_scheduler::Bulk;
+    case message_dispatch::Text:
+    case message_dispatch::GroupText:
+    case message_dispatch::Batch:
+    case message_dispatch::NewGroup:
+    case message_dispatch::AddGroupMember:
+    case message_dispatch::RemoveGroupMember:
+    case message_dispatch::DeleteMessage:
+    case message_dispatch::DeleteGroupMessage:
+        return task_scheduler::Text;
     default:
-        qWarning() << "Unknown message type: " << json_object["type"].toString();
-        break;
-    }
-}
-
-void server_manager::map_initialization() {
-    _map["sign_up"] = SignUp;
-    _map["login_request"] = LoginRequest;
-    _map["is_typing"] = IsTyping;
-    _map["profile_image"] = ProfileImage;
-    _map["group_profile_image"] = GroupProfileImage;
-    _map["profile_image_deleted"] = ProfileImageDeleted;
-    _map["client_disconnected"] = ClientDisconnected;
-    _map["client_connected"] = ClientConnected;
-    _map["lookup_friend"] = LookupFriend;
-    _map["new_group"] = NewGroup;
-    _map["text"] = Text;
-    _map["group_text"] = GroupText;
-    _map["added_to_group"] = AddedToGroup;
-    _map["file"] = File;
-    _map["group_file"] = GroupFile;
-    _map["group_is_typing"] = GroupIsTyping;
-    _map["contact_info_updated"] = UpdateInfo;
-    _map["update_password"] = UpdatePassword;
-    _map["retrieve_question"] = RetrieveQuestion;
-    _map["remove_group_member"] = RemoveGroupMember;
-    _map["add_group_member"] = AddGroupMember;
-    _map["delete_message"] = DeleteMessage;
-    _map["delete_group_message"] = DeleteGroupMessage;
-    _map["update_unread_message"] = UpdateUnreadMessage;
-    _map["update_group_unread_message"] = UpdateGroupUnreadMessage;
-    _map["delete_account"] = DeleteAccount;
-    _map["audio"] = Audio;
-    _map["group_audio"] = GroupAudio;
+        return task_scheduler::Control;
+    }
+}
+
+bool server_manager::needs_login(MessageType type) {
+    switch (type) {
+    case message_dispatch::SignUp:
+    case message_dispatch::LoginRequest:
+    case message_dispatch::UpdatePassword:
+    case message_dispatch::RetrieveQuestion:
+        return false;
+    default:
+        return true;
+    }
+}
+
+bool server_manager::mergeable(MessageType type) {
+    switch (type) {
+    case message_dispatch::Text:
+    case message_dispatch::GroupText:
+    case message_dispatch::IsTyping:
+    case message_dispatch::GroupIsTyping:
+    case message_dispatch::UpdateUnreadMessage:
+    case message_dispatch::UpdateGroupUnreadMessage:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void server_manager::batch_received(json_frame &json) {
+    QList<QByteArray> elements;
+    if (!json.elements(json.find("operations"), elements) || elements.size() > MaxBatchSize) {
+        logger::warning("malformed_batch");
+        return;
+    }
+
+    // Each result is final once the batch is committed; a run operation
+    // keeps its responses aside until then
+    QList<QJsonObject> results;
+    QList<std::pair<qsizetype, QJsonArray>> ran;
+    QList<std::function<void()>> held;
+
+    _repository->begin_batch();
+    _held = &held;
+
+    for (qsizetype index = 0; index < elements.size(); index++) {
+        json_frame operation;
+        MessageType type = operation.parse(std::move(elements[index])) ? message_dispatch::type_of(operation) : message_dispatch::Unknown;
+
+        if (type == message_dispatch::Unknown || type == message_dispatch::Batch) {
+            results.append(QJsonObject{{"index", index}, {"status", "rejected"}});
+            continue;
+        }
+
+        QJsonObject result{{"index", index}, {"type", QString::fromLatin1(message_dispatch::names[type])}};
+
+        // Run here in order or not at all, so nothing in a batch depends on
+        // an operation that has not happened yet
+        if (!mergeable(type)) {
+            result["status"] = "not_batchable";
+            results.append(result);
+            continue;
+        }
+
+        if (!admitted(type, operation)) {
+            result["status"] = "rate_limited";
+            results.append(result);
+            continue;
+        }
+
+        QJsonArray responses;
+        _capture_socket = _socket.get();
+        _captured = &responses;
+
+        (this->*_invokers[type])(operation);
+
+        _captured = nullptr;
+        _capture_socket = nullptr;
+
+        ran.append({results.size(), responses});
+        results.append(result);
+    }
+
+    _held = nullptr;
+    bool written = _repository->commit_batch();
+
+    // Receivers only see what was persisted
+    if (written) {
+        for (const std::function<void()> &delivery : std::as_const(held))
+            delivery();
+    }
+
+    for (auto &[position, responses] : ran) {
+        results[position]["status"] = written ? "ok" : "failed";
+        if (written)
+            results[position]["responses"] = responses;
+    }
+
+    QJsonArray ordered_results;
+    for (const QJsonObject &result : std::as_const(results))
+        ordered_results.append(result);
+
+    QJsonObject response{{"type", "batch"},
+                         {"status", written},
+                         {"results", ordered_results}};
+
+    int batch_ID = 0;
+    if (message_dispatch::decode_value(json, json.find("batch_id"), batch_ID))
+        response.insert("batch_id", batch_ID);
+
+    send_message(_socket, response);
 }
+
+template <server_manager::MessageType Type, auto Handler>
+void server_manager::invoke(json_frame &json) {
+    using Frame = std::tuple_element_t<Type, message_dispatch::frames>;
+
+    Frame frame;
+    if (!message_dispatch::decode(json, frame)) {
+        logger::warning("malformed_message", {{"type", message_dispatch::names[Type]}});
+        return;
+    }
+
+    std::apply([&](const auto &...fields) { (this->*Handler)(frame.*std::decay_t<decltype(fields)>::member...); }, Frame::fields());
+}
+
+const std::array<server_manager::Invoker, message_dispatch::TypeCount> server_manager::_invokers = [] {
+    std::array<Invoker, message_dispatch::TypeCount> invokers{};
+
+    invokers[message_dispatch::SignUp] = &server_manager::invoke<message_dispatch::SignUp, &server_manager::sign_up>;
+    invokers[message_dispatch::LoginRequest] = &server_manager::invoke<message_dispatch::LoginRequest, &server_manager::login_request>;
+    invokers[message_dispatch::IsTyping] = &server_manager::invoke<message_dispatch::IsTyping, &server_manager::is_typing_received>;
+    invokers[message_dispatch::ProfileImage] = &server_manager::invoke<message_dispatch::ProfileImage, &server_manager::profile_image>;
+    invokers[message_dispatch::GroupProfileImage] = &server_manager::invoke<message_dispatch::GroupProfileImage, &server_manager::group_profile_image>;
+    invokers[message_dispatch::ProfileImageDeleted] = &server_manager::invoke<message_dispatch::ProfileImageDeleted, &server_manager::profile_image_deleted>;
+    invokers[message_dispatch::LookupFriend] = &server_manager::invoke<message_dispatch::LookupFriend, &server_manager::lookup_friend>;
+    invokers[message_dispatch::NewGroup] = &server_manager::invoke<message_dispatch::NewGroup, &server_manager::new_group>;
+    invokers[message_dispatch::Text] = &server_manager::invoke<message_dispatch::Text, &server_manager::text_received>;
+    invokers[message_dispatch::GroupText] = &server_manager::invoke<message_dispatch::GroupText, &server_manager::group_text_received>;
+    invokers[message_dispatch::File] = &server_manager::invoke<message_dispatch::File, &server_manager::file_received>;
+    invokers[message_dispatch::GroupFile] = &server_manager::invoke<message_dispatch::GroupFile, &server_manager::group_file_received>;
+    invokers[message_dispatch::GroupIsTyping] = &server_manager::invoke<message_dispatch::GroupIsTyping, &server_manager::group_is_typing_received>;
+    invokers[message_dispatch::UpdateInfo] = &server_manager::invoke<message_dispatch::UpdateInfo, &server_manager::update_info_received>;
+    invokers[message_dispatch::UpdatePassword] = &server_manager::invoke<message_dispatch::UpdatePassword, &server_manager::update_password>;
+    invokers[message_dispatch::RetrieveQuestion] = &server_manager::invoke<message_dispatch::RetrieveQuestion, &server_manager::retrieve_question>;
+    invokers[message_dispatch::RemoveGroupMember] = &server_manager::invoke<message_dispatch::RemoveGroupMember, &server_manager::remove_group_member>;
+    invokers[message_dispatch::AddGroupMember] = &server_manager::invoke<message_dispatch::AddGroupMember, &server_manager::add_group_member>;
+    invokers[message_dispatch::DeleteMessage] = &server_manager::invoke<message_dispatch::DeleteMessage, &server_manager::delete_message>;
+    invokers[message_dispatch::DeleteGroupMessage] = &server_manager::invoke<message_dispatch::DeleteGroupMessage, &server_manager::delete_group_message>;
+    invokers[message_dispatch::UpdateUnreadMessage] = &server_manager::invoke<message_dispatch::UpdateUnreadMessage, &server_manager::update_unread_message>;
+    invokers[message_dispatch::UpdateGroupUnreadMessage] = &server_manager::invoke<message_dispatch::UpdateGroupUnreadMessage, &server_manager::update_group_unread_message>;
+    invokers[message_dispatch::DeleteAccount] = &server_manager::invoke<message_dispatch::DeleteAccount, &server_manager::delete_account>;
+    invokers[message_dispatch::Audio] = &server_manager::invoke<message_dispatch::Audio, &server_manager::audio_received>;
+    invokers[message_dispatch::GroupAudio] = &server_manager::invoke<message_dispatch::GroupAudio, &server_manager::group_audio_received>;
+    invokers[message_dispatch::Batch] = &server_manager::batch_received;
+
+    return invokers;
+}();
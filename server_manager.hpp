@@ -1,6 +1,24 @@
 #pragma once
 
+#include "cluster_bus.hpp"
 #include "database.hpp"
+#include "deletion_jobs.hpp"
+#include "frame_compression.hpp"
+#include "heartbeat.hpp"
+#include "login_stream.hpp"
+#include "metrics_endpoint.hpp"
+#include "message_dispatch.hpp"
+#include "outbound_queue.hpp"
+#include "profile_cache.hpp"
+#include "rate_limiter.hpp"
+#include "repository.hpp"
+#include "slab_pool.hpp"
+#include "task_scheduler.hpp"
+#include "tls_config.hpp"
+#include "traffic_capture.hpp"
+#include "typing_engine.hpp"
+#include "unread_counters.hpp"
+#include <QSslServer>
 #include <QtConcurrent>
 
 class server_manager : public QObject {
@@ -11,17 +29,21 @@ class server_manager : public QObject {
     server_manager(std::shared_ptr<QWebSocket> client, QObject *parent = nullptr);
     ~server_manager();
 
+    // Per-connection sessions come from a slab, the listener from the stack
+    static void *operator new(std::size_t size);
+    static void operator delete(void *pointer, std::size_t size);
+
     void sign_up(const int &phone_number, const QString &first_name, const QString &last_name, const QString &password, const QString &secret_question, const QString &secret_answer);
     void login_request(const int &phone_number, const QString &password, const QString &time_zone);
     void lookup_friend(const int &phone_number);
-    void profile_image(const QString &file_name, const QString &data);
-    void group_profile_image(const int &group_ID, const QString &file_name, const QString &data);
+    void profile_image(const QString &file_name, QByteArrayView data);
+    void group_profile_image(const int &group_ID, const QString &file_name, QByteArrayView data);
     void profile_image_deleted();
     void text_received(const int &receiver, const QString &message, const QString &time, const int &chat_ID);
     void new_group(const QString &group_name, QJsonArray group_members);
     void group_text_received(const int &groupID, QString sender_name, const QString &message, const QString &time);
-    void file_received(const int &chatID, const int &receiver, const QString &file_name, const QString &file_data, const QString &time);
-    void group_file_received(const int &groupID, const QString &sender_name, const QString &file_name, const QString &file_data, const QString &time);
+    void file_received(const int &chatID, const int &receiver, const QString &file_name, QByteArrayView file_data, const QString &time);
+    void group_file_received(const int &groupID, const QString &sender_name, const QString &file_name, QByteArrayView file_data, const QString &time);
     void is_typing_received(const int &receiver);
     void group_is_typing_received(const int &groupID, const QString &sender_name);
     void update_info_received(const QString &first_name, const QString &last_name, const QString &password);
@@ -34,21 +56,48 @@ class server_manager : public QObject {
     void update_unread_message(const int &chatID);
     void update_group_unread_message(const int &groupID);
     void delete_account();
-    void audio_received(const int &chatID, const int &receiver, const QString &audio_name, const QString &audio_data, const QString &time);
-    void group_audio_received(const int &groupID, const QString &sender_name, const QString &audio_name, const QString &audio_data, const QString &time);
+    void audio_received(const int &chatID, const int &receiver, const QString &audio_name, QByteArrayView audio_data, const QString &time);
+    void group_audio_received(const int &groupID, const QString &sender_name, const QString &audio_name, QByteArrayView audio_data, const QString &time);
 
   private slots:
     void on_new_connection();
     void on_client_disconnected();
     void on_text_message_received(const QString &message);
+    void on_binary_message_received(const QByteArray &message);
+    void on_typing_changed(int sender_ID, int conversation_ID, bool group, const QString &sender_name, bool is_typing);
+    void on_cluster_frame(int user_ID, const QString &frame, int kind, const QString &coalesce_key);
+    void on_cluster_claim_lost(int user_ID);
 
   private:
     QWebSocketServer *_server{nullptr};
+
+    // Accepts and handshakes wss:// connections, so every socket can be set
+    // up for resumption before its ClientHello, then hands them to _server
+    QSslServer *_tls_server{nullptr};
     std::shared_ptr<QWebSocket> _socket{nullptr};
 
-    static inline mongocxx::database _chatAppDB{};
+    // The account of the frame being handled, as it was when the frame was
+    // admitted; by the time its task runs the session may have left _clients
+    int _account_ID{0};
+
+    // Scratch for the UTF-8 form of text frames. It keeps its capacity between
+    // frames and is only shared while a frame waits for dispatch, so once that
+    // frame has run the next one is encoded in place without an allocation.
+    // Frames over MaxRetainedFrame bytes (uploads) get a buffer of their own.
+    QByteArray _inbound{};
+    static constexpr qsizetype MaxRetainedFrame = 64 * 1024;
+
+    static inline std::unique_ptr<Repository> _repository{};
     static inline QHash<int, std::shared_ptr<QWebSocket>> _clients{};
     static inline QHash<int, QString> _time_zone{};
+    static inline typing_engine *_typing{nullptr};
+    static inline cluster_bus *_cluster{nullptr};
+    static inline unread_counters *_unread{nullptr};
+    static inline deletion_jobs *_deletions{nullptr};
+    static inline profile_cache *_profiles{nullptr};
+    static inline traffic_capture *_traffic{nullptr};
+    static inline heartbeat *_heartbeat{nullptr};
+    static inline rate_limiter *_limiter{nullptr};
 
     static inline Aws::SDKOptions _options{};
     static inline std::shared_ptr<Aws::S3::S3Client> _s3_client{};
@@ -56,37 +105,50 @@ class server_manager : public QObject {
     QHostAddress _ip{QHostAddress::Any};
     int _port{12345};
 
-    void map_initialization();
-
-    enum MessageType {
-        SignUp = Qt::UserRole + 1,
-        IsTyping,
-        ProfileImage,
-        GroupProfileImage,
-        ProfileImageDeleted,
-        File,
-        Text,
-        GroupFile,
-        GroupText,
-        LoginRequest,
-        ClientDisconnected,
-        ClientConnected,
-        LookupFriend,
-        NewGroup,
-        AddedToGroup,
-        GroupIsTyping,
-        UpdateInfo,
-        UpdatePassword,
-        RetrieveQuestion,
-        RemoveGroupMember,
-        AddGroupMember,
-        Audio,
-        GroupAudio,
-        DeleteMessage,
-        DeleteGroupMessage,
-        UpdateUnreadMessage,
-        UpdateGroupUnreadMessage,
-        DeleteAccount
-    };
-    static inline QHash<QString, MessageType> _map{};
+    void login_succeeded(const int &phone_number, const QJsonObject &my_info);
+    void upload_to_s3(const QString &file_name, QByteArrayView data, std::function<void(const QString &url)> done);
+
+    static void send_message(const std::shared_ptr<QWebSocket> &client, const QJsonObject &message, outbound_queue::FrameKind kind = outbound_queue::Message, const QString &coalesce_key = QString());
+    static void send_frame(const std::shared_ptr<QWebSocket> &client, const QString &frame, outbound_queue::FrameKind kind, const QString &coalesce_key);
+
+    // Sends to a user on this node, or forwards to the node that owns them
+    static void deliver(const int &user_ID, const QJsonObject &message, outbound_queue::FrameKind kind = outbound_queue::Message, const QString &coalesce_key = QString());
+    static bool is_online(const int &user_ID);
+
+    // Held with the deliveries while a batch runs
+    static void count_unread(int account_ID, int conversation_ID, bool group);
+
+    using MessageType = message_dispatch::MessageType;
+    using Invoker = void (server_manager::*)(json_frame &json);
+
+    static const std::array<Invoker, message_dispatch::TypeCount> _invokers;
+
+    template <MessageType Type, auto Handler>
+    void invoke(json_frame &json);
+
+    void on_frame_received(const QByteArray &message);
+
+    // Charges the frame to this connection's rate limits, from its type and
+    // at most one more field, so a shed frame is never decoded
+    bool admitted(MessageType type, json_frame &json);
+
+    static task_scheduler::Lane lane_of(MessageType type);
+    static bool needs_login(MessageType type);
+
+    // Exposes the state other components already count on the metrics endpoint
+    static void register_metrics();
+
+    // Runs the operations of a batch in order in one turn with their DB
+    // writes merged, and answers with one frame. Only writes-only types may be
+    // batched; anything else is rejected, since it would need its own lane
+    static constexpr int MaxBatchSize = 256;
+
+    void batch_received(json_frame &json);
+    static bool mergeable(MessageType type);
+
+    // Frames for the capturing socket are collected instead of sent, and
+    // deliveries to other users wait until the batch is committed
+    static inline QWebSocket *_capture_socket{nullptr};
+    static inline QJsonArray *_captured{nullptr};
+    static inline QList<std::function<void()>> *_held{nullptr};
 };
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QtGlobal>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Fixed-size blocks for objects of type T, carved out of slabs of
+// BlocksPerSlab and recycled through a free list. Slabs are kept for the life
+// of the process, so connect/disconnect churn keeps reusing the same pages
+// instead of scattering per-connection objects over the heap. Main thread only.
+template <typename T, std::size_t BlocksPerSlab = 64>
+class slab_pool {
+  public:
+    static slab_pool &instance() {
+        static slab_pool pool;
+        return pool;
+    }
+
+    void *allocate() {
+        if (!_free)
+            grow();
+
+        Block *block = _free;
+        _free = block->next;
+        _in_use++;
+
+        return block->storage;
+    }
+
+    void release(void *pointer) {
+        Block *block = static_cast<Block *>(pointer);
+        block->next = _free;
+        _free = block;
+        _in_use--;
+    }
+
+    qsizetype in_use() const { return _in_use; }
+    qsizetype capacity() const { return static_cast<qsizetype>(_slabs.size() * BlocksPerSlab); }
+
+  private:
+    union Block {
+        Block *next;
+        alignas(T) std::byte storage[sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Block[]>> _slabs{};
+    Block *_free{nullptr};
+    qsizetype _in_use{0};
+
+    void grow() {
+        std::unique_ptr<Block[]> &slab = _slabs.emplace_back(new Block[BlocksPerSlab]);
+
+        for (std::size_t index = BlocksPerSlab; index > 0; index--) {
+            slab[index - 1].next = _free;
+            _free = &slab[index - 1];
+        }
+    }
+};
@@ -0,0 +1,84 @@
+#include "task_scheduler.hpp"
+
+task_scheduler &task_scheduler::instance() {
+    static task_scheduler scheduler;
+    return scheduler;
+}
+
+task_scheduler::task_scheduler() {
+    const std::array<const char *, LaneCount> variables{"CHAT_APP_CONTROL_CONCURRENCY", "CHAT_APP_TEXT_CONCURRENCY", "CHAT_APP_BULK_CONCURRENCY"};
+
+    for (int lane = Control; lane < LaneCount; lane++) {
+        if (const char *value = std::getenv(variables[lane]))
+            _limits[lane] = std::max(1, std::atoi(value));
+
+        _pools[lane].setMaxThreadCount(_limits[lane]);
+    }
+
+    _drain_timer.setSingleShot(true);
+    _drain_timer.setInterval(0);
+    connect(&_drain_timer, &QTimer::timeout, this, &task_scheduler::drain);
+}
+
+void task_scheduler::post(Lane lane, QObject *context, std::function<void()> task) {
+    hold(context);
+    _pending[lane].push_back(Task{context, context, std::move(task), tracing::current()});
+
+    if (!_drain_timer.isActive())
+        _drain_timer.start();
+}
+
+qsizetype task_scheduler::pending(Lane lane) const {
+    return static_cast<qsizetype>(_pending[lane].size());
+}
+
+void task_scheduler::drain() {
+    // Each lane gets at most its limit of tasks per event loop turn, and a lane
+    // only runs once every higher priority lane is empty, so bulk completions
+    // yield to new control and text frames read in between turns
+    for (int lane = Control; lane < LaneCount; lane++) {
+        for (int budget = _limits[lane]; budget > 0 && !_pending[lane].empty(); budget--) {
+            Task task = std::move(_pending[lane].front());
+            _pending[lane].pop_front();
+
+            if (task.context) {
+                tracing::scope scope(task.trace);
+                task.function();
+            }
+
+            release(task.owner);
+        }
+
+        if (!_pending[lane].empty())
+            break;
+    }
+
+    for (const std::deque<Task> &pending : _pending) {
+        if (!pending.empty()) {
+            _drain_timer.start();
+            break;
+        }
+    }
+}
+
+void task_scheduler::retire(QObject *context) {
+    if (_in_flight.contains(context))
+        _retiring.insert(context);
+    else
+        context->deleteLater();
+}
+
+void task_scheduler::hold(QObject *context) {
+    if (context)
+        _in_flight[context]++;
+}
+
+void task_scheduler::release(QObject *context) {
+    auto it = _in_flight.find(context);
+    if (it == _in_flight.end() || --*it > 0)
+        return;
+
+    _in_flight.erase(it);
+    if (_retiring.remove(context))
+        context->deleteLater();
+}
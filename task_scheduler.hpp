@@ -0,0 +1,87 @@
+#pragma once
+
+#include "tracing.hpp"
+#include <QHash>
+#include <QPointer>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+#include <QtConcurrent>
+#include <array>
+#include <deque>
+#include <functional>
+
+// Splits inbound work into priority lanes so a slow upload cannot hold up
+// presence or chat traffic. Tasks posted to the event loop always run in lane
+// order, and each lane has its own worker pool for blocking work, sized by its
+// concurrency limit (CHAT_APP_{CONTROL,TEXT,BULK}_CONCURRENCY). The trace
+// context current when work is handed over is current again when it runs.
+class task_scheduler : public QObject {
+    Q_OBJECT
+
+  public:
+    enum Lane {
+        Control,
+        Text,
+        Bulk,
+        LaneCount
+    };
+
+    static task_scheduler &instance();
+
+    // Queues a task for the event loop, dropped if context is gone by then
+    void post(Lane lane, QObject *context, std::function<void()> task);
+
+    // Runs work on the lane's pool, then hands the result to done on the event loop
+    template <typename Work, typename Done>
+    void run(Lane lane, QObject *context, Work work, Done done) {
+        using Result = std::invoke_result_t<Work>;
+
+        QPointer<QObject> guard(context);
+        tracing::context trace = tracing::current();
+        hold(context);
+
+        auto traced_work = [trace, work = std::move(work)]() mutable {
+            tracing::scope scope(trace);
+            return work();
+        };
+
+        QtConcurrent::run(&_pools[lane], std::move(traced_work)).then(this, [this, lane, context, guard, trace, done = std::move(done)](Result result) mutable {
+            tracing::scope scope(trace);
+
+            if (guard)
+                post(lane, guard, [done = std::move(done), result = std::move(result)]() mutable { done(std::move(result)); });
+
+            release(context);
+        });
+    }
+
+    qsizetype pending(Lane lane) const;
+
+    // Deletes context once nothing posted or run for it is still in flight,
+    // so work a client started right before leaving still completes
+    void retire(QObject *context);
+
+  private:
+    task_scheduler();
+
+    struct Task {
+        QObject *owner;
+        QPointer<QObject> context;
+        std::function<void()> function;
+        tracing::context trace;
+    };
+
+    std::array<QThreadPool, LaneCount> _pools{};
+    std::array<std::deque<Task>, LaneCount> _pending{};
+    std::array<int, LaneCount> _limits{8, 4, 2};
+
+    QTimer _drain_timer{};
+
+    QHash<QObject *, int> _in_flight{};
+    QSet<QObject *> _retiring{};
+
+    void drain();
+    void hold(QObject *context);
+    void release(QObject *context);
+};
@@ -0,0 +1,103 @@
+#include "timer_wheel.hpp"
+#include <algorithm>
+
+timer_wheel::timer_wheel(qint64 tick_ms, int slot_count, int levels)
+    : _tick_ms(std::max<qint64>(1, tick_ms)), _slot_count(std::max(2, slot_count)), _levels(std::max(1, levels)), _max_ticks(1) {
+    for (int level = 0; level < _levels; level++)
+        _max_ticks *= _slot_count;
+
+    _slots.resize(static_cast<std::size_t>(_slot_count * _levels));
+}
+
+void timer_wheel::schedule(quint64 key, qint64 delay_ms) {
+    cancel(key);
+
+    // Beyond the top level's span a timer fires at the edge of it
+    const qint64 ticks = std::clamp<qint64>((delay_ms + _tick_ms - 1) / _tick_ms, 1, _max_ticks - 1);
+
+    place(key, _current_tick + ticks);
+}
+
+void timer_wheel::place(quint64 key, qint64 expiry) {
+    const qint64 delta = expiry - _current_tick;
+
+    int level = 0;
+    qint64 span = 1;
+    while (level + 1 < _levels && delta >= span * _slot_count) {
+        span *= _slot_count;
+        level++;
+    }
+
+    int slot = static_cast<int>(level * _slot_count + (expiry / span) % _slot_count);
+
+    _slots[slot].insert(key);
+    _entries.insert(key, Entry{slot, expiry});
+}
+
+void timer_wheel::cancel(quint64 key) {
+    auto it = _entries.find(key);
+    if (it == _entries.end())
+        return;
+
+    _slots[it->slot].remove(key);
+    _entries.erase(it);
+}
+
+bool timer_wheel::contains(quint64 key) const {
+    return _entries.contains(key);
+}
+
+bool timer_wheel::isEmpty() const {
+    return _entries.isEmpty();
+}
+
+qsizetype timer_wheel::size() const {
+    return _entries.size();
+}
+
+void timer_wheel::cascade(int level) {
+    qint64 span = 1;
+    for (int index = 0; index < level; index++)
+        span *= _slot_count;
+
+    // Everything here is due within one span of the level below, so each key
+    // lands on a lower level, or on the current level 0 slot if due now
+    QSet<quint64> due;
+    due.swap(_slots[level * _slot_count + (_current_tick / span) % _slot_count]);
+
+    for (quint64 key : due)
+        place(key, _entries.value(key).expiry);
+}
+
+QList<quint64> timer_wheel::advance(qint64 now_ms) {
+    QList<quint64> expired;
+
+    const qint64 target_tick = now_ms / _tick_ms;
+    while (_current_tick < target_tick) {
+        // Nothing left to expire, so skip the idle stretch in one step
+        if (_entries.isEmpty()) {
+            _current_tick = target_tick;
+            break;
+        }
+
+        _current_tick++;
+
+        // A higher level slot comes due each time the levels below it wrap;
+        // the coarsest goes first so its keys can fall through to level 0
+        int wrapped = 0;
+        for (qint64 span = _slot_count; wrapped + 1 < _levels && _current_tick % span == 0; span *= _slot_count)
+            wrapped++;
+
+        for (int level = wrapped; level > 0; level--)
+            cascade(level);
+
+        QSet<quint64> &slot = _slots[_current_tick % _slot_count];
+        for (quint64 key : slot) {
+            expired.append(key);
+            _entries.remove(key);
+        }
+        slot.clear();
+    }
+
+    return expired;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <vector>
+
+// Hierarchical timer wheel keyed by caller ids. Level 0 has one slot per
+// tick, and each level above covers slot_count times the span of the one
+// below; timers sit on the coarsest level that still separates them and move
+// down a level as their time approaches. A tick only touches its own level 0
+// slot, plus one higher slot every slot_count ticks, so the cost per tick does
+// not grow with the number of far-off timers. Each key holds at most one timer,
+// scheduling an existing key moves it, and both schedule and cancel are O(1).
+class timer_wheel {
+  public:
+    timer_wheel(qint64 tick_ms, int slot_count, int levels = 4);
+
+    void schedule(quint64 key, qint64 delay_ms);
+    void cancel(quint64 key);
+    bool contains(quint64 key) const;
+    bool isEmpty() const;
+    qsizetype size() const;
+
+    // Moves the wheel forward to now_ms and returns the keys that expired
+    QList<quint64> advance(qint64 now_ms);
+
+  private:
+    struct Entry {
+        int slot;
+        qint64 expiry;
+    };
+
+    qint64 _tick_ms;
+    qint64 _slot_count;
+    int _levels;
+    qint64 _max_ticks;
+    qint64 _current_tick{0};
+    std::vector<QSet<quint64>> _slots;
+    QHash<quint64, Entry> _entries{};
+
+    void place(quint64 key, qint64 expiry);
+    void cascade(int level);
+};
@@ -0,0 +1,140 @@
+#include "tls_config.hpp"
+#include "logger.hpp"
+#include <QFile>
+#include <QSslCertificate>
+#include <QSslKey>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#include <cstring>
+#include <memory>
+
+namespace {
+
+struct ticket_key {
+    unsigned char name[16];
+    unsigned char cipher[32];
+    unsigned char mac[32];
+};
+
+// Null if the system RNG failed, which leaves every handshake a full one
+const ticket_key *process_key() {
+    static const std::unique_ptr<ticket_key> key = [] {
+        auto generated = std::make_unique<ticket_key>();
+        if (RAND_bytes(generated->name, sizeof(generated->name)) <= 0 || RAND_bytes(generated->cipher, sizeof(generated->cipher)) <= 0 || RAND_bytes(generated->mac, sizeof(generated->mac)) <= 0) {
+            logger::error("tls_ticket_key_failed");
+            generated.reset();
+        }
+
+        return generated;
+    }();
+
+    return key.get();
+}
+
+// OpenSSL's ticket key callback: 1 sealed or opened, 0 unknown key (full
+// handshake), -1 error
+int seal_or_open_ticket(SSL *, unsigned char key_name[16], unsigned char iv[EVP_MAX_IV_LENGTH], EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, int seal) {
+    const ticket_key *key = process_key();
+    if (!key)
+        return seal ? -1 : 0;
+
+    OSSL_PARAM mac_params[] = {OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, const_cast<unsigned char *>(key->mac), sizeof(key->mac)),
+                               OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char *>("SHA256"), 0),
+                               OSSL_PARAM_construct_end()};
+
+    if (seal) {
+        std::memcpy(key_name, key->name, sizeof(key->name));
+        if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) <= 0)
+            return -1;
+
+        return EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key->cipher, iv) && EVP_MAC_CTX_set_params(mac, mac_params) ? 1 : -1;
+    }
+
+    // Sealed before a restart
+    if (std::memcmp(key_name, key->name, sizeof(key->name)) != 0)
+        return 0;
+
+    return EVP_MAC_CTX_set_params(mac, mac_params) && EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key->cipher, iv) ? 1 : -1;
+}
+
+}
+
+namespace tls_config {
+
+bool requested() {
+    return std::getenv("CHAT_APP_TLS_CERT") && std::getenv("CHAT_APP_TLS_KEY");
+}
+
+bool load(QSslConfiguration &configuration) {
+    const char *certificate_path = std::getenv("CHAT_APP_TLS_CERT");
+    const char *key_path = std::getenv("CHAT_APP_TLS_KEY");
+    if (!certificate_path || !key_path)
+        return false;
+
+    QList<QSslCertificate> chain = QSslCertificate::fromPath(QString::fromLocal8Bit(certificate_path), QSsl::Pem);
+    if (chain.isEmpty()) {
+        logger::error("tls_certificate_unavailable", {{"path", certificate_path}});
+        return false;
+    }
+
+    QFile key_file(QString::fromLocal8Bit(key_path));
+    if (!key_file.open(QIODevice::ReadOnly)) {
+        logger::error("tls_key_unavailable", {{"path", key_path}, {"error", key_file.errorString()}});
+        return false;
+    }
+
+    const char *passphrase = std::getenv("CHAT_APP_TLS_KEY_PASSPHRASE");
+    const QByteArray pem = key_file.readAll();
+
+    // The key file does not say its algorithm, so try the ones a server certificate uses
+    QSslKey key;
+    for (QSsl::KeyAlgorithm algorithm : {QSsl::Ec, QSsl::Rsa}) {
+        key = QSslKey(pem, algorithm, QSsl::Pem, QSsl::PrivateKey, passphrase ? QByteArray(passphrase) : QByteArray());
+        if (!key.isNull())
+            break;
+    }
+
+    if (key.isNull()) {
+        logger::error("tls_key_unreadable", {{"path", key_path}});
+        return false;
+    }
+
+    configuration = QSslConfiguration::defaultConfiguration();
+    configuration.setLocalCertificateChain(chain);
+    configuration.setPrivateKey(key);
+    configuration.setPeerVerifyMode(QSslSocket::VerifyNone);
+    configuration.setProtocol(QSsl::TlsV1_2OrLater);
+    configuration.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+
+    // Handed to OpenSSL's SSL_CONF_cmd; other TLS backends ignore them
+    const char *tickets = std::getenv("CHAT_APP_TLS_TICKETS");
+    configuration.setBackendConfigurationOption("NumTickets", QByteArray(tickets ? tickets : "2"));
+
+    const char *ktls = std::getenv("CHAT_APP_TLS_KTLS");
+    configuration.setBackendConfigurationOption("Options", QByteArray(ktls && std::atoi(ktls) ? "SessionTicket,KTLS" : "SessionTicket"));
+
+    logger::info("tls_configured", {{"certificate", certificate_path}, {"chain_length", static_cast<int>(chain.size())}, {"ktls", ktls && std::atoi(ktls) != 0}});
+    return true;
+}
+
+bool share_tickets(QSslSocket *socket) {
+    // The SSL handle is only ours to touch when Qt runs on the same OpenSSL
+    static const bool compatible = [] {
+        bool same_openssl = QSslSocket::activeBackend() == QStringLiteral("openssl") && QSslSocket::sslLibraryVersionNumber() >> 28 == OPENSSL_VERSION_NUMBER >> 28;
+        if (!same_openssl)
+            logger::warning("tls_resumption_unavailable", {{"backend", QSslSocket::activeBackend()}, {"library", QSslSocket::sslLibraryVersionString()}});
+
+        return same_openssl;
+    }();
+
+    SSL *ssl = compatible ? static_cast<SSL *>(socket->sslHandle()) : nullptr;
+    if (!ssl)
+        return false;
+
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(SSL_get_SSL_CTX(ssl), seal_or_open_ticket);
+    return true;
+}
+
+}
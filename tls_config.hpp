@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QSslConfiguration>
+#include <QSslSocket>
+
+// TLS for the listener. Setting CHAT_APP_TLS_CERT (PEM, leaf first, then the
+// chain) and CHAT_APP_TLS_KEY (PEM, CHAT_APP_TLS_KEY_PASSPHRASE if encrypted)
+// switches the server to wss:// on its usual port, so no terminating proxy
+// is needed in front of it. TLS 1.2 is the floor.
+//
+// Reconnects resume with session tickets. Qt builds an SSL context, and with
+// it a ticket key, for every accepted socket, so share_tickets points each
+// context at one process-wide key before its handshake reads the ClientHello;
+// a ticket from any connection then opens on any other until the process
+// restarts. CHAT_APP_TLS_TICKETS (default 2) sets how many a TLS 1.3
+// handshake hands out, and benchmarks/tls_handshake measures the resumed
+// round. CHAT_APP_TLS_KTLS=1 asks OpenSSL to move record encryption into the
+// kernel where it supports it.
+namespace tls_config {
+
+// A certificate and key are configured
+bool requested();
+
+// False, after logging, when the certificate or key cannot be loaded
+bool load(QSslConfiguration &configuration);
+
+// Seals and opens this socket's tickets with the process-wide key. False,
+// logged once, when Qt's TLS backend is not the OpenSSL this was built with
+bool share_tickets(QSslSocket *socket);
+
+}
@@ -0,0 +1,184 @@
+#include "traffic_capture.hpp"
+#include "logger.hpp"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QRandomGenerator>
+
+namespace {
+
+void put_varint(QByteArray &buffer, quint64 value) {
+    while (value >= 0x80) {
+        buffer.append(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+
+    buffer.append(static_cast<char>(value));
+}
+
+bool get_varint(QIODevice &device, quint64 &value) {
+    value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        char byte;
+        if (!device.getChar(&byte))
+            return false;
+
+        value |= static_cast<quint64>(static_cast<unsigned char>(byte) & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+// Keyed splitmix, folded into the positive int range the server uses for IDs
+qint64 pseudonym(qint64 value, quint64 key) {
+    quint64 hash = static_cast<quint64>(value) ^ key;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+
+    return static_cast<qint64>(hash % 2147483646) + 1;
+}
+
+bool kept(const QString &key) {
+    return key == "type" || key == "time" || key == "full_time" || key == "time_zone";
+}
+
+QJsonValue scrub(const QJsonValue &value, const QString &key, quint64 key_seed) {
+    switch (value.type()) {
+    case QJsonValue::Object: {
+        QJsonObject object = value.toObject();
+        for (auto it = object.begin(); it != object.end(); ++it)
+            it.value() = scrub(it.value(), it.key(), key_seed);
+
+        return object;
+    }
+    case QJsonValue::Array: {
+        QJsonArray array = value.toArray();
+        for (qsizetype index = 0; index < array.size(); index++)
+            array[index] = scrub(array[index], key, key_seed);
+
+        return array;
+    }
+    case QJsonValue::Double:
+        return value.toDouble() == static_cast<double>(value.toInteger()) ? QJsonValue(pseudonym(value.toInteger(), key_seed)) : value;
+    case QJsonValue::String:
+        // 'A' keeps base64 payloads decodable, at the same size
+        return kept(key) ? value : QJsonValue(QString(value.toString().size(), QChar('A')));
+    default:
+        return value;
+    }
+}
+
+}
+
+traffic_capture *traffic_capture::create(QObject *parent) {
+    const char *path = std::getenv("CHAT_APP_CAPTURE_FILE");
+
+    return path && *path ? new traffic_capture(QString::fromLocal8Bit(path), parent) : nullptr;
+}
+
+traffic_capture::traffic_capture(const QString &path, QObject *parent)
+    : QObject(parent), _file(path), _key(QRandomGenerator::system()->generate64()) {
+    if (const char *value = std::getenv("CHAT_APP_CAPTURE_MAX_BYTES"))
+        _max_bytes = std::atoll(value);
+
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        logger::error("capture_unavailable", {{"path", path}, {"error", _file.errorString()}});
+        return;
+    }
+
+    _file.write(Magic, sizeof(Magic) - 1);
+    _clock.start();
+
+    connect(&_flush_timer, &QTimer::timeout, this, &traffic_capture::flush);
+    _flush_timer.start(1000);
+
+    logger::info("capture_started", {{"path", path}});
+}
+
+traffic_capture::~traffic_capture() {
+    flush();
+}
+
+void traffic_capture::record(const QWebSocket *socket, const QByteArray &frame, bool binary) {
+    if (!_file.isOpen() || _written >= _max_bytes)
+        return;
+
+    auto it = _connections.find(socket);
+    if (it == _connections.end())
+        it = _connections.insert(socket, _next_connection++);
+
+    append(*it, false, binary, anonymize(frame, _key));
+}
+
+void traffic_capture::closed(const QWebSocket *socket) {
+    auto it = _connections.find(socket);
+    if (it == _connections.end())
+        return;
+
+    if (_file.isOpen() && _written < _max_bytes)
+        append(*it, true, false, QByteArray());
+
+    _connections.erase(it);
+}
+
+void traffic_capture::append(quint32 connection, bool closed, bool binary, const QByteArray &frame) {
+    qint64 now_ns = _clock.nsecsElapsed();
+
+    qsizetype before = _buffer.size();
+    put_varint(_buffer, static_cast<quint64>(now_ns - _last_ns));
+    put_varint(_buffer, static_cast<quint64>(connection) << 2 | static_cast<quint64>(closed) << 1 | static_cast<quint64>(binary));
+    put_varint(_buffer, static_cast<quint64>(frame.size()));
+    _buffer.append(frame);
+
+    _last_ns = now_ns;
+    _written += _buffer.size() - before;
+
+    if (_buffer.size() >= FlushBytes)
+        flush();
+
+    if (_written >= _max_bytes) {
+        logger::warning("capture_full", {{"bytes", _written}});
+        flush();
+    }
+}
+
+void traffic_capture::flush() {
+    if (_buffer.isEmpty() || !_file.isOpen())
+        return;
+
+    _file.write(_buffer);
+    _file.flush();
+    _buffer.clear();
+}
+
+QByteArray traffic_capture::anonymize(const QByteArray &frame, quint64 key) {
+    QJsonParseError error;
+    QJsonDocument json_doc = QJsonDocument::fromJson(frame, &error);
+
+    // Unparseable frames keep only their size
+    if (error.error != QJsonParseError::NoError || !json_doc.isObject())
+        return QByteArray(frame.size(), ' ');
+
+    return QJsonDocument(scrub(json_doc.object(), QString(), key).toObject()).toJson(QJsonDocument::Compact);
+}
+
+bool traffic_capture::read_header(QIODevice &device) {
+    return device.read(sizeof(Magic) - 1) == QByteArray(Magic, sizeof(Magic) - 1);
+}
+
+bool traffic_capture::read(QIODevice &device, Record &record) {
+    quint64 delay_ns, connection, length;
+    if (!get_varint(device, delay_ns) || !get_varint(device, connection) || !get_varint(device, length))
+        return false;
+
+    record.delay_ns = static_cast<qint64>(delay_ns);
+    record.connection = static_cast<quint32>(connection >> 2);
+    record.closed = connection & 2;
+    record.binary = connection & 1;
+    record.frame = device.read(static_cast<qint64>(length));
+
+    return record.frame.size() == static_cast<qsizetype>(length);
+}
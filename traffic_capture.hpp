@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonObject>
+#include <QTimer>
+
+class QWebSocket;
+
+// Records inbound frames to CHAT_APP_CAPTURE_FILE for benchmarks/traffic_replay.
+// Frames are anonymized before they are written: every integer goes through a
+// keyed pseudonym that is stable for the capture, so who talks to whom
+// survives but real numbers and IDs do not, and every string except the frame
+// type and times becomes filler of the same length. Sizes and the frame mix
+// are what matter for performance, and both are kept.
+//
+// The log is "CHATCAP1" followed by records of varints: nanoseconds since the
+// previous record, connection << 2 | closed << 1 | binary, frame length, then
+// the frame. Capture stops at CHAT_APP_CAPTURE_MAX_BYTES (default 1 GiB).
+class traffic_capture : public QObject {
+    Q_OBJECT
+
+  public:
+    struct Record {
+        qint64 delay_ns{0};
+        quint32 connection{0};
+        bool binary{false};
+        bool closed{false};
+        QByteArray frame{};
+    };
+
+    static constexpr char Magic[] = "CHATCAP1";
+
+    // Null unless capture is configured
+    static traffic_capture *create(QObject *parent);
+    ~traffic_capture();
+
+    void record(const QWebSocket *socket, const QByteArray &frame, bool binary);
+    void closed(const QWebSocket *socket);
+
+    // For the replay side; false at the end of the log or on a torn record
+    static bool read_header(QIODevice &device);
+    static bool read(QIODevice &device, Record &record);
+
+    static QByteArray anonymize(const QByteArray &frame, quint64 key);
+
+  private:
+    traffic_capture(const QString &path, QObject *parent);
+
+    QFile _file{};
+    QByteArray _buffer{};
+    QTimer _flush_timer{};
+    QElapsedTimer _clock{};
+    qint64 _last_ns{0};
+    qint64 _written{0};
+    qint64 _max_bytes{qint64(1) << 30};
+    quint64 _key{0};
+
+    QHash<const QWebSocket *, quint32> _connections{};
+    quint32 _next_connection{1};
+
+    void append(quint32 connection, bool closed, bool binary, const QByteArray &frame);
+    void flush();
+
+    static constexpr qsizetype FlushBytes = 64 * 1024;
+};
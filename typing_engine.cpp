@@ -0,0 +1,70 @@
+#include "typing_engine.hpp"
+
+namespace {
+constexpr qint64 tick_ms = 250;
+constexpr int slot_count = 64;
+}
+
+typing_engine::typing_engine(QObject *parent)
+    : QObject(parent), _wheels{timer_wheel(tick_ms, slot_count), timer_wheel(tick_ms, slot_count)} {
+    if (const char *value = std::getenv("CHAT_APP_TYPING_INTERVAL_MS"))
+        _interval = std::atoll(value);
+
+    if (const char *value = std::getenv("CHAT_APP_TYPING_TIMEOUT_MS"))
+        _timeout = std::atoll(value);
+
+    _clock.start();
+
+    _ticker.setInterval(tick_ms);
+    connect(&_ticker, &QTimer::timeout, this, &typing_engine::on_tick);
+}
+
+quint64 typing_engine::key_of(int sender_ID, int conversation_ID) {
+    return (static_cast<quint64>(static_cast<quint32>(sender_ID)) << 32) | static_cast<quint32>(conversation_ID);
+}
+
+void typing_engine::typing(const int &sender_ID, const int &conversation_ID, bool group, const QString &sender_name) {
+    const quint64 key = key_of(sender_ID, conversation_ID);
+    const qint64 now = _clock.elapsed();
+
+    timer_wheel &wheel = _wheels[group];
+    QHash<quint64, State> &states = _states[group];
+
+    // The wheels stop turning while idle, catch this one up before scheduling
+    if (wheel.isEmpty())
+        wheel.advance(now);
+    if (!_ticker.isActive())
+        _ticker.start();
+
+    wheel.schedule(key, _timeout);
+
+    auto it = states.find(key);
+    if (it == states.end()) {
+        states.insert(key, State{sender_name, now});
+        emit typing_changed(sender_ID, conversation_ID, group, sender_name, true);
+
+        return;
+    }
+
+    if (now - it->last_broadcast < _interval)
+        return;
+
+    it->last_broadcast = now;
+    emit typing_changed(sender_ID, conversation_ID, group, it->sender_name, true);
+}
+
+void typing_engine::on_tick() {
+    for (bool group : {false, true}) {
+        for (quint64 key : _wheels[group].advance(_clock.elapsed())) {
+            State state = _states[group].take(key);
+
+            const int sender_ID = static_cast<int>(static_cast<quint32>(key >> 32));
+            const int conversation_ID = static_cast<int>(static_cast<quint32>(key));
+
+            emit typing_changed(sender_ID, conversation_ID, group, state.sender_name, false);
+        }
+    }
+
+    if (_wheels[false].isEmpty() && _wheels[true].isEmpty())
+        _ticker.stop();
+}
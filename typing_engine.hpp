@@ -0,0 +1,44 @@
+#pragma once
+
+#include "timer_wheel.hpp"
+#include <QElapsedTimer>
+#include <QTimer>
+#include <array>
+
+// Collapses typing keystrokes per (sender, conversation) into at most one
+// broadcast per interval, and reports a stop once a sender goes quiet for
+// the timeout. Conversation is the receiver for direct chats, the group ID
+// otherwise.
+class typing_engine : public QObject {
+    Q_OBJECT
+
+  public:
+    typing_engine(QObject *parent = nullptr);
+
+    void typing(const int &sender_ID, const int &conversation_ID, bool group, const QString &sender_name = QString());
+
+  signals:
+    void typing_changed(int sender_ID, int conversation_ID, bool group, const QString &sender_name, bool is_typing);
+
+  private slots:
+    void on_tick();
+
+  private:
+    struct State {
+        QString sender_name;
+        qint64 last_broadcast;
+    };
+
+    qint64 _interval{3000};
+    qint64 _timeout{5000};
+
+    QElapsedTimer _clock{};
+    QTimer _ticker{};
+
+    // Direct chats and groups number their conversations independently, so
+    // each keeps its own wheel and states, indexed by the group flag
+    std::array<timer_wheel, 2> _wheels;
+    std::array<QHash<quint64, State>, 2> _states{};
+
+    static quint64 key_of(int sender_ID, int conversation_ID);
+};
@@ -0,0 +1,301 @@
+#include "unread_counters.hpp"
+#include "logger.hpp"
+#include <QDataStream>
+#include <QDateTime>
+#include <utility>
+
+unread_counters::unread_counters(Repository &db, QObject *parent)
+    : QObject(parent), _db(db) {
+    _log.setFileName(std::getenv("CHAT_APP_UNREAD_LOG") ? QString(std::getenv("CHAT_APP_UNREAD_LOG")) : QString("unread_counters.log"));
+
+    replay();
+
+    if (!_log.open(QIODevice::ReadWrite))
+        logger::error("unread_log_unavailable", {{"file", _log.fileName()}, {"error", _log.errorString()}});
+    else
+        _log.seek(_log.size());
+
+    flush();
+
+    connect(&_flush_timer, &QTimer::timeout, this, qOverload<>(&unread_counters::flush));
+    _flush_timer.start(std::getenv("CHAT_APP_UNREAD_FLUSH_MS") ? std::atoi(std::getenv("CHAT_APP_UNREAD_FLUSH_MS")) : 5000);
+
+    connect(&_log_timer, &QTimer::timeout, this, &unread_counters::sync);
+    _log_timer.start(std::getenv("CHAT_APP_UNREAD_LOG_SYNC_MS") ? std::atoi(std::getenv("CHAT_APP_UNREAD_LOG_SYNC_MS")) : 50);
+}
+
+unread_counters::~unread_counters() {
+    flush();
+    sync();
+}
+
+void unread_counters::increment(int account_ID, int conversation_ID, bool group) {
+    if (account_ID > 0 && conversation_ID > 0)
+        mutate(Key{account_ID, conversation_ID, group}, Increment);
+}
+
+void unread_counters::reset(int account_ID, int conversation_ID, bool group) {
+    // The conversation comes straight from the client
+    if (account_ID > 0 && conversation_ID > 0)
+        mutate(Key{account_ID, conversation_ID, group}, Reset);
+}
+
+void unread_counters::flush() {
+    while (!_retries.empty()) {
+        if (!write(_retries.front()))
+            return;
+
+        _retries.pop_front();
+    }
+
+    Batch batch;
+    qint64 checkpoint_end = 0;
+    {
+        std::lock_guard log_lock(_log_mutex);
+
+        batch.sequence = next_sequence();
+        for (Shard &shard : _shards) {
+            std::lock_guard lock(shard.mutex);
+
+            batch.counters.insert(shard.counters);
+            shard.counters.clear();
+        }
+
+        // On disk before the write, or a crash could replay it as never sent
+        append(0, Checkpoint, batch.sequence);
+        sync_log();
+        checkpoint_end = _log.size();
+    }
+
+    if (!write(batch)) {
+        _retries.push_back(std::move(batch));
+        return;
+    }
+
+    std::lock_guard log_lock(_log_mutex);
+    compact(checkpoint_end);
+}
+
+void unread_counters::flush(int account_ID) {
+    // Keeps batches in sequence order; the periodic flush retries first
+    if (!_retries.empty())
+        return;
+
+    Shard &shard = shard_of(account_ID);
+
+    Batch batch;
+    {
+        std::lock_guard log_lock(_log_mutex);
+        {
+            std::lock_guard lock(shard.mutex);
+            for (auto it = shard.counters.begin(); it != shard.counters.end();) {
+                if (it.key().account_ID == account_ID) {
+                    batch.counters.insert(it.key(), it.value());
+                    it = shard.counters.erase(it);
+                } else
+                    ++it;
+            }
+        }
+
+        if (batch.counters.isEmpty())
+            return;
+
+        batch.sequence = next_sequence();
+        append(Key{account_ID, 0, false}, AccountCheckpoint, batch.sequence);
+        sync_log();
+    }
+
+    // The log keeps the batch until the next full flush compacts it; replaying
+    // it again is a no-op for entries that already recorded its sequence
+    if (!write(batch))
+        _retries.push_back(std::move(batch));
+}
+
+unread_counters::Metrics unread_counters::metrics() const {
+    return Metrics{_mutations.load(std::memory_order_relaxed), _writes.load(std::memory_order_relaxed)};
+}
+
+void unread_counters::apply(QHash<Key, Counter> &counters, const Key &key, Operation operation) {
+    if (operation == Increment)
+        counters[key].count++;
+    else if (operation == Reset)
+        counters[key] = Counter{0, true};
+}
+
+unread_counters::Shard &unread_counters::shard_of(int account_ID) {
+    return _shards[static_cast<quint32>(account_ID) % ShardCount];
+}
+
+void unread_counters::mutate(const Key &key, Operation operation) {
+    Shard &shard = shard_of(key.account_ID);
+
+    // Logged and applied under one lock, so a checkpoint never falls between
+    std::lock_guard log_lock(_log_mutex);
+    append(key, operation);
+
+    std::lock_guard lock(shard.mutex);
+    apply(shard.counters, key, operation);
+
+    _mutations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void unread_counters::append(const Key &key, Operation operation, quint64 sequence) {
+    if (!_log.isOpen())
+        return;
+
+    quint64 packed = (static_cast<quint64>(static_cast<quint32>(key.account_ID)) << 32) | static_cast<quint32>(key.conversation_ID);
+    quint8 code = (operation == Increment || operation == Reset) && key.group ? static_cast<quint8>(operation + GroupOffset) : static_cast<quint8>(operation);
+
+    QDataStream stream(&_log_buffer, QIODevice::WriteOnly | QIODevice::Append);
+    stream << packed << code;
+    if (operation == Checkpoint || operation == AccountCheckpoint)
+        stream << sequence;
+
+    if (_log_buffer.size() >= LogBatchBytes)
+        sync_log();
+}
+
+void unread_counters::sync_log() {
+    if (_log_buffer.isEmpty() || !_log.isOpen())
+        return;
+
+    _log.write(_log_buffer);
+    _log.flush();
+    _log_buffer.clear();
+}
+
+void unread_counters::compact(qint64 offset) {
+    if (!_log.isOpen())
+        return;
+
+    // Whatever was logged after the checkpoint still has to survive a crash
+    sync_log();
+    _log.seek(offset);
+    QByteArray tail = _log.readAll();
+
+    _log.resize(0);
+    _log.seek(0);
+    _log.write(tail);
+    _log.flush();
+}
+
+quint64 unread_counters::next_sequence() {
+    // Stays above every sequence from before a restart unless the clock
+    // steps back further than the downtime
+    _sequence = std::max(_sequence + 1, static_cast<quint64>(QDateTime::currentMSecsSinceEpoch()));
+
+    return _sequence;
+}
+
+void unread_counters::sync() {
+    std::lock_guard lock(_log_mutex);
+    sync_log();
+}
+
+void unread_counters::replay() {
+    if (!_log.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&_log);
+
+    QHash<Key, Counter> pending;
+    qint64 replayed = 0;
+    while (!stream.atEnd()) {
+        quint64 packed = 0;
+        quint8 operation = 0;
+        quint64 sequence = 0;
+        stream >> packed >> operation;
+        if (operation == Checkpoint || operation == AccountCheckpoint)
+            stream >> sequence;
+
+        if (stream.status() != QDataStream::Ok)
+            break;
+
+        Key key{static_cast<qint32>(packed >> 32), static_cast<qint32>(static_cast<quint32>(packed)), false};
+        if (operation == LegacyIncrement || operation == LegacyReset) {
+            key.conversation_ID = static_cast<qint32>(static_cast<quint32>(packed) >> 1);
+            key.group = packed & 1;
+            operation = operation == LegacyIncrement ? Increment : Reset;
+        } else if (operation == GroupIncrement || operation == GroupReset) {
+            key.group = true;
+            operation -= GroupOffset;
+        }
+
+        int account_ID = key.account_ID;
+        auto of_account = [account_ID](const std::pair<const Key &, Counter &> &counter) { return counter.first.account_ID == account_ID; };
+
+        // Checkpoints turn what came before them back into the batches that
+        // may or may not have reached the database
+        switch (static_cast<Operation>(operation)) {
+        case Checkpoint:
+            _retries.push_back(Batch{sequence, std::exchange(pending, {})});
+            break;
+        case AccountCheckpoint: {
+            Batch batch{sequence, {}};
+            for (auto it = pending.cbegin(); it != pending.cend(); ++it) {
+                if (it.key().account_ID == account_ID)
+                    batch.counters.insert(it.key(), it.value());
+            }
+
+            pending.removeIf(of_account);
+            _retries.push_back(std::move(batch));
+            break;
+        }
+        case Flushed:
+            pending.removeIf(of_account);
+            break;
+        default:
+            apply(pending, key, static_cast<Operation>(operation));
+            break;
+        }
+
+        _sequence = std::max(_sequence, sequence);
+        replayed++;
+    }
+
+    _log.close();
+
+    for (auto it = pending.cbegin(); it != pending.cend(); ++it)
+        shard_of(it.key().account_ID).counters.insert(it.key(), it.value());
+
+    if (replayed)
+        logger::info("unread_log_replayed", {{"updates", replayed}, {"batches", static_cast<qint64>(_retries.size())}});
+}
+
+bool unread_counters::write(const Batch &batch) {
+    QJsonArray operations;
+    for (auto it = batch.counters.cbegin(); it != batch.counters.cend(); ++it) {
+        int account_ID = it.key().account_ID;
+        int conversation_ID = it.key().conversation_ID;
+        bool group = it.key().group;
+
+        if (!it->reset && !it->count)
+            continue;
+
+        QString entry = group ? "groups.$[entry]." : "contacts.$[entry].";
+        QString field = entry + (group ? "group_unread_messages" : "unread_messages");
+
+        // Entries that have seen this batch, or a later one, are left alone
+        QJsonObject array_filter{{group ? "entry.groupID" : "entry.chatID", conversation_ID},
+                                 {"entry.unread_sequence", QJsonObject{{"$not", QJsonObject{{"$gte", static_cast<qint64>(batch.sequence)}}}}}};
+
+        QJsonObject update_object{{"$set", QJsonObject{{entry + "unread_sequence", static_cast<qint64>(batch.sequence)}}}};
+        if (it->reset)
+            update_object["$set"] = QJsonObject{{entry + "unread_sequence", static_cast<qint64>(batch.sequence)}, {field, it->count}};
+        else
+            update_object["$inc"] = QJsonObject{{field, it->count}};
+
+        operations.append(QJsonObject{{"update_one", QJsonObject{{"filter", QJsonObject{{"_id", account_ID}}}, {"update", update_object}, {"array_filters", QJsonArray{array_filter}}}}});
+    }
+
+    if (operations.isEmpty())
+        return true;
+
+    // The same positional updates apply to both collections, one round trip each
+    bool written = _db.bulk_write("accounts", operations, false);
+    written = _db.bulk_write("inboxes", operations, false) && written;
+
+    _writes.fetch_add(2, std::memory_order_relaxed);
+
+    return written;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "repository.hpp"
+#include <QFile>
+#include <QTimer>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+// Holds unread counts per (account, conversation) in memory and writes them
+// to accounts and inboxes with one bulk write per collection, every
+// CHAT_APP_UNREAD_FLUSH_MS and whenever the account disconnects. Mutations
+// are buffered into a write-ahead log (CHAT_APP_UNREAD_LOG), written out every
+// CHAT_APP_UNREAD_LOG_SYNC_MS or 64 KiB, replayed on startup and compacted
+// after a successful full flush.
+//
+// Every flush is a batch with a sequence, logged before the write. Each
+// entry it touches records the sequence and skips batches it has already
+// seen, so replaying a batch that was written just before a crash is
+// harmless. A batch that fails to write is retried, in order, before any
+// newer one. Non-positive account or conversation IDs are ignored.
+class unread_counters : public QObject {
+    Q_OBJECT
+
+  public:
+    struct Metrics {
+        qint64 mutations{0};
+        qint64 writes{0};
+    };
+
+    unread_counters(Repository &db, QObject *parent = nullptr);
+    ~unread_counters();
+
+    void increment(int account_ID, int conversation_ID, bool group);
+    void reset(int account_ID, int conversation_ID, bool group);
+
+    void flush();
+    void flush(int account_ID);
+
+    Metrics metrics() const;
+
+  private:
+    // Flushed only appears in logs written before batches had sequences, and
+    // the Legacy operations in logs that packed the group flag into the key.
+    // A Group operation is its chat operation plus GroupOffset
+    enum Operation : quint8 {
+        LegacyIncrement,
+        LegacyReset,
+        Flushed,
+        Checkpoint,
+        AccountCheckpoint,
+        Increment,
+        Reset,
+        GroupIncrement,
+        GroupReset
+    };
+
+    static constexpr quint8 GroupOffset = GroupIncrement - Increment;
+
+    // The conversation keeps all 32 bits; a chat and a group with the same ID
+    // are different counters
+    struct Key {
+        qint32 account_ID{0};
+        qint32 conversation_ID{0};
+        bool group{false};
+
+        bool operator==(const Key &other) const = default;
+        friend size_t qHash(const Key &key, size_t seed = 0) { return qHashMulti(seed, key.account_ID, key.conversation_ID, key.group); }
+    };
+
+    // A pending reset means the stored count is replaced rather than bumped
+    struct Counter {
+        qint32 count{0};
+        bool reset{false};
+    };
+
+    struct Shard {
+        std::mutex mutex{};
+        QHash<Key, Counter> counters{};
+    };
+
+    struct Batch {
+        quint64 sequence{0};
+        QHash<Key, Counter> counters{};
+    };
+
+    static constexpr int ShardCount = 16;
+    static constexpr qsizetype LogBatchBytes = 64 * 1024;
+
+    Repository &_db;
+
+    std::array<Shard, ShardCount> _shards{};
+
+    // Guards the log and orders mutations against checkpoints
+    QFile _log{};
+    QByteArray _log_buffer{};
+    std::mutex _log_mutex{};
+    quint64 _sequence{0};
+
+    // Main thread only
+    std::deque<Batch> _retries{};
+
+    QTimer _flush_timer{};
+    QTimer _log_timer{};
+
+    std::atomic<qint64> _mutations{0};
+    std::atomic<qint64> _writes{0};
+
+    static void apply(QHash<Key, Counter> &counters, const Key &key, Operation operation);
+    Shard &shard_of(int account_ID);
+
+    // operation is Increment or Reset
+    void mutate(const Key &key, Operation operation);
+
+    // Callers hold _log_mutex
+    void append(const Key &key, Operation operation, quint64 sequence = 0);
+    void sync_log();
+    void compact(qint64 offset);
+    quint64 next_sequence();
+
+    void sync();
+    void replay();
+    bool write(const Batch &batch);
+};